@@ -0,0 +1,97 @@
+#include "arena.h"
+
+#include <memory>
+#include <new>
+
+chip8emu::Machine::Machine(std::uint32_t seed)
+   : ppu(), cpu(std::shared_ptr<PPU>(std::shared_ptr<PPU>(), &ppu), seed)
+{
+
+}
+
+chip8emu::Machine::Machine(const Machine &prototype)
+   : ppu(), cpu(std::shared_ptr<PPU>(std::shared_ptr<PPU>(), &ppu), prototype.cpu)
+{
+
+}
+
+chip8emu::MachineArena::MachineArena(void *memory, std::size_t size)
+   : mSlots(nullptr), mCapacity(0), mUsed(0), mFree(nullptr), mSize(0)
+{
+   // Start at the first aligned address, the remainder is unused.
+   if(std::align(alignof(Slot), sizeof(Slot), memory, size) != nullptr) {
+      mSlots = static_cast<Slot*>(memory);
+      mCapacity = size / sizeof(Slot);
+   }
+}
+
+chip8emu::MachineArena::~MachineArena()
+{
+   for(std::size_t i = 0; i < mUsed; i++) {
+      if(mSlots[i].alive) {
+         reinterpret_cast<Machine*>(&mSlots[i].storage)->~Machine();
+      }
+   }
+}
+
+std::size_t chip8emu::MachineArena::bytesFor(std::size_t machines)
+{
+   return machines * sizeof(Slot) + alignof(Slot) - 1;
+}
+
+chip8emu::Machine* chip8emu::MachineArena::create(std::uint32_t seed)
+{
+   Slot *slot = take();
+   return slot != nullptr ? new (&slot->storage) Machine(seed) : nullptr;
+}
+
+chip8emu::Machine* chip8emu::MachineArena::create(const Machine &prototype)
+{
+   Slot *slot = take();
+   return slot != nullptr ? new (&slot->storage) Machine(prototype) : nullptr;
+}
+
+void chip8emu::MachineArena::destroy(Machine *machine)
+{
+   if(machine == nullptr) {
+      return;
+   }
+
+   // The storage is the first member, so the machine is its slot.
+   Slot *slot = reinterpret_cast<Slot*>(machine);
+   machine->~Machine();
+
+   slot->alive = false;
+   slot->next = mFree;
+   mFree = slot;
+   mSize--;
+}
+
+chip8emu::MachineArena::Slot* chip8emu::MachineArena::take()
+{
+   // Reuse a freed slot, whose memory is likely cached, or take a new one.
+   Slot *slot = mFree;
+   if(slot != nullptr) {
+      mFree = slot->next;
+   } else if(mUsed < mCapacity) {
+      slot = &mSlots[mUsed++];
+   } else {
+      return nullptr;
+   }
+
+   slot->next = nullptr;
+   slot->alive = true;
+   mSize++;
+
+   return slot;
+}
+
+std::size_t chip8emu::MachineArena::capacity() const
+{
+   return mCapacity;
+}
+
+std::size_t chip8emu::MachineArena::size() const
+{
+   return mSize;
+}
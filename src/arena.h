@@ -0,0 +1,86 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include "cpu.h"
+#include "ppu.h"
+
+#include <cstdint>
+#include <type_traits>
+
+namespace chip8emu
+{
+
+// A complete emulator instance, the CPU driving the PPU next to it. The CPU
+// refers to the PPU through a non-owning shared_ptr, so constructing a
+// machine allocates nothing. Copies start from the machine state, quirks
+// and rom of the original, see CPU::copyState().
+struct Machine
+{
+   explicit Machine(std::uint32_t seed);
+   Machine(const Machine &prototype);
+   Machine& operator=(const Machine&) = delete;
+
+   PPU ppu;
+   CPU cpu;
+};
+
+// Places machines into slots of caller-provided memory, for hosts creating
+// and destroying instances by the million. Creating a machine takes a free
+// slot (freed ones first, then unused ones) and constructs it in place, so
+// neither the arena nor its machines allocate. Running a machine does not
+// allocate either, unless a trace or debugger is attached.
+//
+//    std::vector<unsigned char> memory(MachineArena::bytesFor(1024));
+//    MachineArena arena(memory.data(), memory.size());
+//
+//    Machine *machine = arena.create(prototype);
+//    machine->cpu.runFrames(60);
+//    arena.destroy(machine);
+class MachineArena
+{
+public:
+   // The memory must outlive the arena, slots start at its first suitably
+   // aligned address.
+   MachineArena(void *memory, std::size_t size);
+   // Destroys the machines still alive.
+   ~MachineArena();
+
+   MachineArena(const MachineArena&) = delete;
+   MachineArena& operator=(const MachineArena&) = delete;
+
+   // Memory needed for 'machines' slots, whatever its alignment.
+   static std::size_t bytesFor(std::size_t machines);
+
+   // Constructs a machine with a seeded random generator, or a copy of the
+   // prototype's machine state, quirks and rom. Returns nullptr if all
+   // slots are taken.
+   Machine* create(std::uint32_t seed);
+   Machine* create(const Machine &prototype);
+   void destroy(Machine *machine);
+
+   std::size_t capacity() const;
+   std::size_t size() const; // Machines alive
+
+private:
+   struct Slot;
+
+   // Takes a slot to construct a machine in, nullptr if all are taken.
+   Slot* take();
+
+   struct Slot
+   {
+      std::aligned_storage<sizeof(Machine), alignof(Machine)>::type storage;
+      Slot *next; // Next free slot, if free
+      bool alive;
+   };
+
+   Slot *mSlots;
+   std::size_t mCapacity;
+   std::size_t mUsed; // Slots ever taken, the ones behind were never touched
+   Slot *mFree; // Freed slots
+   std::size_t mSize;
+};
+
+}
+
+#endif // ARENA_H
@@ -0,0 +1,620 @@
+#include "batchcpu.h"
+#include "cpu.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <limits>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace
+{
+
+const std::size_t MEM_SIZE = 4096;
+const std::size_t GFX_ROWS = 32;
+
+}
+
+chip8emu::BatchCPU::BatchCPU(std::size_t lanes)
+   : mLanes((std::max<std::size_t>(lanes, 1) + LANE_BLOCK - 1) / LANE_BLOCK * LANE_BLOCK),
+     mCyclesPerFrame(10), mFrameCycles(0),
+     mShiftVy(false), mIncrementI(false), mClipSprites(false), mJumpVx(false), mResetVf(false),
+     mReg(16 * mLanes, 0), mPc(mLanes, 0x200), mI(mLanes, 0), mDelayTimer(mLanes, 0), mSoundTimer(mLanes, 0),
+     mSp(mLanes, 0), mStk(STACK_SIZE * mLanes, 0), mKeys(mLanes, 0), mRng(mLanes),
+     mRndDist(0, std::numeric_limits<std::uint8_t>::max()),
+     mMem(MEM_SIZE * mLanes, 0), mGfx(GFX_ROWS * mLanes, 0), mActive(mLanes, 0),
+     mGroupInstructions(0), mScalarInstructions(0)
+{
+   for(std::size_t lane = 0; lane < mLanes; lane++) {
+      std::copy(std::begin(FONTSET), std::end(FONTSET), mMem.begin() + lane * MEM_SIZE);
+      std::copy(std::begin(FONTSET_HIRES), std::end(FONTSET_HIRES), mMem.begin() + lane * MEM_SIZE + FONTSET_HIRES_ADDRESS);
+      seed(lane, lane);
+   }
+}
+
+chip8emu::BatchCPU::~BatchCPU()
+{
+}
+
+void chip8emu::BatchCPU::loadRom(const std::string &filename)
+{
+   std::ifstream rom(filename, std::ios::in | std::ios::binary);
+
+   if(rom.is_open()) {
+      // Read the rom once ...
+      std::vector<char> data((std::istreambuf_iterator<char>(rom)), std::istreambuf_iterator<char>());
+      data.resize(std::min(data.size(), MEM_SIZE - 0x200));
+
+      // ... and place it in the memory of every lane.
+      for(std::size_t lane = 0; lane < mLanes; lane++) {
+         std::copy(data.begin(), data.end(), mMem.begin() + lane * MEM_SIZE + 0x200);
+      }
+   }
+}
+
+void chip8emu::BatchCPU::seed(std::size_t lane, std::uint32_t seed)
+{
+   mRng[lane].seed(seed);
+}
+
+void chip8emu::BatchCPU::setKeys(std::size_t lane, std::uint16_t keys)
+{
+   mKeys[lane] = keys;
+}
+
+void chip8emu::BatchCPU::setCyclesPerFrame(std::uint32_t cycles)
+{
+   mCyclesPerFrame = std::max<std::uint32_t>(cycles, 1);
+   mFrameCycles = 0;
+}
+
+void chip8emu::BatchCPU::setQuirks(Quirks quirks)
+{
+   mShiftVy = quirks == QUIRKS_COSMAC || quirks == QUIRKS_XOCHIP;
+   mIncrementI = quirks == QUIRKS_COSMAC || quirks == QUIRKS_XOCHIP;
+   mClipSprites = quirks == QUIRKS_COSMAC || quirks == QUIRKS_SCHIP;
+   mJumpVx = quirks == QUIRKS_SCHIP;
+   mResetVf = quirks == QUIRKS_COSMAC;
+}
+
+void chip8emu::BatchCPU::run(std::uint32_t cycles)
+{
+   while(cycles-- > 0) {
+      step();
+   }
+}
+
+void chip8emu::BatchCPU::runFrames(std::uint32_t frames)
+{
+   while(frames-- > 0) {
+      run(mCyclesPerFrame - mFrameCycles);
+   }
+}
+
+std::size_t chip8emu::BatchCPU::lanes() const
+{
+   return mLanes;
+}
+
+const std::uint64_t* chip8emu::BatchCPU::gfx(std::size_t lane) const
+{
+   return &mGfx[lane * GFX_ROWS];
+}
+
+std::uint16_t chip8emu::BatchCPU::pc(std::size_t lane) const
+{
+   return mPc[lane];
+}
+
+std::uint16_t chip8emu::BatchCPU::index(std::size_t lane) const
+{
+   return mI[lane];
+}
+
+std::uint8_t chip8emu::BatchCPU::reg(std::size_t lane, std::uint8_t reg) const
+{
+   return mReg[(reg & 0xF) * mLanes + lane];
+}
+
+std::uint64_t chip8emu::BatchCPU::groupInstructions() const
+{
+   return mGroupInstructions;
+}
+
+std::uint64_t chip8emu::BatchCPU::scalarInstructions() const
+{
+   return mScalarInstructions;
+}
+
+std::uint16_t chip8emu::BatchCPU::fetch(std::size_t lane) const
+{
+   const std::uint8_t *mem = &mMem[lane * MEM_SIZE];
+   const std::uint16_t pc = mPc[lane];
+
+   return (mem[pc & 0xFFF] << 8) | mem[(pc + 1) & 0xFFF];
+}
+
+std::uint8_t chip8emu::BatchCPU::random(std::size_t lane)
+{
+   return mRndDist(mRng[lane]);
+}
+
+std::size_t chip8emu::BatchCPU::selectGroup(std::uint16_t pc, std::uint16_t op)
+{
+   // A lane joins the group if it is at the same address and, as memory may
+   // have been modified per lane, is about to execute the same opcode.
+   std::size_t members = 0;
+   for(std::size_t lane = 0; lane < mLanes; lane++) {
+      const bool member = mPc[lane] == pc && fetch(lane) == op;
+      mActive[lane] = member ? 0xFF : 0x00;
+      members += member;
+   }
+
+   return members;
+}
+
+void chip8emu::BatchCPU::step()
+{
+   // Lead with lane 0, ...
+   std::uint16_t pc = mPc[0];
+   std::uint16_t op = fetch(0);
+   std::size_t members = selectGroup(pc, op);
+
+   // ... but follow the other lanes if most of them left lane 0 behind.
+   if(members < mLanes / 2) {
+      const std::size_t other = std::find(mActive.begin(), mActive.end(), 0) - mActive.begin();
+      const std::uint16_t otherPc = mPc[other];
+      const std::uint16_t otherOp = fetch(other);
+      const std::size_t otherMembers = selectGroup(otherPc, otherOp);
+
+      if(otherMembers > members) {
+         pc = otherPc, op = otherOp, members = otherMembers;
+      } else {
+         selectGroup(pc, op);
+      }
+   }
+
+   // Execute the leading group in lockstep, ...
+   execGroup(op);
+   mGroupInstructions += members;
+
+   // ... and step every diverged lane on its own.
+   if(members < mLanes) {
+      for(std::size_t lane = 0; lane < mLanes; lane++) {
+         if(!mActive[lane]) {
+            execLane(lane, fetch(lane));
+            mScalarInstructions++;
+         }
+      }
+   }
+
+   // The timers run at 60Hz, so update them once per frame.
+   if(++mFrameCycles >= mCyclesPerFrame) {
+      mFrameCycles = 0;
+      tickFrame();
+   }
+}
+
+void chip8emu::BatchCPU::tickFrame()
+{
+   for(std::size_t lane = 0; lane < mLanes; lane++) {
+      mDelayTimer[lane] -= mDelayTimer[lane] > 0;
+      mSoundTimer[lane] -= mSoundTimer[lane] > 0;
+   }
+}
+
+void chip8emu::BatchCPU::push(std::size_t lane, std::uint16_t addr)
+{
+   std::uint16_t &sp = mSp[lane];
+
+   // A full stack drops its oldest return address, like the CPU's.
+   if(sp == STACK_SIZE) {
+      for(std::size_t depth = 1; depth < STACK_SIZE; depth++) {
+         mStk[(depth - 1) * mLanes + lane] = mStk[depth * mLanes + lane];
+      }
+      sp--;
+   }
+
+   mStk[sp++ * mLanes + lane] = addr;
+}
+
+void chip8emu::BatchCPU::execGroup(std::uint16_t op)
+{
+   const std::uint8_t x = (op & 0x0F00) >> 8;
+   const std::uint8_t y = (op & 0x00F0) >> 4;
+   const std::uint8_t n = op & 0x000F;
+   const std::uint8_t nn = op & 0x00FF;
+   const std::uint16_t nnn = op & 0x0FFF;
+
+   std::uint8_t *vx = &mReg[x * mLanes];
+   const std::uint8_t *active = mActive.data();
+
+   // The loops below are branch free, so the compiler vectorizes them.
+   switch(op & 0xF000) {
+   case 0x1000:
+      for(std::size_t lane = 0; lane < mLanes; lane++) {
+         mPc[lane] = active[lane] ? nnn : mPc[lane];
+      }
+      return;
+
+   case 0x6000:
+      for(std::size_t lane = 0; lane < mLanes; lane++) {
+         vx[lane] = active[lane] ? nn : vx[lane];
+      }
+      break;
+
+   case 0x7000:
+      for(std::size_t lane = 0; lane < mLanes; lane++) {
+         vx[lane] += nn & active[lane];
+      }
+      break;
+
+   case 0x8000:
+      if((n <= 0x7 || n == 0xE) && x != 0xF && y != 0xF) {
+         execAlu(x, y, n);
+         break;
+      }
+
+      // Invalid 8XYN opcodes and those on VF, whose order of writing VF and
+      // VX matters, take the scalar path.
+      for(std::size_t lane = 0; lane < mLanes; lane++) {
+         if(active[lane]) {
+            execLane(lane, op);
+         }
+      }
+      return;
+
+   case 0xA000:
+      for(std::size_t lane = 0; lane < mLanes; lane++) {
+         mI[lane] = active[lane] ? nnn : mI[lane];
+      }
+      break;
+
+   case 0xD000:
+      drawGroup(x, y, n);
+      break;
+
+   default:
+      // Control flow, timer and memory instructions touch per lane state
+      // anyway, so they share the scalar implementation.
+      for(std::size_t lane = 0; lane < mLanes; lane++) {
+         if(active[lane]) {
+            execLane(lane, op);
+         }
+      }
+      return;
+   }
+
+   for(std::size_t lane = 0; lane < mLanes; lane++) {
+      mPc[lane] += active[lane] & 2;
+   }
+}
+
+void chip8emu::BatchCPU::execAlu(std::uint8_t x, std::uint8_t y, std::uint8_t n)
+{
+   std::uint8_t *vx = &mReg[x * mLanes];
+   std::uint8_t *vy = &mReg[y * mLanes];
+   std::uint8_t *vf = &mReg[0xF * mLanes];
+   const bool setsFlag = n >= 0x4 || (mResetVf && n != 0x0);
+   const bool shiftVy = mShiftVy && (n == 0x6 || n == 0xE);
+
+#if defined(__AVX2__)
+   const __m256i one = _mm256_set1_epi8(1);
+   const __m256i ones = _mm256_set1_epi8(-1);
+
+   for(std::size_t lane = 0; lane < mLanes; lane += LANE_BLOCK) {
+      const __m256i mask = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&mActive[lane]));
+      const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&vx[lane]));
+      const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&vy[lane]));
+      const __m256i shifted = shiftVy ? b : a;
+      __m256i res, flag = _mm256_setzero_si256();
+
+      switch(n) {
+      case 0x0: res = b; break;
+      case 0x1: res = _mm256_or_si256(a, b); break;
+      case 0x2: res = _mm256_and_si256(a, b); break;
+      case 0x3: res = _mm256_xor_si256(a, b); break;
+      case 0x4:
+         // Carry if the wrapped sum is smaller than VX.
+         res = _mm256_add_epi8(a, b);
+         flag = _mm256_andnot_si256(_mm256_cmpeq_epi8(_mm256_max_epu8(res, a), res), ones);
+         break;
+      case 0x5:
+         // No borrow if VX >= VY.
+         res = _mm256_sub_epi8(a, b);
+         flag = _mm256_cmpeq_epi8(_mm256_max_epu8(a, b), a);
+         break;
+      case 0x6:
+         res = _mm256_and_si256(_mm256_srli_epi16(shifted, 1), _mm256_set1_epi8(0x7F));
+         flag = _mm256_cmpeq_epi8(_mm256_and_si256(shifted, one), one);
+         break;
+      case 0x7:
+         res = _mm256_sub_epi8(b, a);
+         flag = _mm256_cmpeq_epi8(_mm256_max_epu8(b, a), b);
+         break;
+      default: // 0xE
+         res = _mm256_add_epi8(shifted, shifted);
+         flag = _mm256_cmpeq_epi8(_mm256_max_epu8(shifted, _mm256_set1_epi8(-128)), shifted);
+         break;
+      }
+
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(&vx[lane]), _mm256_blendv_epi8(a, res, mask));
+
+      // X and Y are not F here, so VX and VF may be written in any order.
+      if(setsFlag) {
+         const __m256i f = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&vf[lane]));
+         _mm256_storeu_si256(reinterpret_cast<__m256i*>(&vf[lane]),
+               _mm256_blendv_epi8(f, _mm256_and_si256(flag, one), mask));
+      }
+   }
+#else
+   for(std::size_t lane = 0; lane < mLanes; lane++) {
+      const std::uint8_t a = vx[lane], b = vy[lane];
+      const std::uint8_t shifted = shiftVy ? b : a;
+      std::uint8_t res, flag = 0;
+
+      switch(n) {
+      case 0x0: res = b; break;
+      case 0x1: res = a | b; break;
+      case 0x2: res = a & b; break;
+      case 0x3: res = a ^ b; break;
+      case 0x4: res = a + b; flag = res < a; break;
+      case 0x5: res = a - b; flag = a >= b; break;
+      case 0x6: res = shifted >> 1; flag = shifted & 1; break;
+      case 0x7: res = b - a; flag = b >= a; break;
+      default: res = shifted << 1; flag = shifted >> 7; break;
+      }
+
+      vx[lane] = mActive[lane] ? res : a;
+      if(setsFlag) {
+         vf[lane] = mActive[lane] ? flag : vf[lane];
+      }
+   }
+#endif
+}
+
+void chip8emu::BatchCPU::drawGroup(std::uint8_t x, std::uint8_t y, std::uint8_t n)
+{
+#if defined(__AVX2__)
+   const std::uint8_t *vx = &mReg[x * mLanes];
+   const std::uint8_t *vy = &mReg[y * mLanes];
+   std::uint8_t *vf = &mReg[0xF * mLanes];
+   const long long *rows = reinterpret_cast<const long long*>(mGfx.data());
+
+   // Draw four lanes per iteration, one 64 bit framebuffer row each.
+   for(std::size_t lane = 0; lane < mLanes; lane += 4) {
+      std::uint32_t active;
+      std::memcpy(&active, &mActive[lane], sizeof(active));
+      if(active == 0) {
+         continue;
+      } else if(active != 0xFFFFFFFF) {
+         for(std::size_t k = 0; k < 4; k++) {
+            if(mActive[lane + k]) {
+               drawLane(lane + k, x, y, n);
+            }
+         }
+         continue;
+      }
+
+      const __m256i shift = _mm256_set_epi64x(vx[lane + 3] & 63, vx[lane + 2] & 63, vx[lane + 1] & 63, vx[lane] & 63);
+      // Clipped sprites are not rotated, shifting by 64 drops their tail.
+      const __m256i counter = mClipSprites ? _mm256_set1_epi64x(64) : _mm256_sub_epi64(_mm256_set1_epi64x(64), shift);
+      __m256i collision = _mm256_setzero_si256();
+
+      for(std::uint8_t i = 0; i < n; i++) {
+         alignas(32) long long index[4], sprite[4];
+         for(std::size_t k = 0; k < 4; k++) {
+            const std::size_t l = lane + k;
+            const std::size_t y = (vy[l] & (GFX_ROWS - 1)) + i;
+            index[k] = l * GFX_ROWS + (y & (GFX_ROWS - 1));
+            const bool clipped = mClipSprites && y >= GFX_ROWS;
+            sprite[k] = clipped ? 0 : static_cast<long long>(mMem[l * MEM_SIZE + ((mI[l] + i) & 0xFFF)]) << 56;
+         }
+
+         // Rotate the sprite bytes into place, so they wrap around the edge
+         // unless clipped.
+         const __m256i spr = _mm256_load_si256(reinterpret_cast<const __m256i*>(sprite));
+         const __m256i bits = _mm256_or_si256(_mm256_srlv_epi64(spr, shift), _mm256_sllv_epi64(spr, counter));
+         const __m256i row = _mm256_i64gather_epi64(rows, _mm256_load_si256(reinterpret_cast<const __m256i*>(index)), 8);
+
+         collision = _mm256_or_si256(collision, _mm256_and_si256(row, bits));
+
+         alignas(32) std::uint64_t result[4];
+         _mm256_store_si256(reinterpret_cast<__m256i*>(result), _mm256_xor_si256(row, bits));
+         for(std::size_t k = 0; k < 4; k++) {
+            mGfx[index[k]] = result[k];
+         }
+      }
+
+      const int hit = _mm256_movemask_pd(_mm256_castsi256_pd(
+               _mm256_cmpeq_epi64(collision, _mm256_setzero_si256())));
+      for(std::size_t k = 0; k < 4; k++) {
+         vf[lane + k] = (hit >> k) & 1 ? 0 : 1;
+      }
+   }
+#else
+   for(std::size_t lane = 0; lane < mLanes; lane++) {
+      if(mActive[lane]) {
+         drawLane(lane, x, y, n);
+      }
+   }
+#endif
+}
+
+void chip8emu::BatchCPU::drawLane(std::size_t lane, std::uint8_t x, std::uint8_t y, std::uint8_t n)
+{
+   const std::uint8_t px = mReg[x * mLanes + lane] & 63;
+   const std::uint8_t py = mReg[y * mLanes + lane] & (GFX_ROWS - 1);
+   const std::uint8_t *mem = &mMem[lane * MEM_SIZE];
+   std::uint64_t *rows = &mGfx[lane * GFX_ROWS];
+   std::uint64_t collision = 0;
+
+   // Clipped sprites end at the bottom and right edges, others wrap around.
+   const std::uint8_t visible = mClipSprites ? std::min<std::uint8_t>(n, GFX_ROWS - py) : n;
+
+   for(std::uint8_t i = 0; i < visible; i++) {
+      std::uint64_t bits = std::uint64_t(mem[(mI[lane] + i) & 0xFFF]) << 56;
+      bits = px && !mClipSprites ? (bits >> px) | (bits << (64 - px)) : bits >> px;
+
+      std::uint64_t &row = rows[(py + i) & (GFX_ROWS - 1)];
+      collision |= row & bits;
+      row ^= bits;
+   }
+
+   mReg[0xF * mLanes + lane] = collision != 0 ? 1 : 0;
+}
+
+void chip8emu::BatchCPU::execLane(std::size_t lane, std::uint16_t op)
+{
+   std::uint8_t *mem = &mMem[lane * MEM_SIZE];
+   std::uint16_t &pc = mPc[lane];
+   std::uint16_t &i = mI[lane];
+   std::uint16_t &sp = mSp[lane];
+   auto V = [this, lane](std::uint8_t reg) -> std::uint8_t& { return mReg[reg * mLanes + lane]; };
+
+   const std::uint8_t x = (op & 0x0F00) >> 8;
+   const std::uint8_t y = (op & 0x00F0) >> 4;
+   const std::uint8_t nn = op & 0x00FF;
+   const std::uint16_t nnn = op & 0x0FFF;
+
+   switch(op & 0xF000) {
+   case 0x0000:
+      // 0NNN does not advance, the machine halts on it like the CPU.
+      if(op == 0x00E0) {
+         std::fill_n(&mGfx[lane * GFX_ROWS], GFX_ROWS, 0);
+         pc += 2;
+      } else if(op == 0x00EE) {
+         // Returning with an empty stack goes back to the oldest call.
+         pc = mStk[(sp > 0 ? --sp : 0) * mLanes + lane];
+         pc += 2;
+      }
+      break;
+   case 0x1000:
+      pc = nnn;
+      break;
+   case 0x2000:
+      push(lane, pc);
+      pc = nnn;
+      break;
+   case 0x3000:
+      pc += V(x) == nn ? 4 : 2;
+      break;
+   case 0x4000:
+      pc += V(x) != nn ? 4 : 2;
+      break;
+   case 0x5000:
+      pc += V(x) == V(y) ? 4 : 2;
+      break;
+   case 0x6000:
+      V(x) = nn;
+      pc += 2;
+      break;
+   case 0x7000:
+      V(x) += nn;
+      pc += 2;
+      break;
+   case 0x8000:
+      // VF is written first and VY read after, like in the CPU, so VX wins
+      // if X is F and 8FY4 adds the new VF.
+      switch(op & 0x000F) {
+      case 0x0: V(x) = V(y); break;
+      case 0x1: V(x) |= V(y); V(0xF) = mResetVf ? 0 : V(0xF); break;
+      case 0x2: V(x) &= V(y); V(0xF) = mResetVf ? 0 : V(0xF); break;
+      case 0x3: V(x) ^= V(y); V(0xF) = mResetVf ? 0 : V(0xF); break;
+      case 0x4: V(0xF) = V(y) > 0xFF - V(x) ? 1 : 0; V(x) += V(y); break;
+      case 0x5: V(0xF) = V(y) > V(x) ? 0 : 1; V(x) -= V(y); break;
+      case 0x6: {
+         const std::uint8_t value = V(mShiftVy ? y : x);
+         V(0xF) = value & 1;
+         V(x) = value >> 1;
+         break;
+      }
+      case 0x7: V(0xF) = V(x) > V(y) ? 0 : 1; V(x) = V(y) - V(x); break;
+      case 0xE: {
+         const std::uint8_t value = V(mShiftVy ? y : x);
+         V(0xF) = value >> 7;
+         V(x) = value << 1;
+         break;
+      }
+      default: break;
+      }
+      pc += 2;
+      break;
+   case 0x9000:
+      pc += V(x) != V(y) ? 4 : 2;
+      break;
+   case 0xA000:
+      i = nnn;
+      pc += 2;
+      break;
+   case 0xB000:
+      pc = nnn + V(mJumpVx ? x : 0);
+      break;
+   case 0xC000:
+      V(x) = random(lane) & nn;
+      pc += 2;
+      break;
+   case 0xD000:
+      drawLane(lane, x, y, op & 0x000F);
+      pc += 2;
+      break;
+   case 0xE000:
+      // Keys above F are never down.
+      if(nn == 0x9E) {
+         pc += V(x) < 16 && (mKeys[lane] >> V(x)) & 1 ? 4 : 2;
+      } else if(nn == 0xA1) {
+         pc += V(x) < 16 && (mKeys[lane] >> V(x)) & 1 ? 2 : 4;
+      } else {
+         pc += 2;
+      }
+      break;
+   case 0xF000:
+      switch(nn) {
+      case 0x07: V(x) = mDelayTimer[lane]; break;
+      case 0x0A:
+         // Block until a key is down, taking the lowest one.
+         if(mKeys[lane] == 0) {
+            return;
+         }
+         for(std::uint8_t key = 0; key < 16; key++) {
+            if((mKeys[lane] >> key) & 1) {
+               V(x) = key;
+               break;
+            }
+         }
+         break;
+      case 0x15: mDelayTimer[lane] = V(x); break;
+      case 0x18: mSoundTimer[lane] = V(x); break;
+      case 0x1E:
+         V(0xF) = i + V(x) > 0xFFF ? 1 : 0;
+         i += V(x);
+         break;
+      case 0x29: i = V(x) * 5; break;
+      case 0x30: i = FONTSET_HIRES_ADDRESS + (V(x) & 0xF) * 10; break;
+      case 0x33:
+         mem[i & 0xFFF] = V(x) / 100;
+         mem[(i + 1) & 0xFFF] = (V(x) / 10) % 10;
+         mem[(i + 2) & 0xFFF] = V(x) % 10;
+         break;
+      case 0x55:
+         for(std::uint8_t reg = 0; reg <= x; reg++) {
+            mem[(i + reg) & 0xFFF] = V(reg);
+         }
+         i += mIncrementI ? x + 1 : 0;
+         break;
+      case 0x65:
+         for(std::uint8_t reg = 0; reg <= x; reg++) {
+            V(reg) = mem[(i + reg) & 0xFFF];
+         }
+         i += mIncrementI ? x + 1 : 0;
+         break;
+      default: break;
+      }
+      pc += 2;
+      break;
+   }
+}
@@ -0,0 +1,102 @@
+#ifndef BATCH_CPU_H
+#define BATCH_CPU_H
+
+#include "quirks.h"
+
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace chip8emu
+{
+
+// Runs many instances of one rom in lockstep, e.g. for seed sweeps.
+//
+// The machine state is kept in structure of arrays layout (one array per
+// register, indexed by lane), so an instruction is fetched and decoded once
+// for all lanes sharing the leading program counter and ALU operations and
+// sprite drawing run vectorized across those lanes. Lanes that diverged are
+// stepped by a scalar path until they reconverge with the leading group.
+//
+// Framebuffers are 64x32 and bit-packed like in the PPU, one 64 bit word per
+// row. Opcode semantics match CPU::execute() for the default, COSMAC and
+// SUPER-CHIP quirk profiles, except that neither the SUPER-CHIP display and
+// flag opcodes nor XO-CHIP are supported. Every lane has its own mt19937
+// (5 KB), seeded like CPU::seed(), so a lane computes the same machine as a
+// CPU with the same seed. chip8batchbench checks this.
+class BatchCPU
+{
+public:
+   static const std::size_t LANE_BLOCK = 32; // Lanes per 256 bit vector of 8 bit registers
+
+   BatchCPU(std::size_t lanes);
+   ~BatchCPU();
+
+   void loadRom(const std::string &filename);
+
+   void seed(std::size_t lane, std::uint32_t seed);
+   void setKeys(std::size_t lane, std::uint16_t keys);
+   void setCyclesPerFrame(std::uint32_t cycles);
+   void setQuirks(Quirks quirks);
+
+   void run(std::uint32_t cycles);
+   void runFrames(std::uint32_t frames);
+
+   std::size_t lanes() const;
+   const std::uint64_t* gfx(std::size_t lane) const;
+   std::uint16_t pc(std::size_t lane) const;
+   std::uint16_t index(std::size_t lane) const;
+   std::uint8_t reg(std::size_t lane, std::uint8_t reg) const;
+
+   std::uint64_t groupInstructions() const;
+   std::uint64_t scalarInstructions() const;
+
+private:
+   void step();
+   void execGroup(std::uint16_t op);
+   void execLane(std::size_t lane, std::uint16_t op);
+   void execAlu(std::uint8_t x, std::uint8_t y, std::uint8_t n);
+   void drawGroup(std::uint8_t x, std::uint8_t y, std::uint8_t n);
+   void drawLane(std::size_t lane, std::uint8_t x, std::uint8_t y, std::uint8_t n);
+   void tickFrame();
+   void push(std::size_t lane, std::uint16_t addr);
+
+   std::uint16_t fetch(std::size_t lane) const;
+   std::uint8_t random(std::size_t lane);
+   std::size_t selectGroup(std::uint16_t pc, std::uint16_t op);
+
+   std::size_t mLanes; // Number of lanes, a multiple of LANE_BLOCK
+   std::uint32_t mCyclesPerFrame; // Instructions executed per 60Hz frame
+   std::uint32_t mFrameCycles; // Instructions executed in the current frame
+
+   // Quirks of the profile, see QuirkSet
+   bool mShiftVy;
+   bool mIncrementI;
+   bool mClipSprites;
+   bool mJumpVx;
+   bool mResetVf;
+
+   std::vector<std::uint8_t> mReg; // V0-VF, indexed by reg * mLanes + lane
+   std::vector<std::uint16_t> mPc; // Instruction pointer per lane
+   std::vector<std::uint16_t> mI; // Index register per lane
+   std::vector<std::uint8_t> mDelayTimer; // Delay timer per lane
+   std::vector<std::uint8_t> mSoundTimer; // Sound timer per lane
+   std::vector<std::uint16_t> mSp; // Stack depth per lane
+   std::vector<std::uint16_t> mStk; // Jump stacks of STACK_SIZE entries, indexed by depth * mLanes + lane
+   std::vector<std::uint16_t> mKeys; // Keypad state per lane
+   std::vector<std::mt19937> mRng; // Random generator per lane
+   std::uniform_int_distribution<std::uint16_t> mRndDist; // Maps mRng to 0-255, like the CPU's
+
+   std::vector<std::uint8_t> mMem; // 4k of memory per lane, lane after lane
+   std::vector<std::uint64_t> mGfx; // 32 packed rows per lane, lane after lane
+
+   std::vector<std::uint8_t> mActive; // 0xFF for lanes in the current group
+
+   std::uint64_t mGroupInstructions; // Lane instructions run in lockstep
+   std::uint64_t mScalarInstructions; // Lane instructions run on the scalar path
+};
+
+}
+
+#endif // BATCH_CPU_H
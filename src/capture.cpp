@@ -0,0 +1,335 @@
+#include "capture.h"
+
+#include <chrono>
+#include <cstring>
+
+namespace
+{
+
+const std::size_t QUEUE_SIZE = 256;
+const std::uint8_t LZW_MIN_CODE_SIZE = 2;
+
+// Packs variable length LZW codes into GIF data sub-blocks.
+class BitWriter
+{
+public:
+   BitWriter(std::ofstream &file) : mFile(file), mBits(0), mCount(0) {}
+
+   void write(std::uint16_t code, std::uint8_t size)
+   {
+      mBits |= static_cast<std::uint32_t>(code) << mCount;
+      mCount += size;
+
+      while(mCount >= 8) {
+         put(mBits & 0xFF);
+         mBits >>= 8;
+         mCount -= 8;
+      }
+   }
+
+   void finish()
+   {
+      if(mCount > 0) {
+         put(mBits & 0xFF);
+      }
+
+      if(!mBlock.empty()) {
+         writeBlock();
+      }
+
+      // Block terminator.
+      mFile.put(0);
+   }
+
+private:
+   void put(std::uint8_t byte)
+   {
+      mBlock.push_back(byte);
+      if(mBlock.size() == 255) {
+         writeBlock();
+      }
+   }
+
+   void writeBlock()
+   {
+      mFile.put(static_cast<char>(mBlock.size()));
+      mFile.write(reinterpret_cast<const char*>(mBlock.data()), mBlock.size());
+      mBlock.clear();
+   }
+
+   std::ofstream &mFile;
+   std::uint32_t mBits;
+   std::uint8_t mCount;
+   std::vector<std::uint8_t> mBlock;
+};
+
+void writeWord(std::ofstream &file, std::uint16_t value)
+{
+   file.put(value & 0xFF);
+   file.put(value >> 8);
+}
+
+}
+
+chip8emu::Capture::Capture(const std::string &filename, std::uint8_t scale, std::uint32_t light, std::uint32_t dark)
+   : mFilename(filename), mScale(std::max<std::uint8_t>(scale, 1)), mLight(light), mDark(dark),
+     mQueue(QUEUE_SIZE), mHasLast(false), mBlocking(false), mRunning(false), mHeaderWritten(false),
+     mTicks(0), mCentiseconds(0), mFrames(0), mStored(0), mDropped(0)
+{
+}
+
+chip8emu::Capture::~Capture()
+{
+   stop();
+}
+
+bool chip8emu::Capture::start()
+{
+   mFile.open(mFilename, std::ios::out | std::ios::binary);
+
+   if(!mFile.is_open()) {
+      return false;
+   }
+
+   mRunning = true;
+   mEncoder = std::thread(&Capture::encode, this);
+
+   return true;
+}
+
+void chip8emu::Capture::push(const PPU &ppu)
+{
+   const std::size_t words = ppu.wordsPerRow() * ppu.height();
+   mFrames++;
+
+   // Extend the pending frame if nothing changed, ...
+   if(mHasLast && mLast.width == ppu.width() && mLast.height == ppu.height()
+         && std::memcmp(mLast.rows, ppu.row(0), words * sizeof(std::uint64_t)) == 0) {
+      mLast.repeat++;
+      return;
+   }
+
+   // ... otherwise hand it to the encoder and start a new one.
+   flush();
+
+   mLast.width = ppu.width();
+   mLast.height = ppu.height();
+   mLast.repeat = 1;
+   std::memcpy(mLast.rows, ppu.row(0), std::min(words, CaptureFrame::MAX_WORDS) * sizeof(std::uint64_t));
+   mHasLast = true;
+}
+
+void chip8emu::Capture::flush()
+{
+   if(mHasLast) {
+      // Headless runs wait for the encoder, interactive ones never stall.
+      while(mBlocking && !mQueue.push(mLast)) {
+         std::this_thread::yield();
+      }
+
+      if(mBlocking || mQueue.push(mLast)) {
+         mStored++;
+      } else {
+         mDropped += mLast.repeat;
+      }
+
+      mHasLast = false;
+   }
+}
+
+void chip8emu::Capture::stop()
+{
+   if(!mRunning) {
+      return;
+   }
+
+   flush();
+
+   mRunning = false;
+   mEncoder.join();
+   mFile.close();
+}
+
+void chip8emu::Capture::setBlocking(bool blocking)
+{
+   mBlocking = blocking;
+}
+
+bool chip8emu::Capture::active() const
+{
+   return mRunning;
+}
+
+const std::string& chip8emu::Capture::filename() const
+{
+   return mFilename;
+}
+
+std::uint64_t chip8emu::Capture::frames() const
+{
+   return mFrames;
+}
+
+std::uint64_t chip8emu::Capture::stored() const
+{
+   return mStored;
+}
+
+std::uint64_t chip8emu::Capture::dropped() const
+{
+   return mDropped;
+}
+
+void chip8emu::Capture::encode()
+{
+   CaptureFrame frame;
+
+   // Drain the queue until capturing stopped and everything is written.
+   for(;;) {
+      if(mQueue.pop(frame)) {
+         writeFrame(frame);
+      } else if(!mRunning) {
+         if(!mQueue.pop(frame)) {
+            break;
+         }
+
+         writeFrame(frame);
+      } else {
+         std::this_thread::sleep_for(std::chrono::milliseconds(2));
+      }
+   }
+
+   // GIF trailer.
+   if(mHeaderWritten) {
+      mFile.put(0x3B);
+   }
+}
+
+void chip8emu::Capture::writeHeader()
+{
+   // Header and logical screen of the hires display with a global table of
+   // two colors.
+   mFile.write("GIF89a", 6);
+   writeWord(mFile, HiresFramebuffer::WIDTH * mScale);
+   writeWord(mFile, HiresFramebuffer::HEIGHT * mScale);
+   mFile.put(static_cast<char>(0x80));
+   mFile.put(0);
+   mFile.put(0);
+
+   for(const std::uint32_t color : { mDark, mLight }) {
+      mFile.put((color >> 16) & 0xFF);
+      mFile.put((color >> 8) & 0xFF);
+      mFile.put(color & 0xFF);
+   }
+
+   // Loop the animation forever.
+   mFile.put(0x21);
+   mFile.put(static_cast<char>(0xFF));
+   mFile.put(11);
+   mFile.write("NETSCAPE2.0", 11);
+   mFile.put(3);
+   mFile.put(1);
+   writeWord(mFile, 0);
+   mFile.put(0);
+
+   mHeaderWritten = true;
+}
+
+void chip8emu::Capture::writeFrame(const CaptureFrame &frame)
+{
+   if(!mHeaderWritten) {
+      writeHeader();
+   }
+
+   // Convert the repeat count from 60Hz frames to GIF centiseconds. Delays
+   // below 2cs are not played back reliably, the difference is caught up by
+   // the following frames.
+   mTicks += frame.repeat;
+   const std::uint64_t end = mTicks * 100 / 60;
+   const std::uint16_t delay = end > mCentiseconds + 2 ? end - mCentiseconds : 2;
+   mCentiseconds += delay;
+
+   // Graphic control extension carrying the delay.
+   mFile.put(0x21);
+   mFile.put(static_cast<char>(0xF9));
+   mFile.put(4);
+   mFile.put(0);
+   writeWord(mFile, delay);
+   mFile.put(0);
+   mFile.put(0);
+
+   // Image descriptor covering the whole screen, whatever the mode.
+   const std::uint16_t width = HiresFramebuffer::WIDTH * mScale;
+   const std::uint16_t height = HiresFramebuffer::HEIGHT * mScale;
+   const std::uint16_t scale = width / frame.width;
+   mFile.put(0x2C);
+   writeWord(mFile, 0);
+   writeWord(mFile, 0);
+   writeWord(mFile, width);
+   writeWord(mFile, height);
+   mFile.put(0);
+
+   // Expand the packed rows into one palette index per output pixel.
+   const std::size_t words = (frame.width + 63) / 64;
+   std::vector<std::uint8_t> pixels(width * height);
+   for(std::uint16_t y = 0; y < height; y++) {
+      const std::uint64_t *row = &frame.rows[(y / scale) * words];
+      for(std::uint16_t x = 0; x < width; x++) {
+         const std::uint8_t px = x / scale;
+         pixels[y * width + x] = (row[px / 64] >> (63 - px % 64)) & 1;
+      }
+   }
+
+   writeLzw(pixels);
+}
+
+void chip8emu::Capture::writeLzw(const std::vector<std::uint8_t> &pixels)
+{
+   const std::uint16_t clearCode = 1 << LZW_MIN_CODE_SIZE;
+
+   // Code table as a trie, each code having one child per palette index.
+   std::vector<std::uint16_t> children(4096 * clearCode, 0);
+   std::uint16_t maxCode = clearCode + 1;
+   std::uint8_t codeSize = LZW_MIN_CODE_SIZE + 1;
+
+   BitWriter writer(mFile);
+   mFile.put(LZW_MIN_CODE_SIZE);
+   writer.write(clearCode, codeSize);
+
+   std::uint16_t code = pixels[0];
+   for(std::size_t i = 1; i < pixels.size(); i++) {
+      std::uint16_t &child = children[code * clearCode + pixels[i]];
+
+      if(child != 0) {
+         code = child;
+         continue;
+      }
+
+      // Emit the longest known string and learn it plus the next pixel.
+      writer.write(code, codeSize);
+      child = ++maxCode;
+
+      if(maxCode >= (1u << codeSize)) {
+         codeSize++;
+      }
+
+      if(maxCode == 4095) {
+         writer.write(clearCode, codeSize);
+         std::fill(children.begin(), children.end(), 0);
+         maxCode = clearCode + 1;
+         codeSize = LZW_MIN_CODE_SIZE + 1;
+      }
+
+      code = pixels[i];
+   }
+
+   // The decoder learns one more string when reading the last code, which
+   // may widen the end of information code.
+   writer.write(code, codeSize);
+   if(maxCode + 1u >= (1u << codeSize) && codeSize < 12) {
+      codeSize++;
+   }
+
+   writer.write(clearCode + 1, codeSize);
+   writer.finish();
+}
@@ -0,0 +1,90 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include "ppu.h"
+#include "spscqueue.h"
+
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace chip8emu
+{
+
+// A captured framebuffer together with the number of 60Hz frames it stayed
+// on screen.
+struct CaptureFrame
+{
+   static const std::size_t MAX_WORDS = 128; // Enough for 128x64 pixels
+
+   std::uint8_t width;
+   std::uint8_t height;
+   std::uint32_t repeat;
+   std::uint64_t rows[MAX_WORDS];
+};
+
+// Records the emulated screen into an animated GIF.
+//
+// The emulation thread hands every frame to push(), which only compares it
+// against the previous frame and enqueues it into a lock-free queue. Runs of
+// identical frames are collapsed into one entry with a repeat count, which
+// becomes the GIF frame delay. Encoding happens on a background thread; if
+// it falls behind, frames are dropped unless blocking mode is enabled.
+//
+// The GIF screen fits the 128x64 hires display, lores frames are scaled up
+// to fill it, so captures may switch modes.
+class Capture
+{
+public:
+   Capture(const std::string &filename, std::uint8_t scale = 2, std::uint32_t light = 0xE0EEEE, std::uint32_t dark = 0x000000);
+   ~Capture();
+
+   void setBlocking(bool blocking);
+
+   bool start();
+   void push(const PPU &ppu);
+   void stop();
+
+   bool active() const;
+   const std::string& filename() const;
+
+   std::uint64_t frames() const;
+   std::uint64_t stored() const;
+   std::uint64_t dropped() const;
+
+private:
+   void flush();
+   void encode();
+
+   void writeHeader();
+   void writeFrame(const CaptureFrame &frame);
+   void writeLzw(const std::vector<std::uint8_t> &pixels);
+
+   const std::string mFilename;
+   const std::uint8_t mScale; // Size of a hires pixel in the GIF, lores ones are twice as large
+   const std::uint32_t mLight; // RGB color of lit pixels
+   const std::uint32_t mDark; // RGB color of unlit pixels
+
+   SpscQueue<CaptureFrame> mQueue;
+   CaptureFrame mLast; // Frame waiting for its repeat count to complete
+   bool mHasLast;
+   bool mBlocking; // Wait for the encoder instead of dropping frames
+
+   std::ofstream mFile;
+   std::thread mEncoder;
+   std::atomic<bool> mRunning;
+   bool mHeaderWritten;
+   std::uint64_t mTicks; // Emulated frames written so far
+   std::uint64_t mCentiseconds; // GIF time written so far
+
+   std::uint64_t mFrames; // Frames handed to push()
+   std::uint64_t mStored; // Distinct frames enqueued
+   std::uint64_t mDropped; // Frames lost because the encoder fell behind
+};
+
+}
+
+#endif // CAPTURE_H
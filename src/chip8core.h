@@ -0,0 +1,38 @@
+#ifndef CHIP8_CORE_H
+#define CHIP8_CORE_H
+
+// Public interface of libchip8core, the SDL independent emulation core.
+//
+// A host creates a PPU and a CPU, loads a rom and drives the machine with
+// CPU::run() or CPU::runFrames(). Input is injected as a 16 bit pad mask via
+// CPU::setKeys() and everything the host has to react on (new frame, sound,
+// key wait) is returned as a bitmask of chip8emu::Event values.
+//
+//    auto ppu = std::make_shared<chip8emu::PPU>();
+//    chip8emu::CPU cpu(ppu);
+//    cpu.loadRom("pong.ch8");
+//
+//    while(...) {
+//       cpu.setKeys(pad);
+//       if(cpu.runFrames(1) & chip8emu::EVENT_FRAME_READY) { ... }
+//    }
+
+#include "cpu.h"
+#include "ppu.h"
+#include "batchcpu.h"
+#include "capture.h"
+#include "inputlog.h"
+#include "trace.h"
+#include "disasm.h"
+#include "debugger.h"
+#include "quirks.h"
+#include "server.h"
+#include "threadpool.h"
+#include "vecenv.h"
+#include "metrics.h"
+#include "search.h"
+#include "terminal.h"
+#include "arena.h"
+#include "replay.h"
+
+#endif // CHIP8_CORE_H
@@ -3,101 +3,289 @@
 #include <algorithm>
 #include <iostream>
 #include <fstream>
+#include <future>
+#include <iomanip>
 #include <memory>
 
 chip8emu::Chip8Emu::Chip8Emu(std::unique_ptr<chip8emu::CPU> cpu, std::shared_ptr<chip8emu::PPU> ppu, std::shared_ptr<chip8emu::Keyboard> keyboard)
-   : mCpu(std::move(cpu)), mGfx(ppu), mKeyboard(keyboard), mPixelRects(new SDL_Rect[ppu->width()* ppu->height()])
+   : mScale(10), mFilter(Scaler::FILTER_NONE), mMaxSkip(0), mCpu(std::move(cpu)), mGfx(ppu), mKeyboard(keyboard),
+     mScreenWidth(0), mScreenHeight(0), mOverlayDirty(false), mInstructions(0), mFrames(0)
 {
    
 }
 
-bool chip8emu::Chip8Emu::init()
+void chip8emu::Chip8Emu::setScale(std::uint8_t scale)
+{
+   mScale = std::max<std::uint8_t>(scale, 1);
+}
+
+void chip8emu::Chip8Emu::setFilter(Scaler::Filter filter)
+{
+   mFilter = filter;
+}
+
+void chip8emu::Chip8Emu::setTrace(std::shared_ptr<Trace> trace)
+{
+   mTrace = trace;
+   mCpu->setTrace(trace);
+}
+
+void chip8emu::Chip8Emu::setDebugger(std::shared_ptr<Debugger> debugger)
+{
+   mDebugger = debugger;
+   mCpu->setDebugger(debugger);
+}
+
+void chip8emu::Chip8Emu::setStartupTimer(std::shared_ptr<StartupTimer> startup)
+{
+   mStartup = startup;
+}
+
+void chip8emu::Chip8Emu::setFrameSkip(std::uint32_t maxSkip)
+{
+   mMaxSkip = maxSkip;
+}
+
+void chip8emu::Chip8Emu::setMetrics(std::shared_ptr<Metrics> metrics, bool showOverlay)
+{
+   mMetrics = metrics;
+
+   if(showOverlay) {
+      toggleOverlay();
+   }
+}
+
+bool chip8emu::Chip8Emu::init(const std::string &rom)
 {
    //keyboard->setQuitHandler([this](){ this->quit(); });
    
-   // Define the pixel tile size.
-   mScale = 10;
+   // Setup the software scaler, which may round the pixel tile size down.
+   mScaler = std::make_unique<Scaler>(mFilter, mScale, 0xFFE0EEEE, 0xFF000000);
+   mScale = mScaler->scale();
+
+   // Frames are due at 60Hz.
+   mFrameSkipper = std::make_unique<FrameSkipper>(std::chrono::microseconds(1000000 / 60), mMaxSkip);
+
+   mGfx->clear();
+
+   // Load the rom and its last state while SDL brings up the window, the
+   // loader does not touch SDL.
+   std::future<void> loader;
+   if(!rom.empty()) {
+      loader = std::async(std::launch::async, [this, rom]() { loadRom(rom); });
+   }
+
+   const bool created = createWindow();
+
+   if(loader.valid()) {
+      loader.wait();
+   }
+
+   if(!created) {
+      return false;
+   }
+
+   mRunning = true;
+   mFullscreen = false;
+   mSpeedTrottled = true;
+
+   return true;
+}
+
+bool chip8emu::Chip8Emu::createWindow()
+{
+   // Initialize only the video subsystem (and thereby events), audio and
+   // input devices besides the keyboard are not used.
+   {
+      StartupTimer::Phase phase(mStartup.get(), "sdl video");
+      if (SDL_InitSubSystem(SDL_INIT_VIDEO) != 0) {
+         std::cout << "Failed to initialize SDL: " << SDL_GetError() << std::endl;
+         return false;
+      }
+   }
 
-   // Initialize SDL.
-   if (SDL_Init(SDL_INIT_EVERYTHING) == 0) {
-      // Create the main window on success.
+   // Create the main window, sized for lores displays while the rom may
+   // still be loading, ...
+   {
+      StartupTimer::Phase phase(mStartup.get(), "window");
       mWindow = std::shared_ptr<SDL_Window>(
                    SDL_CreateWindow("Chip8 Emulator by Phidelux", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, 
-                        mGfx->width() * mScale, mGfx->height() * mScale, 0), SDL_DestroyWindow);
-
-      // Create the renderer if the window creation succeeded.
-      if (mWindow != nullptr) {
-         mRenderer = std::shared_ptr<SDL_Renderer>(
-                        SDL_CreateRenderer(mWindow.get(), -1, 0), SDL_DestroyRenderer);
-
-         if (mRenderer != nullptr) {
-            // Setup the pixel rectangle dimensions.
-            const std::uint16_t screenSize = mGfx->width() * mGfx->height(); 
-            for (std::uint16_t i = 0; i < screenSize; i++) {
-               mPixelRects[i].w = mPixelRects[i].h = mScale;
-            }
-
-            SDL_ShowCursor(0);
-         } else {
-            std::cout << "Failed to initialize renderer!" << std::endl;
-            return false;
-         }
-      } else {
+                        PPU::LORES_WIDTH * mScale, PPU::LORES_HEIGHT * mScale, 0), SDL_DestroyWindow);
+
+      if (mWindow == nullptr) {
          std::cout << "Failed to initialize window!" << std::endl;
          return false;
       }
-   } else {
-      std::cout << "Failed to initialize SDL!" << std::endl;
-      return false;
    }
 
-   mRunning = true;
-   mFullscreen = false;
-   mSpeedTrottled = true;
+   // ... its renderer ...
+   {
+      StartupTimer::Phase phase(mStartup.get(), "renderer");
+      mRenderer = std::shared_ptr<SDL_Renderer>(
+                     SDL_CreateRenderer(mWindow.get(), -1, 0), SDL_DestroyRenderer);
 
-   mGfx->clear();
+      if (mRenderer == nullptr) {
+         std::cout << "Failed to initialize renderer!" << std::endl;
+         return false;
+      }
+   }
+
+   // ... and the texture the scaled screen is streamed into.
+   {
+      StartupTimer::Phase phase(mStartup.get(), "texture");
+      if (!createScreen(PPU::LORES_WIDTH, PPU::LORES_HEIGHT)) {
+         return false;
+      }
+   }
+
+   SDL_ShowCursor(0);
+
+   return true;
+}
+
+bool chip8emu::Chip8Emu::createScreen(std::uint8_t width, std::uint8_t height)
+{
+   mScaler->outputSize(width, height, mScreenWidth, mScreenHeight);
+   mScreen = std::shared_ptr<SDL_Texture>(
+         SDL_CreateTexture(mRenderer.get(), SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING,
+               mScreenWidth, mScreenHeight), SDL_DestroyTexture);
+
+   if (mScreen == nullptr) {
+      std::cout << "Failed to initialize screen texture!" << std::endl;
+      return false;
+   }
 
    return true;
 }
 
 void chip8emu::Chip8Emu::cycle()
 {
-   mCpu->cycle();
+   // A host frame starts with the emulation of the next machine frame.
+   const FrameSkipper::Clock::time_point now = FrameSkipper::Clock::now();
+   mFrameSkipper->beginFrame(now);
+
+   if(mMetrics != nullptr) {
+      mMetrics->beginFrame(now);
+
+      if(mMetrics->update(now) && mOverlay != nullptr) {
+         mOverlay->update(mMetrics->snapshot());
+         mOverlayDirty = true;
+      }
+   }
+
+   Metrics::Timer timer(mMetrics.get(), Metrics::PHASE_CYCLE);
+
+   // Run debugger commands, the machine stands still while it is paused.
+   if(mDebugger != nullptr) {
+      mDebugger->poll(*mCpu);
+      if(mDebugger->paused()) {
+         return;
+      }
+   }
+
+   // Hand the pad state to the core and emulate one 60Hz frame.
+   mCpu->setKeys(mKeyboard->padKeys(mFrames));
+   const std::uint32_t events = mCpu->runFrames(1);
+   mFrames++;
+
+   if(mMetrics != nullptr) {
+      for(const Keyboard::PadEdge &edge : mKeyboard->padEdges()) {
+         mMetrics->addInputLatency(edge.latency);
+      }
+   }
+
+   if(events & EVENT_BREAK) {
+      mDebugger->reportBreak(*mCpu);
+   }
+
+   if(mMetrics != nullptr) {
+      mMetrics->addInstructions(mCpu->instructions() - mInstructions);
+      mInstructions = mCpu->instructions();
+   }
+
+   if(mCapture != nullptr) {
+      mCapture->push(*mGfx);
+   }
+
+   if(events & EVENT_SOUND_ON) {
+      // TODO: Play sound with SDL lib.
+      std::cout << "BEEP!" << std::endl;
+   }
 }
 
 void chip8emu::Chip8Emu::render()
 {
-   if(mGfx->isDrawFlagSet()) {
-      std::uint16_t pixelsOn = 0;
-      for (int y = 0; y < mGfx->height(); y++) {
-         for (int x = 0; x < mGfx->width(); x++) {
-            if ((*mGfx)[y * mGfx->width() + x]) {
-               mPixelRects[pixelsOn].x = mScale * x, mPixelRects[pixelsOn].y = mScale * y;
-               pixelsOn++;
-            }
+   Metrics::Timer timer(mMetrics.get(), Metrics::PHASE_RENDER);
+
+   // Drop presenting a changed frame if it would make the next one late.
+   // The draw flag stays set, so the next presented frame shows the latest
+   // framebuffer.
+   if(mGfx->isDrawFlagSet() && !mFrameSkipper->shouldPresent(FrameSkipper::Clock::now())) {
+      if(mMetrics != nullptr) {
+         mMetrics->addDropped();
+      }
+
+      return;
+   }
+
+   if(mMetrics != nullptr) {
+      mGfx->isDrawFlagSet() ? mMetrics->addPresented() : mMetrics->addSkipped();
+   }
+
+   if(mGfx->isDrawFlagSet() || mOverlayDirty) {
+      const FrameSkipper::Clock::time_point start = FrameSkipper::Clock::now();
+      void *pixels;
+      int pitch;
+
+      // The texture follows the display mode the rom switched to, ...
+      int width, height;
+      mScaler->outputSize(mGfx->width(), mGfx->height(), width, height);
+      if((width != mScreenWidth || height != mScreenHeight) && !createScreen(mGfx->width(), mGfx->height())) {
+         mRunning = false;
+         return;
+      }
+
+      // ... the framebuffer is scaled straight into it ...
+      if(SDL_LockTexture(mScreen.get(), nullptr, &pixels, &pitch) == 0) {
+         mScaler->render(*mGfx, static_cast<std::uint32_t*>(pixels), pitch / sizeof(std::uint32_t));
+
+         if(mOverlay != nullptr) {
+            mOverlay->render(static_cast<std::uint32_t*>(pixels), pitch / sizeof(std::uint32_t),
+                             mScreenWidth, mScreenHeight);
          }
+
+         SDL_UnlockTexture(mScreen.get());
       }
 
-      // Clear the screen then draw the pixels
-      SDL_SetRenderDrawColor(mRenderer.get(), 0x00, 0x00, 0x00, 0xFF);
-      SDL_RenderClear(mRenderer.get());
-      SDL_SetRenderDrawColor(mRenderer.get(), 0xE0, 0xEE, 0xEE, 0xFF);
-      SDL_RenderFillRects(mRenderer.get(), mPixelRects, pixelsOn);
+      // ... and present it with a single blit.
+      SDL_RenderCopy(mRenderer.get(), mScreen.get(), nullptr, nullptr);
 
       // Flip the screen and hold
       SDL_RenderPresent(mRenderer.get());
 
       mGfx->resetDrawFlag();
+      mOverlayDirty = false;
+
+      mFrameSkipper->addPresentCost(FrameSkipper::Clock::now() - start);
    }
 }
 
-void chip8emu::Chip8Emu::handleEvents()
+chip8emu::FrameSkipper::Clock::time_point chip8emu::Chip8Emu::frameDue() const
 {
-   if(mKeyboard->isKeyDown(SDL_SCANCODE_ESCAPE)) {
+   return mFrameSkipper->due();
+}
+
+void chip8emu::Chip8Emu::handleEvents(std::uint32_t timeout)
+{
+   Metrics::Timer timer(mMetrics.get(), Metrics::PHASE_EVENTS);
+
+   mKeyboard->update(timeout);
+
+   if(mKeyboard->hotkeyPressed(HOTKEY_QUIT)) {
       mRunning = false;
    }
    
-   if(mKeyboard->isKeyDown(SDL_SCANCODE_F10)) {
+   if(mKeyboard->hotkeyPressed(HOTKEY_FULLSCREEN)) {
       if(mFullscreen) {
          SDL_SetWindowFullscreen(mWindow.get(), 0);
       } else {
@@ -107,21 +295,49 @@ void chip8emu::Chip8Emu::handleEvents()
       mFullscreen = !mFullscreen;
    }
    
-   if(mKeyboard->isKeyPressed(SDLK_F8)) {
+   if(mKeyboard->hotkeyPressed(HOTKEY_OVERLAY)) {
+      toggleOverlay();
+   }
+
+   if(mKeyboard->hotkeyPressed(HOTKEY_TRACE)) {
+      dumpTrace();
+   }
+
+   if(mKeyboard->hotkeyPressed(HOTKEY_SAVE_STATE)) {
       saveState();
    }
    
-   if(mKeyboard->isKeyPressed(SDLK_F9)) {
+   if(mKeyboard->hotkeyPressed(HOTKEY_SNAPSHOT)) {
       takeSnapshot();
    }
 
-   mSpeedTrottled = !mKeyboard->isKeyDown(SDL_SCANCODE_SPACE);
-    
-   mKeyboard->update();
+   if(mKeyboard->hotkeyPressed(HOTKEY_CAPTURE)) {
+      toggleCapture();
+   }
+
+   mSpeedTrottled = !mKeyboard->isHotkeyDown(HOTKEY_TURBO);
 }
 
 void chip8emu::Chip8Emu::clean()
 {
+   if(mCapture != nullptr) {
+      toggleCapture();
+   }
+
+   if(mScaler != nullptr) {
+      mScaler->reportCost(std::cout);
+   }
+
+   if(mFrameSkipper != nullptr) {
+      mFrameSkipper->report(std::cout);
+   }
+
+   mKeyboard->reportLatency(std::cout);
+
+   mScreen.reset();
+   mRenderer.reset();
+   mWindow.reset();
+
    SDL_Quit();
 }
 
@@ -141,9 +357,16 @@ void chip8emu::Chip8Emu::loadRom(const std::string &filename)
       mRomName.erase(periodIdx);
    }
    
-   mCpu->loadRom(filename);
+   {
+      StartupTimer::Phase phase(mStartup.get(), "rom");
+      mCpu->loadRom(filename);
+   }
+
+   std::cout << "Rom hash " << std::hex << std::setw(16) << std::setfill('0') << mCpu->romHash() << std::dec
+             << std::setfill(' ') << ", quirk profile " << quirksName(mCpu->quirks()) << std::endl;
       
    // Fetch the name of the last save state, ...
+   StartupTimer::Phase phase(mStartup.get(), "state");
    std::string stateFile = generateFilename("chip8_", ".bak", true);
    
    // ... check if the file exists.
@@ -183,6 +406,52 @@ void chip8emu::Chip8Emu::takeSnapshot()
    std::cout << "Saved snapshot as " << filename << " ..." << std::endl;
 }
 
+void chip8emu::Chip8Emu::dumpTrace()
+{
+   if(mTrace == nullptr) {
+      std::cout << "Tracing is disabled, start with -trace <file> ..." << std::endl;
+   } else if(mTrace->dump()) {
+      std::cout << "Saved execution trace as " << mTrace->filename() << " ..." << std::endl;
+   }
+}
+
+void chip8emu::Chip8Emu::toggleOverlay()
+{
+   if(mMetrics == nullptr) {
+      return;
+   }
+
+   if(mOverlay != nullptr) {
+      mOverlay.reset();
+   } else {
+      mOverlay = std::make_unique<Overlay>(0xFFFFFF00, 0xFF202020);
+      mOverlay->update(mMetrics->snapshot());
+   }
+
+   mOverlayDirty = true;
+}
+
+void chip8emu::Chip8Emu::toggleCapture(const std::string &filename)
+{
+   // Stop a running capture ...
+   if(mCapture != nullptr) {
+      mCapture->stop();
+      std::cout << "Saved capture as " << mCapture->filename() << " (" << mCapture->frames() << " frames, "
+                << mCapture->stored() << " distinct, " << mCapture->dropped() << " dropped) ..." << std::endl;
+      mCapture.reset();
+      return;
+   }
+
+   // ... or start a new one.
+   mCapture = std::make_unique<Capture>(filename.empty() ? generateFilename("capture_", ".gif") : filename);
+   if(mCapture->start()) {
+      std::cout << "Capturing to " << mCapture->filename() << " ..." << std::endl;
+   } else {
+      std::cout << "Failed to open " << mCapture->filename() << "!" << std::endl;
+      mCapture.reset();
+   }
+}
+
 std::string chip8emu::Chip8Emu::generateFilename(const std::string &prefix, const std::string &ext, const bool exists) const
 {
    // Fetch the current rom name, ...
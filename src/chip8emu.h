@@ -3,7 +3,14 @@
 
 #include "cpu.h"
 #include "ppu.h"
+#include "capture.h"
+#include "debugger.h"
+#include "frameskipper.h"
 #include "keyboard.h"
+#include "metrics.h"
+#include "overlay.h"
+#include "scaler.h"
+#include "startuptimer.h"
 
 #include "SDL2/SDL.h"
 
@@ -13,7 +20,6 @@
 #include <memory>
 #include <functional>
 
-#define MEM_SIZE 4096
 #define REG_SIZE 16
 
 #define STK_SIZE 16
@@ -31,10 +37,24 @@ class Chip8Emu
 public:
    Chip8Emu(std::unique_ptr<chip8emu::CPU>cpu, std::shared_ptr<chip8emu::PPU> ppu, std::shared_ptr<chip8emu::Keyboard> keyboard);
 
-   bool init();
+   void setScale(std::uint8_t scale);
+   void setFilter(Scaler::Filter filter);
+   void setTrace(std::shared_ptr<Trace> trace);
+   void setDebugger(std::shared_ptr<Debugger> debugger);
+   void setMetrics(std::shared_ptr<Metrics> metrics, bool showOverlay);
+   void setStartupTimer(std::shared_ptr<StartupTimer> startup);
+   // Presenting up to 'maxSkip' changed frames in a row may be dropped to
+   // keep emulation in time, 0 presents every changed frame.
+   void setFrameSkip(std::uint32_t maxSkip);
+
+   // Creates the window and, if given, loads the rom meanwhile.
+   bool init(const std::string &rom = "");
    void cycle();
    void render();
-	void handleEvents();
+   // Handles pending input, waiting up to 'timeout' ms for the first event.
+   void handleEvents(std::uint32_t timeout = 0);
+   // When the next frame is due on the real-time schedule.
+   FrameSkipper::Clock::time_point frameDue() const;
    
    std::shared_ptr<SDL_Renderer> getRenderer() const;
    std::shared_ptr<SDL_Window> getWindow() const;
@@ -43,6 +63,9 @@ public:
    void loadState(const std::string &filename);
    void saveState();
    void takeSnapshot();
+   void toggleCapture(const std::string &filename = "");
+   void dumpTrace();
+   void toggleOverlay();
    
    bool speedTrottled();
    bool fullscreen();
@@ -56,17 +79,34 @@ private:
    bool mFullscreen;
    bool mSpeedTrottled;
    std::uint8_t mScale;
+   Scaler::Filter mFilter;
+   std::uint32_t mMaxSkip;
    
    std::string mRomName;
 
    std::unique_ptr<CPU> mCpu;
-   std::shared_ptr<PPU> mGfx; // Display of 64x32 px
+   std::shared_ptr<PPU> mGfx; // Display, lores or hires
    std::shared_ptr<Keyboard> mKeyboard; // Current keypad state
    
    std::shared_ptr<SDL_Window> mWindow;
    std::shared_ptr<SDL_Renderer> mRenderer;
-   SDL_Rect *mPixelRects;
+   std::shared_ptr<SDL_Texture> mScreen; // Streaming texture the scaler renders into
+   int mScreenWidth; // Size of mScreen, following the display mode
+   int mScreenHeight;
+   std::unique_ptr<Scaler> mScaler;
+   std::unique_ptr<Capture> mCapture;
+   std::shared_ptr<Trace> mTrace;
+   std::shared_ptr<Debugger> mDebugger;
+   std::shared_ptr<Metrics> mMetrics;
+   std::unique_ptr<Overlay> mOverlay; // Metrics drawn on screen, if shown
+   bool mOverlayDirty; // Overlay changed since the last presented frame
+   std::uint64_t mInstructions; // CPU instruction count already reported
+   std::uint64_t mFrames; // Emulated frames, the time base of pad edges
+   std::shared_ptr<StartupTimer> mStartup; // Startup phase times, if requested
+   std::unique_ptr<FrameSkipper> mFrameSkipper; // Real-time schedule of the frames
    
+   bool createWindow();
+   bool createScreen(std::uint8_t width, std::uint8_t height);
    std::string generateFilename(const std::string &prefix, const std::string &ext, const bool exists = false) const;
 };
 
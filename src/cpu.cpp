@@ -1,347 +1,754 @@
 #include "cpu.h"
 
 #include <algorithm>
+#include <cstring>
 #include <iostream>
 #include <iterator>
 #include <fstream>
 
-chip8emu::CPU::CPU(std::shared_ptr<PPU> ppu, std::shared_ptr<Keyboard> keyboard)
-   : mGfx(ppu), mKeyboard(keyboard), mMem(4096, 0), mReg(16, 0)
+const std::uint8_t chip8emu::FONTSET[80] = {
+   0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
+   0x20, 0x60, 0x20, 0x20, 0x70, // 1
+   0xF0, 0x10, 0xF0, 0x80, 0xF0, // 2
+   0xF0, 0x10, 0xF0, 0x10, 0xF0, // 3
+   0x90, 0x90, 0xF0, 0x10, 0x10, // 4
+   0xF0, 0x80, 0xF0, 0x10, 0xF0, // 5
+   0xF0, 0x80, 0xF0, 0x90, 0xF0, // 6
+   0xF0, 0x10, 0x20, 0x40, 0x40, // 7
+   0xF0, 0x90, 0xF0, 0x90, 0xF0, // 8
+   0xF0, 0x90, 0xF0, 0x10, 0xF0, // 9
+   0xF0, 0x90, 0xF0, 0x90, 0x90, // A
+   0xE0, 0x90, 0xE0, 0x90, 0xE0, // B
+   0xF0, 0x80, 0x80, 0x80, 0xF0, // C
+   0xE0, 0x90, 0x90, 0x90, 0xE0, // D
+   0xF0, 0x80, 0xF0, 0x80, 0xF0, // E
+   0xF0, 0x80, 0xF0, 0x80, 0x80  // F
+};
+
+const std::uint8_t chip8emu::FONTSET_HIRES[160] = {
+   0xFF, 0xFF, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, // 0
+   0x18, 0x78, 0x78, 0x18, 0x18, 0x18, 0x18, 0x18, 0xFF, 0xFF, // 1
+   0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // 2
+   0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 3
+   0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0x03, 0x03, // 4
+   0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 5
+   0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 6
+   0xFF, 0xFF, 0x03, 0x03, 0x06, 0x0C, 0x18, 0x18, 0x18, 0x18, // 7
+   0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 8
+   0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 9
+   0x7E, 0xFF, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3, // A
+   0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, // B
+   0x3C, 0xFF, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0xFF, 0x3C, // C
+   0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC, // D
+   0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // E
+   0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xC0, 0xC0  // F
+};
+
+namespace
+{
+
+// Memory stored by states of earlier versions, the rest follows the
+// extension marker behind the random generator.
+const std::size_t LOW_MEMORY = 0x1000;
+const char STATE_EXTENSION = 'X';
+
+// Seeded generators are stored as the seed and the values drawn since,
+// unless restoring them would take more than about a second of drawing.
+const char STATE_SEEDED = 'S';
+const std::uint64_t MAX_STATE_DRAWS = 1ull << 26;
+
+// Interpreter hooks without a debugger attached, compiled away entirely.
+struct NoDebugHooks
+{
+   static bool before(chip8emu::Debugger*, std::uint16_t, const std::uint8_t*) { return false; }
+   static void read(chip8emu::Debugger*, std::uint16_t, std::uint16_t, std::uint16_t) { }
+   static void write(chip8emu::Debugger*, std::uint16_t, std::uint16_t, std::uint16_t) { }
+   static bool after(chip8emu::Debugger*) { return false; }
+};
+
+// Interpreter hooks forwarding to the attached debugger.
+struct DebuggerHooks
+{
+   static bool before(chip8emu::Debugger *debugger, std::uint16_t pc, const std::uint8_t *reg)
+   {
+      return debugger->breakBefore(pc, reg);
+   }
+
+   static void read(chip8emu::Debugger *debugger, std::uint16_t addr, std::uint16_t length, std::uint16_t mask)
+   {
+      debugger->onRead(addr, length, mask);
+   }
+
+   static void write(chip8emu::Debugger *debugger, std::uint16_t addr, std::uint16_t length, std::uint16_t mask)
+   {
+      debugger->onWrite(addr, length, mask);
+   }
+
+   static bool after(chip8emu::Debugger *debugger)
+   {
+      return debugger->breakAfter();
+   }
+};
+
+}
+
+chip8emu::CPU::CPU(std::shared_ptr<PPU> ppu)
+   : CPU(ppu, std::random_device {}())
+{
+
+}
+
+chip8emu::CPU::CPU(std::shared_ptr<PPU> ppu, std::uint32_t seed)
+   : mGfx(ppu), mKeys(0), mTraceDumped(false), mQuirks(QUIRKS_DEFAULT), mRomHash(0), mInstructions(0), mEvents(EVENT_NONE), mCyclesPerFrame(10), mFrameCycles(0), mStackDepth(0)
 {
-   rnd = std::bind(
-            std::uniform_int_distribution<std::uint16_t> {0, std::numeric_limits<std::uint8_t>::max()},
-            std::mt19937(std::random_device {}()));
+   this->seed(seed);
 
    // Initialize the registers and memory.
    mPc = 0x200;
    mOp = 0;
    mI = 0;
 
-   // Clear registers V0-VF.
-   std::fill(mReg.begin(), mReg.end(), 0);
+   // Clear registers V0-VF and the user flags.
+   mReg.fill(0);
+   mRpl.fill(0);
+
+   // Clear memory and stack.
+   mMem.fill(0);
+   mStk.fill(0);
+
+   // Load the fontsets into memory.
+   std::copy(std::begin(FONTSET), std::end(FONTSET), mMem.begin());
+   std::copy(std::begin(FONTSET_HIRES), std::end(FONTSET_HIRES), mMem.begin() + FONTSET_HIRES_ADDRESS);
+
+   // Initialize the timers.
+   mDelayTimer = 0;
+   mSoundTimer = 0;
+   mFrameDirty = false;
+}
+
+chip8emu::CPU::CPU(std::shared_ptr<PPU> ppu, const CPU &prototype)
+   : mGfx(ppu), mKeys(prototype.mKeys), mTraceDumped(false), mQuirks(prototype.mQuirks), mRomHash(prototype.mRomHash),
+     mInstructions(0), mEvents(EVENT_NONE), mCyclesPerFrame(prototype.mCyclesPerFrame), mFrameCycles(prototype.mFrameCycles),
+     mFrameDirty(prototype.mFrameDirty), mOp(prototype.mOp), mMem(prototype.mMem), mReg(prototype.mReg), mRpl(prototype.mRpl),
+     mI(prototype.mI), mPc(prototype.mPc), mDelayTimer(prototype.mDelayTimer), mSoundTimer(prototype.mSoundTimer),
+     mStk(prototype.mStk), mStackDepth(prototype.mStackDepth), mRng(prototype.mRng), mRngOrigin(prototype.mRngOrigin),
+     mRandomDraws(prototype.mRandomDraws), mRngMark(prototype.mRngMark), mRngMarkDraws(prototype.mRngMarkDraws),
+     mSeed(prototype.mSeed), mSeeded(prototype.mSeeded), mRndDist(prototype.mRndDist)
+{
+   mGfx->copyFrom(*prototype.mGfx);
+}
 
-   // Clear memory.
-   std::fill(mMem.begin(), mMem.end(), 0);
+chip8emu::CPU::~CPU()
+{
+   
+}
 
-   // Load fontset into memory.
-   std::copy(mFontset.begin(), mFontset.end(), mMem.begin());
+void chip8emu::CPU::cycle()
+{
+   run(1);
+}
 
-   // Initialize the opcode matrix.
-   mOpcodes = {
-      // Call RCA 1802 programm at NNN
-      { 0x0000, [this]() { } },
+template <typename Q>
+void chip8emu::CPU::runQuirks(std::uint32_t cycles)
+{
+   if(mDebugger != nullptr) {
+      runCycles<DebuggerHooks, Q>(cycles);
+   } else {
+      runCycles<NoDebugHooks, Q>(cycles);
+   }
+}
+
+template <typename Hooks, typename Q>
+void chip8emu::CPU::runCycles(std::uint32_t cycles)
+{
+   Debugger *debugger = mDebugger.get();
+   std::uint32_t executed = 0;
+
+   while(executed < cycles) {
+      if(Hooks::before(debugger, mPc, mReg.data())) {
+         mEvents |= EVENT_BREAK;
+         break;
+      }
+
+      execute<Hooks, Q>();
+      executed++;
+
+      // The timers run at 60Hz, so update them once per frame.
+      if(++mFrameCycles >= mCyclesPerFrame) {
+         mFrameCycles = 0;
+         tickFrame();
+      }
+
+      if(Hooks::after(debugger)) {
+         mEvents |= EVENT_BREAK;
+         break;
+      }
+   }
+
+   mInstructions += executed;
+}
+
+template <typename Hooks, typename Q>
+void chip8emu::CPU::execute()
+{
+   Debugger *debugger = mDebugger.get();
+   const std::uint16_t pc = mPc;
+   bool invalid = false;
+
+   // Fetch the opcode, ...
+   mOp = (mMem[mPc & Q::ADDRESS_MASK] << 8) | mMem[(mPc + 1) & Q::ADDRESS_MASK];
+
+   const std::uint8_t x = (mOp & 0x0F00) >> 8;
+   const std::uint8_t y = (mOp & 0x00F0) >> 4;
+   const std::uint8_t nn = mOp & 0x00FF;
+
+   // ... decode and execute it.
+   switch(mOp & 0xF000) {
+   case 0x0000:
+      switch(mOp) {
       // Clear screen
-      { 0x00E0, [this]() {
-            mGfx->clear();
-            mPc += 2;
-         }
-      },
+      case 0x00E0:
+         mGfx->clear();
+         mFrameDirty = true;
+         mPc += 2;
+         break;
       // Return from subroutine
-      {
-         0x00EE, [this]() {
-            mPc = mStk.back();
-            mStk.pop_back();
+      case 0x00EE:
+         // Returning with an empty stack goes back to the oldest call.
+         mPc = mStk[mStackDepth > 0 ? --mStackDepth : 0];
+         mPc += 2;
+         break;
+      // Scroll the display right by 4 pixels
+      case 0x00FB:
+         mGfx->scrollRight(4);
+         mFrameDirty = true;
+         mPc += 2;
+         break;
+      // Scroll the display left by 4 pixels
+      case 0x00FC:
+         mGfx->scrollLeft(4);
+         mFrameDirty = true;
+         mPc += 2;
+         break;
+      // Exit the interpreter, which halts on this instruction
+      case 0x00FD:
+         break;
+      // Switch to the 64x32 or the 128x64 display, clearing it
+      case 0x00FE:
+      case 0x00FF:
+         mGfx->setHires(mOp == 0x00FF);
+         mFrameDirty = true;
+         mPc += 2;
+         break;
+      default:
+         // Scroll the display down N rows, or up N rows on XO-CHIP
+         if((mOp & 0xFFF0) == 0x00C0) {
+            mGfx->scrollDown(mOp & 0x000F);
+            mFrameDirty = true;
+            mPc += 2;
+         } else if(Q::XO_EXTENSIONS && (mOp & 0xFFF0) == 0x00D0) {
+            mGfx->scrollUp(mOp & 0x000F);
+            mFrameDirty = true;
             mPc += 2;
          }
-      },
-      // Jump to addr NNN
-      {
-         0x1000, [this]() {
-            mPc = (mOp & 0x0FFF);
-         }
-      },
-      // Call subroutine at nn
-      {
-         0x2000, [this]() {
-            mStk.push_back(mPc);
-            mPc = (mOp & 0x0FFF);
-         }
-      },
-      // Skip next instruction if VX equals NN
-      {
-         0x3000, [this]() {
-            mReg[(mOp & 0x0F00) >> 8] == (mOp & 0x00FF) ? mPc += 4 : mPc += 2;
+         // Call RCA 1802 programm at NNN
+         break;
+      }
+      break;
+   // Jump to addr NNN
+   case 0x1000:
+      mPc = (mOp & 0x0FFF);
+      break;
+   // Call subroutine at nn
+   case 0x2000:
+      push(mPc);
+      mPc = (mOp & 0x0FFF);
+      break;
+   // Skip next instruction if VX equals NN
+   case 0x3000:
+      mPc += mReg[x] == nn ? skip<Q>() : 2;
+      break;
+   // Skip next instruction if VX doesn't equal NN
+   case 0x4000:
+      mPc += mReg[x] != nn ? skip<Q>() : 2;
+      break;
+   case 0x5000:
+      switch(Q::XO_EXTENSIONS ? mOp & 0x000F : 0) {
+      // Store VX to VY, in either order, in memory starting at I
+      case 0x2: {
+         const std::uint8_t count = (x < y ? y - x : x - y) + 1;
+         Hooks::write(debugger, mI, count, Q::ADDRESS_MASK);
+         for(std::uint8_t i = 0; i < count; i++) {
+            mMem[(mI + i) & Q::ADDRESS_MASK] = mReg[x < y ? x + i : x - i];
          }
-      },
-      // Skip next instruction if VX doesn't equal NN
-      {
-         0x4000, [this]() {
-            mReg[(mOp & 0x0F00) >> 8] != (mOp & 0x00FF) ? mPc += 4 : mPc += 2;
+         mPc += 2;
+         break;
+      }
+      // Fill VX to VY, in either order, with values from memory starting at I
+      case 0x3: {
+         const std::uint8_t count = (x < y ? y - x : x - y) + 1;
+         Hooks::read(debugger, mI, count, Q::ADDRESS_MASK);
+         for(std::uint8_t i = 0; i < count; i++) {
+            mReg[x < y ? x + i : x - i] = mMem[(mI + i) & Q::ADDRESS_MASK];
          }
-      },
+         mPc += 2;
+         break;
+      }
       // Skip the next instruction of VX equals VY
-      {
-         0x5000, [this]() {
-            mReg[(mOp & 0x0F00) >> 8] == mReg[(mOp & 0x00F0) >> 4] ? mPc += 4 : mPc += 2;
-         }
-      },
-      // Set VX to NN
-      {
-         0x6000, [this]() {
-            mReg[(mOp & 0x0F00) >> 8] = (mOp & 0x00FF);
-            mPc += 2;
-         }
-      },
-      // Add NN to VX
-      {
-         0x7000, [this]() {
-            mReg[(mOp & 0x0F00) >> 8] += (mOp & 0x00FF);
-            mPc += 2;
-         }
-      },
+      default:
+         mPc += mReg[x] == mReg[y] ? skip<Q>() : 2;
+         break;
+      }
+      break;
+   // Set VX to NN
+   case 0x6000:
+      mReg[x] = nn;
+      mPc += 2;
+      break;
+   // Add NN to VX
+   case 0x7000:
+      mReg[x] += nn;
+      mPc += 2;
+      break;
+   case 0x8000:
+      switch(mOp & 0x000F) {
       // Set VX to value of VY
-      {
-         0x8000, [this]() {
-            mReg[(mOp & 0x0F00) >> 8] = mReg[(mOp & 0x00F0) >> 4];
-            mPc += 2;
-         }
-      },
+      case 0x0:
+         mReg[x] = mReg[y];
+         break;
       // Set VX to VX or VY
-      {
-         0x8001, [this]() {
-            mReg[(mOp & 0x0F00) >> 8] |= mReg[(mOp & 0x00F0) >> 4];
-            mPc += 2;
-         }
-      },
+      case 0x1:
+         mReg[x] |= mReg[y];
+         mReg[0xF] = Q::RESET_VF ? 0 : mReg[0xF];
+         break;
       // Set VX to VX and VY
-      {
-         0x8002, [this]() {
-            mReg[(mOp & 0x0F00) >> 8] &= mReg[(mOp & 0x00F0) >> 4];
-            mPc += 2;
-         }
-      },
+      case 0x2:
+         mReg[x] &= mReg[y];
+         mReg[0xF] = Q::RESET_VF ? 0 : mReg[0xF];
+         break;
       // Set VX to VX xor VY
-      {
-         0x8003, [this]() {
-            mReg[(mOp & 0x0F00) >> 8] ^= mReg[(mOp & 0x00F0) >> 4];
-            mPc += 2;
-         }
-      },
+      case 0x3:
+         mReg[x] ^= mReg[y];
+         mReg[0xF] = Q::RESET_VF ? 0 : mReg[0xF];
+         break;
       // Add VY to VX and set VF to 1 if there is a carry, 0 otherwise
-      {
-         0x8004, [this]() {
-            mReg[0xF] = mReg[(mOp & 0x00F0) >> 4] > (0xFF - mReg[(mOp & 0x0F00) >> 8]) ? 1 : 0;
-            mReg[(mOp & 0x0F00) >> 8] += mReg[(mOp & 0x00F0) >> 4];
-            mPc += 2;
-         }
-      },
+      case 0x4:
+         mReg[0xF] = mReg[y] > (0xFF - mReg[x]) ? 1 : 0;
+         mReg[x] += mReg[y];
+         break;
       // Substract VY from VX and set VF to 1 if there is a borrow, 0 otherwise
-      {
-         0x8005, [this]() {
-            mReg[0xF] = mReg[(mOp & 0x00F0) >> 4] > mReg[(mOp & 0x0F00) >> 8] ? 0 : 1;
-            mReg[(mOp & 0x0F00) >> 8] -= mReg[(mOp & 0x00F0) >> 4];
-            mPc += 2;
-         }
-      },
-      // Shift VX right by one, set VF to the least significant bit of VX before
-      {
-         0x8006, [this]() {
-            mReg[0xF] = mReg[(mOp & 0x0F00) >> 8] & 1;
-            mReg[(mOp & 0x0F00) >> 8] >>= 1;
-            mPc += 2;
-         }
-      },
+      case 0x5:
+         mReg[0xF] = mReg[y] > mReg[x] ? 0 : 1;
+         mReg[x] -= mReg[y];
+         break;
+      // Shift VX (or VY) right by one into VX, set VF to the least significant bit before
+      case 0x6: {
+         const std::uint8_t value = mReg[Q::SHIFT_VY ? y : x];
+         mReg[0xF] = value & 1;
+         mReg[x] = value >> 1;
+         break;
+      }
       // Set VX to VY minus VX, set VF to 1 if there is a barrow, 0 otherwise
-      {
-         0x8007, [this]() {
-            mReg[0xF] = mReg[(mOp & 0x0F00) >> 8] > (mReg[(mOp & 0x00F0) >> 4]) ? 0 : 1;
-            mReg[(mOp & 0x0F00) >> 8] = mReg[(mOp & 0x00F0) >> 4] - mReg[(mOp & 0x0F00) >> 8];
-            mPc += 2;
-         }
-      },
-      // Shift VX left by one, set VF to the most significant bit.
-      {
-         0x800E, [this]() {
-            mReg[0xF] = mReg[(mOp & 0x0F00) >> 8] >> 7;
-            mReg[(mOp & 0x0F00) >> 8] <<= 1;
-            mPc += 2;
-         }
-      },
-      // Skip the next instruction if VX doesn't equal VY
-      {
-         0x9000, [this]() {
-            mReg[(mOp & 0x0F00) >> 8] != mReg[(mOp & 0x00F0) >> 4] ? mPc += 4 : mPc += 2;
-         }
-      },
-      // Set the index register to address NNN
-      {
-         0xA000, [this]() {
-            mI = mOp & 0x0FFF;
-            mPc += 2;
-         }
-      },
-      // Jump to the address NNN plus V0
-      {
-         0xB000, [this]() {
-            mPc = (mOp & 0x0FFF) + mReg[0];
-         }
-      },
-      // Set VX to a bitweis and operation of a randam number and NN
-      {
-         0xC000, [this]() {
-            mReg[(mOp & 0x0F00) >> 8] = rnd() & (mOp & 0x00FF);
-            mPc += 2;
-         }
-      },
-      // Draw a sprite at (VX, VY) that has a width of 8 pixels and a height of N pixels.
-      {
-         0xD000, [this]() {
-            uint8_t x = mReg[(mOp & 0x0F00) >> 8];
-            uint8_t y = mReg[(mOp & 0x00F0) >> 4];
-            uint8_t h = (mOp & 0x000F);
-            std::uint8_t p;
-
-            mReg[0xF] = 0;
-
-            for (std::uint8_t i = 0; i < h; i++) {
-               p = mMem[mI + i];
-               for (std::uint8_t j = 0; j < 8; j++) {
-                  if ((p & (0x80 >> j)) != 0) {
-                     if ((*mGfx)[(x + j + ((y + i) * 64))] != 0) {
-                        mReg[0xF] = 1;
-                     }
-
-                     (*mGfx)[(x + j + ((y + i) * 64))] ^= 1;
-                  }
-               }
-            }
+      case 0x7:
+         mReg[0xF] = mReg[x] > mReg[y] ? 0 : 1;
+         mReg[x] = mReg[y] - mReg[x];
+         break;
+      // Shift VX (or VY) left by one into VX, set VF to the most significant bit.
+      case 0xE: {
+         const std::uint8_t value = mReg[Q::SHIFT_VY ? y : x];
+         mReg[0xF] = value >> 7;
+         mReg[x] = value << 1;
+         break;
+      }
+      default:
+         invalid = true;
+         break;
+      }
+      mPc += 2;
+      break;
+   // Skip the next instruction if VX doesn't equal VY
+   case 0x9000:
+      mPc += mReg[x] != mReg[y] ? skip<Q>() : 2;
+      break;
+   // Set the index register to address NNN
+   case 0xA000:
+      mI = mOp & 0x0FFF;
+      mPc += 2;
+      break;
+   // Jump to the address NNN plus V0, or XNN plus VX
+   case 0xB000:
+      mPc = (mOp & 0x0FFF) + mReg[Q::JUMP_VX ? x : 0];
+      break;
+   // Set VX to a bitweis and operation of a randam number and NN
+   case 0xC000:
+      mReg[x] = mRndDist(mRng) & nn;
+      mRandomDraws++;
+      mPc += 2;
+      break;
+   // Draw a sprite at (VX, VY) that has a width of 8 pixels and a height of N pixels,
+   // or of 16x16 pixels for N = 0 on the hires display and on XO-CHIP.
+   case 0xD000: {
+      const bool wide = (mOp & 0x000F) == 0 && (Q::XO_EXTENSIONS || mGfx->isHires());
+      const std::uint8_t h = wide ? 16 : (mOp & 0x000F);
 
-            mPc += 2;
-         }
-      },
+      // Every selected plane has its own sprite data.
+      const std::uint8_t planes = mGfx->selectedPlanes();
+      const std::uint8_t length = h * (wide ? 2 : 1) * ((planes & 1) + (planes >> 1));
+      std::uint8_t sprite[64];
+
+      Hooks::read(debugger, mI, length, Q::ADDRESS_MASK);
+      for(std::uint8_t i = 0; i < length; i++) {
+         sprite[i] = mMem[(mI + i) & Q::ADDRESS_MASK];
+      }
+
+      mReg[0xF] = mGfx->drawSprite(mReg[x], mReg[y], sprite, h, Q::CLIP_SPRITES, wide) ? 1 : 0;
+
+      mFrameDirty = true;
+      mPc += 2;
+      break;
+   }
+   case 0xE000:
+      switch(nn) {
       // Skip next instruction if key in VX is pressed
-      {
-         0xE09E, [this]() {
-            mKeyboard->isPadKeyDown(mReg[(mOp & 0x0F00) >> 8]) ? mPc += 4 : mPc += 2;
-         }
-      },
+      case 0x9E:
+         mPc += isPadKeyDown(mReg[x]) ? skip<Q>() : 2;
+         mEvents |= EVENT_KEY_QUERY;
+         break;
       // Skip next instruction if key in VX is not pressed
-      {
-         0xE0A1, [this]() {
-            !mKeyboard->isPadKeyDown(mReg[(mOp & 0x0F00) >> 8]) ? mPc += 4 : mPc += 2;
+      case 0xA1:
+         mPc += !isPadKeyDown(mReg[x]) ? skip<Q>() : 2;
+         mEvents |= EVENT_KEY_QUERY;
+         break;
+      default:
+         invalid = true;
+         mPc += 2;
+         break;
+      }
+      break;
+   case 0xF000:
+      switch(nn) {
+      // Set I to the address in the next two bytes (XO-CHIP F000 NNNN)
+      case 0x00:
+         if(!Q::XO_EXTENSIONS || x != 0) {
+            invalid = true;
+            mPc += 2;
+            break;
          }
-      },
+
+         mI = (mMem[(mPc + 2) & Q::ADDRESS_MASK] << 8) | mMem[(mPc + 3) & Q::ADDRESS_MASK];
+         mPc += 4;
+         break;
+      // Select the planes drawn, scrolled and cleared (XO-CHIP FN01)
+      case 0x01:
+         if(Q::XO_EXTENSIONS) {
+            mGfx->selectPlanes(x);
+         } else {
+            invalid = true;
+         }
+         mPc += 2;
+         break;
+      // Load the audio pattern (XO-CHIP F002), there is no audio output yet
+      case 0x02:
+         invalid = !Q::XO_EXTENSIONS || x != 0;
+         mPc += 2;
+         break;
       // Set VX to value of delay timer
-      {
-         0xF007, [this]() {
-            mReg[(mOp & 0x0F00) >> 8] = mDelayTimer;
-            mPc += 2;
+      case 0x07:
+         mReg[x] = mDelayTimer;
+         mPc += 2;
+         break;
+      // Store the next keypress in VX, blocking until a key is down
+      case 0x0A:
+         mEvents |= EVENT_KEY_QUERY;
+         if(mKeys == 0) {
+            mEvents |= EVENT_WAITING_FOR_KEY;
+            break;
          }
-      },
-      // TODO: Store the next keypress in VX
-      {
-         0xF00A, [this]() {
-            for(std::uint8_t i = 0; i < 16; i++) {
-               if(mKeyboard->isPadKeyDown(i)) {
-                  mReg[(mOp & 0x0F00) >> 8] = i;
-                  mPc += 2;
-                  break;
-               }
+
+         for(std::uint8_t i = 0; i < 16; i++) {
+            if(isPadKeyDown(i)) {
+               mReg[x] = i;
+               mPc += 2;
+               break;
             }
          }
-      },
+         break;
       // Set delay timer to VX
-      {
-         0xF015, [this]() {
-            mDelayTimer = mReg[(mOp & 0x0F00) >> 8];
-            mPc += 2;
-         }
-      },
+      case 0x15:
+         mDelayTimer = mReg[x];
+         mPc += 2;
+         break;
       // Set sound timer to VX
-      {
-         0xF018, [this]() {
-            mSoundTimer = mReg[(mOp & 0x0F00) >> 8];
-            mPc += 2;
+      case 0x18:
+         if(mSoundTimer == 0 && mReg[x] > 0) {
+            mEvents |= EVENT_SOUND_ON;
+         } else if(mSoundTimer > 0 && mReg[x] == 0) {
+            mEvents |= EVENT_SOUND_OFF;
          }
-      },
+
+         mSoundTimer = mReg[x];
+         mPc += 2;
+         break;
       // Add VX to I
-      {
-         0xF01E, [this]() {
-            // VF is set to 1 when range overflow (I+VX>0xFFF), and 0 when there isn't.
-            mReg[0xF] = mI + mReg[(mOp & 0x0F00) >> 8] > 0xFFF ? 1 : 0;
-            mI += mReg[(mOp & 0x0F00) >> 8];
-            mPc += 2;
-         }
-      },
+      case 0x1E:
+         // VF is set to 1 when range overflow (I+VX>0xFFF), and 0 when there isn't.
+         mReg[0xF] = mI + mReg[x] > 0xFFF ? 1 : 0;
+         mI += mReg[x];
+         mPc += 2;
+         break;
       // Set I to the location of the sprite for the character in VX.
       // Characters 0-F (in hexadecimal) are represented by a 4x5 font.
-      {
-         0xF029, [this]() {
-            mI = mReg[(mOp & 0x0F00) >> 8] * 0x5;
-            mPc += 2;
-         }
-      },
+      case 0x29:
+         mI = mReg[x] * 0x5;
+         mPc += 2;
+         break;
+      // Set I to the location of the 8x10 sprite for the character in VX.
+      case 0x30:
+         mI = FONTSET_HIRES_ADDRESS + (mReg[x] & 0xF) * 10;
+         mPc += 2;
+         break;
       // Store the binary-coded decimal representation of VX in memory at I.
-      {
-         0xF033, [this]() {
-            mMem[mI] = mReg[(mOp & 0x0F00) >> 8] / 100;
-            mMem[mI + 1] = (mReg[(mOp & 0x0F00) >> 8] / 10) % 10;
-            mMem[mI + 2] = (mReg[(mOp & 0x0F00) >> 8] % 100) % 10;
-            mPc += 2;
-         }
-      },
+      case 0x33:
+         Hooks::write(debugger, mI, 3, Q::ADDRESS_MASK);
+         mMem[mI & Q::ADDRESS_MASK] = mReg[x] / 100;
+         mMem[(mI + 1) & Q::ADDRESS_MASK] = (mReg[x] / 10) % 10;
+         mMem[(mI + 2) & Q::ADDRESS_MASK] = mReg[x] % 10;
+         mPc += 2;
+         break;
+      // Set the audio pitch to VX (XO-CHIP), there is no audio output yet
+      case 0x3A:
+         invalid = !Q::XO_EXTENSIONS;
+         mPc += 2;
+         break;
       // Store V0 to VX in memory starting at I
-      {
-         0xF055, [this]() {
-            // TODO: Fix copy here.
-            std::copy(mReg.begin(), mReg.begin() + ((mOp & 0x0F00) >> 8) + 1, mMem.begin() + mI);
-            mPc += 2;
+      case 0x55:
+         Hooks::write(debugger, mI, x + 1, Q::ADDRESS_MASK);
+         for(std::uint8_t i = 0; i <= x; i++) {
+            mMem[(mI + i) & Q::ADDRESS_MASK] = mReg[i];
          }
-      },
+         mI += Q::INCREMENT_I ? x + 1 : 0;
+         mPc += 2;
+         break;
       // Fill V0 to VX with values from memory starting at I
-      {
-         0xF065, [this]() {
-            std::copy(mMem.begin() + mI, mMem.begin() + mI + ((mOp & 0x0F00) >> 8) + 1, mReg.begin());
-            mPc += 2;
+      case 0x65:
+         Hooks::read(debugger, mI, x + 1, Q::ADDRESS_MASK);
+         for(std::uint8_t i = 0; i <= x; i++) {
+            mReg[i] = mMem[(mI + i) & Q::ADDRESS_MASK];
          }
+         mI += Q::INCREMENT_I ? x + 1 : 0;
+         mPc += 2;
+         break;
+      // Store V0 to VX in the user flags
+      case 0x75:
+         std::copy(mReg.begin(), mReg.begin() + x + 1, mRpl.begin());
+         mPc += 2;
+         break;
+      // Fill V0 to VX from the user flags
+      case 0x85:
+         std::copy(mRpl.begin(), mRpl.begin() + x + 1, mReg.begin());
+         mPc += 2;
+         break;
+      default:
+         invalid = true;
+         mPc += 2;
+         break;
       }
-   };
+      break;
+   }
 
-   // Initialize the timers.
-   mDelayTimer = 0;
-   mSoundTimer = 0;
+   if(invalid) {
+      std::cerr << "Error: Invalid opcode 0x" << std::hex << mOp << std::dec << std::endl;
+   }
+
+   if(mTrace != nullptr) {
+      const std::uint8_t reg = Trace::changedRegister(mOp);
+      mTrace->record(pc, mOp, mI, reg, reg < mReg.size() ? mReg[reg] : 0);
+
+      // Preserve the history leading to the first invalid opcode.
+      if(invalid && !mTraceDumped && mTrace->dump()) {
+         std::cerr << "Trace written to " << mTrace->filename() << std::endl;
+         mTraceDumped = true;
+      }
+   }
 }
 
-chip8emu::CPU::~CPU()
+template <typename Q>
+std::uint16_t chip8emu::CPU::skip() const
 {
-   
+   // XO-CHIP skips the four byte F000 NNNN as a whole.
+   if(Q::XO_EXTENSIONS && mMem[(mPc + 2) & Q::ADDRESS_MASK] == 0xF0 && mMem[(mPc + 3) & Q::ADDRESS_MASK] == 0x00) {
+      return 6;
+   }
+
+   return 4;
 }
 
-void chip8emu::CPU::cycle()
+std::uint32_t chip8emu::CPU::run(std::uint32_t cycles)
 {
-   // Fetch the opcode, ...
-   mOp = (mMem[mPc] << 8) | mMem[mPc +1];
-
-   // ... decode ...
-   std::map<std::uint16_t, std::function<void()>>::iterator it = mOpcodes.end();
-   if(mOpcodes.count(mOp & 0xF0FF)) {
-      it = mOpcodes.find(mOp & 0xF0FF);
-   } else if(mOpcodes.count(mOp & 0xF00F)) {
-      it = mOpcodes.find(mOp & 0xF00F);
-   } else if(mOpcodes.count(mOp & 0xF000)) {
-      it = mOpcodes.find(mOp & 0xF000);
-   } else {
-      std::cerr << "Error: Invalid opcode 0x" << std::hex << mOp << std::endl;
-      mPc += 2;
+   mEvents = EVENT_NONE;
+
+   // Pick the interpreter once per call, specialized for the quirk profile
+   // and without hooks unless debugging.
+   switch(mQuirks) {
+   case QUIRKS_COSMAC:
+      runQuirks<CosmacQuirks>(cycles);
+      break;
+   case QUIRKS_SCHIP:
+      runQuirks<SchipQuirks>(cycles);
+      break;
+   case QUIRKS_XOCHIP:
+      runQuirks<XochipQuirks>(cycles);
+      break;
+   default:
+      runQuirks<DefaultQuirks>(cycles);
+      break;
    }
 
-   // ... and execute the opcode.
-   if(it != mOpcodes.end()) {
-      (it->second)();
+   return mEvents;
+}
+
+std::uint32_t chip8emu::CPU::runFrames(std::uint32_t frames)
+{
+   std::uint32_t events = EVENT_NONE;
+
+   // Run up to the next frame boundary, once per requested frame.
+   while(frames-- > 0 && (events & EVENT_BREAK) == 0) {
+      events |= run(mCyclesPerFrame - mFrameCycles);
+   }
+
+   return events;
+}
+
+void chip8emu::CPU::seed(std::uint32_t seed)
+{
+   mRng.seed(seed);
+   mSeed = seed;
+   mSeeded = true;
+   mRngOrigin = mRng;
+   mRandomDraws = 0;
+   mRngMark = mRng;
+   mRngMarkDraws = 0;
+   mRndDist = std::uniform_int_distribution<std::uint16_t> {0, std::numeric_limits<std::uint8_t>::max()};
+}
+
+void chip8emu::CPU::setKeys(std::uint16_t keys)
+{
+   mKeys = keys;
+}
+
+void chip8emu::CPU::setTrace(std::shared_ptr<Trace> trace)
+{
+   mTrace = trace;
+   mTraceDumped = false;
+}
+
+void chip8emu::CPU::setDebugger(std::shared_ptr<Debugger> debugger)
+{
+   mDebugger = debugger;
+}
+
+void chip8emu::CPU::setQuirks(Quirks quirks)
+{
+   mQuirks = quirks;
+}
+
+void chip8emu::CPU::setQuirkDatabase(std::shared_ptr<QuirkDatabase> database)
+{
+   mQuirkDb = database;
+}
+
+void chip8emu::CPU::setCyclesPerFrame(std::uint32_t cycles)
+{
+   mCyclesPerFrame = std::max<std::uint32_t>(cycles, 1);
+   mFrameCycles = 0;
+}
+
+chip8emu::Quirks chip8emu::CPU::quirks() const
+{
+   return mQuirks;
+}
+
+std::uint32_t chip8emu::CPU::cyclesPerFrame() const
+{
+   return mCyclesPerFrame;
+}
+
+std::uint64_t chip8emu::CPU::romHash() const
+{
+   return mRomHash;
+}
+
+std::uint64_t chip8emu::CPU::instructions() const
+{
+   return mInstructions;
+}
+
+std::uint16_t chip8emu::CPU::pc() const
+{
+   return mPc;
+}
+
+std::uint16_t chip8emu::CPU::index() const
+{
+   return mI;
+}
+
+std::uint8_t chip8emu::CPU::reg(std::uint8_t reg) const
+{
+   return mReg[reg & 0xF];
+}
+
+std::uint8_t chip8emu::CPU::peek(std::uint16_t addr) const
+{
+   return mMem[addr];
+}
+
+std::uint8_t chip8emu::CPU::delayTimer() const
+{
+   return mDelayTimer;
+}
+
+std::uint8_t chip8emu::CPU::soundTimer() const
+{
+   return mSoundTimer;
+}
+
+std::size_t chip8emu::CPU::stackDepth() const
+{
+   return mStackDepth;
+}
+
+void chip8emu::CPU::push(std::uint16_t addr)
+{
+   // A full stack drops its oldest return address.
+   if(mStackDepth == STACK_SIZE) {
+      std::copy(mStk.begin() + 1, mStk.end(), mStk.begin());
+      mStackDepth--;
    }
 
-   // Update the timers.
+   mStk[mStackDepth++] = addr;
+}
+
+bool chip8emu::CPU::isPadKeyDown(std::uint8_t key) const
+{
+   return key < 16 && (mKeys & (1 << key)) != 0;
+}
+
+void chip8emu::CPU::tickFrame()
+{
    if (mDelayTimer > 0) {
       mDelayTimer--;
    }
 
    if (mSoundTimer > 0) {
-      if (mSoundTimer == 1) {
-         // TODO: Play sound with SDL lib.
-         printf("BEEP!\n");
+      if (--mSoundTimer == 0) {
+         mEvents |= EVENT_SOUND_OFF;
       }
+   }
 
-      mSoundTimer--;
+   if (mFrameDirty) {
+      mEvents |= EVENT_FRAME_READY;
+      mFrameDirty = false;
    }
 }
 
@@ -351,9 +758,28 @@ void chip8emu::CPU::loadRom(const std::string &filename)
 
    if(rom.is_open()) {
       rom.unsetf(std::ios::skipws);
-      std::ifstream::pos_type size = rom.tellg();
+      const std::size_t size = std::min<std::size_t>(rom.tellg(), mMem.size() - 0x200);
       rom.seekg(0, std::ios::beg);
-      rom.read((char *)&mMem[mI+0x200], static_cast<std::size_t>(size));
+      rom.read((char *)&mMem[0x200], size);
+      rom.close();
+
+      // Identify the rom to pick the quirk profile it was written for, ...
+      mRomHash = hashRom(&mMem[0x200], size);
+      if(mQuirkDb != nullptr) {
+         mQuirks = mQuirkDb->lookup(mRomHash);
+      }
+
+      // ... and the display it starts with.
+      mGfx->setMode(mQuirks == QUIRKS_XOCHIP ? DISPLAY_XO_LORES : DISPLAY_LORES);
+   }
+}
+
+void chip8emu::CPU::loadState(const std::string &filename)
+{
+   std::ifstream rom(filename, std::ios::in | std::ios::binary);
+
+   if(rom.is_open()) {
+      loadState(rom);
       rom.close();
    }
 }
@@ -363,60 +789,275 @@ void chip8emu::CPU::saveState(const std::string &filename) const
    std::ofstream rom(filename, std::ios::out | std::ios::binary);
 
    if(rom.is_open()) {
-      rom.write((char*)&mI, sizeof(mI));
-      rom.write((char*)&mPc, sizeof(mPc));
-      rom.write((char*)&mOp, sizeof(mOp));
-      rom.write((char*)&mDelayTimer, sizeof(mDelayTimer));
-      rom.write((char*)&mSoundTimer, sizeof(mSoundTimer));
-      std::copy(mReg.begin(), mReg.end(), std::ostream_iterator<std::uint8_t>(rom, ""));
-      std::copy(mMem.begin(), mMem.end(), std::ostream_iterator<std::uint8_t>(rom, ""));
-      
-      std::uint16_t numPixels = mGfx->width() * mGfx->height();
-      for(std::uint16_t i = 0; i < numPixels; i++) {
-         rom.put((*mGfx)[i]);
-      }
-      
-      // Must be written last as it is the only structure with undefined size.
-      std::copy(mStk.begin(), mStk.end(), std::ostream_iterator<std::uint16_t>(rom, ""));
-      
+      saveState(rom);
       rom.close();
    }
 }
 
-void chip8emu::CPU::loadState(const std::string &filename)
+bool chip8emu::CPU::loadState(std::istream &in)
 {
-   std::ifstream rom(filename, std::ios::in | std::ios::binary);
+   in.unsetf(std::ios::skipws);
+   in.read(reinterpret_cast<char*>(&mI), sizeof(mI));
+   in.read(reinterpret_cast<char*>(&mPc), sizeof(mPc));
+   in.read(reinterpret_cast<char*>(&mOp), sizeof(mOp));
+   in.read(reinterpret_cast<char*>(&mDelayTimer), sizeof(mDelayTimer));
+   in.read(reinterpret_cast<char*>(&mSoundTimer), sizeof(mSoundTimer));
+   in.read(reinterpret_cast<char*>(mReg.data()), mReg.size());
+   in.read(reinterpret_cast<char*>(mMem.data()), LOW_MEMORY);
 
-   if(rom.is_open()) {
-      rom.unsetf(std::ios::skipws);
-      rom.read(reinterpret_cast<char*>(&mI), sizeof(mI));
-      rom.read(reinterpret_cast<char*>(&mPc), sizeof(mPc));
-      rom.read(reinterpret_cast<char*>(&mOp), sizeof(mOp));
-      rom.read(reinterpret_cast<char*>(&mDelayTimer), sizeof(mDelayTimer));
-      rom.read(reinterpret_cast<char*>(&mSoundTimer), sizeof(mSoundTimer));
-      std::copy_n(std::istream_iterator<std::uint8_t>(rom), mReg.size(), mReg.begin());
-      std::copy_n(std::istream_iterator<std::uint8_t>(rom), mMem.size(), mMem.begin());
-      
-      // Fetch the number of pixels ...
-      std::uint16_t numPixels = mGfx->width() * mGfx->height();
-      
-      // ... and write pixel by pixel back to the pixel buffer.
-      for(std::uint16_t i = 0; i < numPixels; i++) {
-         rom.read(reinterpret_cast<char*>(&((*mGfx)[i])), sizeof(std::uint8_t));
+   // The 64x32 display, one byte per pixel, is all earlier versions had.
+   char pixels[PPU::LORES_WIDTH * PPU::LORES_HEIGHT];
+   in.read(pixels, sizeof(pixels));
+
+   const auto loadPixels = [this, &pixels]() {
+      mGfx->setMode(mGfx->planes() > 1 ? DISPLAY_XO_LORES : DISPLAY_LORES);
+
+      for(std::uint8_t y = 0; y < PPU::LORES_HEIGHT; y++) {
+         for(std::uint8_t x = 0; x < PPU::LORES_WIDTH; x++) {
+            mGfx->setPixel(x, y, pixels[y * PPU::LORES_WIDTH + x] == 1);
+         }
       }
-      
-      // Must be read last as it is the only structure with undefined size.
-      std::copy(std::istream_iterator<std::uint16_t>(rom), 
-            std::istream_iterator<std::uint16_t>(), std::back_inserter(mStk));
-      
-      rom.close();
+   };
+
+   if(!in) {
+      return false;
+   }
+
+   // States of earlier versions end here, with an empty stack.
+   mStackDepth = 0;
+   const int depth = in.get();
+   if(depth == std::char_traits<char>::eof()) {
+      loadPixels();
+      return true;
+   }
+
+   in.read(reinterpret_cast<char*>(mStk.data()), depth * sizeof(std::uint16_t));
+   mStackDepth = depth;
+
+   if(in.peek() == STATE_SEEDED) {
+      // The random generator is its seed and the values drawn since, ...
+      in.get();
+      std::uint32_t seed = 0;
+      std::uint64_t draws = 0;
+      in.read(reinterpret_cast<char*>(&seed), sizeof(seed));
+      in.read(reinterpret_cast<char*>(&draws), sizeof(draws));
+      if(!in || draws > MAX_STATE_DRAWS) {
+         return false;
+      }
+
+      if(!mSeeded || mSeed != seed) {
+         this->seed(seed);
+      }
+
+      restoreDraws(draws);
+   } else {
+      // ... or text as defined by the standard, whose draws are counted
+      // from here on.
+      in.setf(std::ios::skipws);
+      in >> mRng;
+
+      mSeeded = false;
+      mRngOrigin = mRng;
+      mRngMark = mRng;
+      mRandomDraws = 0;
+      mRngMarkDraws = 0;
+
+      if(!in) {
+         return false;
+      }
+   }
+
+   // States of earlier versions end here as well, ...
+   in.unsetf(std::ios::skipws);
+   if(in.eof() || in.peek() != STATE_EXTENSION) {
+      loadPixels();
+      return true;
+   }
+
+   // ... later ones hold the display mode with all planes, the user flags
+   // and the memory above 4K.
+   in.get();
+   const int mode = in.get();
+   const int planes = in.get();
+   if(!in || mode < DISPLAY_LORES || mode > DISPLAY_XO_HIRES) {
+      return false;
+   }
+
+   std::uint64_t gfx[PPU::MAX_WORDS] = {};
+   mGfx->setMode(static_cast<DisplayMode>(mode));
+   in.read(reinterpret_cast<char*>(gfx), mGfx->size() * sizeof(std::uint64_t));
+   if(!in) {
+      return false;
+   }
+
+   mGfx->selectPlanes(planes);
+   mGfx->setData(gfx);
+
+   in.read(reinterpret_cast<char*>(mRpl.data()), mRpl.size());
+
+   std::uint16_t high = 0;
+   in.read(reinterpret_cast<char*>(&high), sizeof(high));
+   high = std::min<std::size_t>(high, MEMORY_SIZE - LOW_MEMORY);
+   in.read(reinterpret_cast<char*>(&mMem[LOW_MEMORY]), high);
+   std::fill(mMem.begin() + LOW_MEMORY + high, mMem.end(), 0);
+
+   return static_cast<bool>(in);
+}
+
+void chip8emu::CPU::saveState(std::ostream &out) const
+{
+   out.write((char*)&mI, sizeof(mI));
+   out.write((char*)&mPc, sizeof(mPc));
+   out.write((char*)&mOp, sizeof(mOp));
+   out.write((char*)&mDelayTimer, sizeof(mDelayTimer));
+   out.write((char*)&mSoundTimer, sizeof(mSoundTimer));
+   out.write((const char*)mReg.data(), mReg.size());
+   out.write((const char*)mMem.data(), LOW_MEMORY);
+
+   for(std::uint8_t y = 0; y < PPU::LORES_HEIGHT; y++) {
+      for(std::uint8_t x = 0; x < PPU::LORES_WIDTH; x++) {
+         out.put(mGfx->pixel(x, y) ? 1 : 0);
+      }
+   }
+
+   // Keep the innermost 255 return addresses of runaway recursions.
+   const std::size_t depth = std::min<std::size_t>(mStackDepth, 0xFF);
+   out.put(static_cast<char>(depth));
+   out.write((const char*)(mStk.data() + mStackDepth - depth), depth * sizeof(std::uint16_t));
+
+   // A seed and a draw count are a few bytes, the generator as text is
+   // about 7 KB and differs completely after every draw.
+   if(mSeeded && mRandomDraws <= MAX_STATE_DRAWS) {
+      out.put(STATE_SEEDED);
+      out.write((const char*)&mSeed, sizeof(mSeed));
+      out.write((const char*)&mRandomDraws, sizeof(mRandomDraws));
+   } else {
+      out << mRng;
    }
+
+   // The memory above 4K is only stored up to its last used byte.
+   std::size_t end = MEMORY_SIZE;
+   while(end > LOW_MEMORY && mMem[end - 1] == 0) {
+      end--;
+   }
+
+   const std::uint16_t high = end - LOW_MEMORY;
+
+   out.put(STATE_EXTENSION);
+   out.put(static_cast<char>(mGfx->mode()));
+   out.put(static_cast<char>(mGfx->selectedPlanes()));
+   out.write((const char*)mGfx->data(), mGfx->size() * sizeof(std::uint64_t));
+   out.write((const char*)mRpl.data(), mRpl.size());
+   out.write((const char*)&high, sizeof(high));
+   out.write((const char*)&mMem[LOW_MEMORY], high);
+}
+
+void chip8emu::CPU::saveMachine(MachineState &state) const
+{
+   std::memset(&state, 0, sizeof(state));
+
+   state.randomDraws = mRandomDraws;
+   std::copy(mGfx->data(), mGfx->data() + mGfx->size(), state.gfx);
+   state.displayMode = mGfx->mode();
+   state.planes = mGfx->selectedPlanes();
+
+   state.frameCycles = mFrameCycles;
+   state.frameDirty = mFrameDirty;
+   state.i = mI;
+   state.pc = mPc;
+
+   state.stackDepth = mStackDepth;
+   std::copy(mStk.begin(), mStk.begin() + mStackDepth, state.stack);
+
+   std::copy(mMem.begin(), mMem.begin() + sizeof(state.mem), state.mem);
+   std::copy(mReg.begin(), mReg.end(), state.reg);
+   std::copy(mRpl.begin(), mRpl.end(), state.rpl);
+   state.delayTimer = mDelayTimer;
+   state.soundTimer = mSoundTimer;
+}
+
+void chip8emu::CPU::loadMachine(const MachineState &state)
+{
+   restoreDraws(state.randomDraws);
+
+   if(mGfx->mode() != state.displayMode) {
+      mGfx->setMode(static_cast<DisplayMode>(state.displayMode));
+   }
+
+   mGfx->selectPlanes(state.planes);
+   mGfx->setData(state.gfx);
+
+   mFrameCycles = state.frameCycles;
+   mFrameDirty = state.frameDirty != 0;
+   mI = state.i;
+   mPc = state.pc;
+   std::copy(state.stack, state.stack + state.stackDepth, mStk.begin());
+   mStackDepth = state.stackDepth;
+
+   std::copy(std::begin(state.mem), std::end(state.mem), mMem.begin());
+   std::copy(std::begin(state.reg), std::end(state.reg), mReg.begin());
+   std::copy(std::begin(state.rpl), std::end(state.rpl), mRpl.begin());
+   mDelayTimer = state.delayTimer;
+   mSoundTimer = state.soundTimer;
+}
+
+void chip8emu::CPU::restoreDraws(std::uint64_t draws)
+{
+   // The generator only depends on its origin and the number of draws, so
+   // it is rewound to the origin or advanced by drawing. Forks of one state
+   // rewind to the mark instead of the origin.
+   if(draws < mRandomDraws) {
+      if(draws >= mRngMarkDraws) {
+         mRng = mRngMark;
+         mRandomDraws = mRngMarkDraws;
+      } else {
+         mRng = mRngOrigin;
+         mRandomDraws = 0;
+      }
+   }
+
+   for(; mRandomDraws < draws; mRandomDraws++) {
+      mRndDist(mRng);
+   }
+
+   mRngMark = mRng;
+   mRngMarkDraws = mRandomDraws;
+}
+
+void chip8emu::CPU::copyState(const CPU &other)
+{
+   mKeys = other.mKeys;
+   mQuirks = other.mQuirks;
+   mRomHash = other.mRomHash;
+   mCyclesPerFrame = other.mCyclesPerFrame;
+   mFrameCycles = other.mFrameCycles;
+   mFrameDirty = other.mFrameDirty;
+
+   mOp = other.mOp;
+   mMem = other.mMem;
+   mReg = other.mReg;
+   mRpl = other.mRpl;
+   mI = other.mI;
+   mPc = other.mPc;
+   mDelayTimer = other.mDelayTimer;
+   mSoundTimer = other.mSoundTimer;
+   std::copy(other.mStk.begin(), other.mStk.begin() + other.mStackDepth, mStk.begin());
+   mStackDepth = other.mStackDepth;
+   mRng = other.mRng;
+   mRngOrigin = other.mRngOrigin;
+   mRandomDraws = other.mRandomDraws;
+   mRngMark = other.mRngMark;
+   mRngMarkDraws = other.mRngMarkDraws;
+   mSeed = other.mSeed;
+   mSeeded = other.mSeeded;
+
+   mGfx->copyFrom(*other.mGfx);
 }
 
 void chip8emu::CPU::debugRegisters()
 {
    std::uint16_t counter = 0;
-   for(std::vector<std::uint8_t>::iterator it = mReg.begin(); it != mReg.end(); ++it) {
+   for(auto it = mReg.begin(); it != mReg.end(); ++it) {
       std::cout << "0x" << std::hex << static_cast<int>(*it) << " ";
 
       if(counter % 4 == 4 - 1) {
@@ -430,7 +1071,7 @@ void chip8emu::CPU::debugRegisters()
 void chip8emu::CPU::debugMemory()
 {
    std::uint16_t counter = 0;
-   for(std::vector<std::uint8_t>::iterator it = mMem.begin(); it != mMem.end(); ++it) {
+   for(auto it = mMem.begin(); it != mMem.end(); ++it) {
       std::cout << "0x" << std::hex << static_cast<int>(*it) << " ";
 
       if(counter % 5 == 5 - 1) {
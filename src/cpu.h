@@ -1,12 +1,14 @@
 #ifndef CPU_H
 #define CPU_H
 
+#include "debugger.h"
 #include "ppu.h"
-#include "keyboard.h"
+#include "quirks.h"
+#include "trace.h"
 
-#include <map>
-#include <stack>
-#include <vector>
+#include <array>
+#include <istream>
+#include <ostream>
 #include <memory>
 #include <random>
 #include <limits>
@@ -15,28 +17,149 @@
 namespace chip8emu
 {
 
+// Built-in 4x5 hex font, loaded at address 0x000 of every machine, ...
+extern const std::uint8_t FONTSET[80];
+
+// ... and the 8x10 hex font of SUPER-CHIP and XO-CHIP, loaded behind it.
+extern const std::uint8_t FONTSET_HIRES[160];
+const std::uint16_t FONTSET_HIRES_ADDRESS = 0x50;
+
+// Size of the address space. Roms of the original profiles only reach the
+// first 4K, XO-CHIP roms all of it.
+const std::size_t MEMORY_SIZE = 0x10000;
+
+// Return addresses kept for nested calls, the oldest being dropped beyond.
+const std::size_t STACK_SIZE = 256;
+
+// Events reported by CPU::run() and CPU::runFrames() as a bitmask.
+enum Event : std::uint32_t
+{
+   EVENT_NONE = 0,
+   EVENT_FRAME_READY = 1 << 0, // A frame ended with a modified display
+   EVENT_SOUND_ON = 1 << 1, // The sound timer started
+   EVENT_SOUND_OFF = 1 << 2, // The sound timer expired
+   EVENT_WAITING_FOR_KEY = 1 << 3, // FX0A is blocking on a key press
+   EVENT_BREAK = 1 << 4, // The debugger stopped execution
+   EVENT_KEY_QUERY = 1 << 5 // The pad state was read (EX9E, EXA1, FX0A)
+};
+
+// Plain copy of everything that determines the future of a machine, used to
+// fork, compare and restore machines without any allocation. The random
+// generator is represented by the number of values drawn since seeding.
+// Only the first 4K of memory are copied, keeping states small, so XO-CHIP
+// machines are not covered and Search rejects the XO-CHIP profile.
+struct MachineState
+{
+   std::uint64_t randomDraws;
+   std::uint64_t gfx[PPU::MAX_WORDS]; // PPU::data(), zero beyond PPU::size()
+   std::uint32_t frameCycles;
+   std::uint16_t i;
+   std::uint16_t pc;
+   std::uint16_t stackDepth;
+   std::uint16_t stack[STACK_SIZE];
+   std::uint8_t mem[4096];
+   std::uint8_t reg[16];
+   std::uint8_t rpl[16];
+   std::uint8_t delayTimer;
+   std::uint8_t soundTimer;
+   std::uint8_t frameDirty;
+   std::uint8_t displayMode;
+   std::uint8_t planes;
+};
+
 class CPU
 {
 public:
-   CPU(std::shared_ptr<PPU> ppu, std::shared_ptr<Keyboard> keyboard);
+   // The whole machine lives inside the CPU object, constructing it does
+   // not allocate. Without a seed, the random generator is seeded from
+   // std::random_device.
+   CPU(std::shared_ptr<PPU> ppu);
+   CPU(std::shared_ptr<PPU> ppu, std::uint32_t seed);
+   // Starts as a copy of the prototype like copyState(), without clearing
+   // and seeding first.
+   CPU(std::shared_ptr<PPU> ppu, const CPU &prototype);
    ~CPU();
    
    void cycle();
 
+   std::uint32_t run(std::uint32_t cycles);
+   std::uint32_t runFrames(std::uint32_t frames);
+
+   void seed(std::uint32_t seed);
+   void setKeys(std::uint16_t keys);
+   void setCyclesPerFrame(std::uint32_t cycles);
+   void setTrace(std::shared_ptr<Trace> trace);
+   void setDebugger(std::shared_ptr<Debugger> debugger);
+   void setQuirks(Quirks quirks);
+   void setQuirkDatabase(std::shared_ptr<QuirkDatabase> database);
+
    void loadRom(const std::string &filename);
    void loadState(const std::string &filename);
    void saveState(const std::string &filename) const;
 
+   // States hold registers, memory, display, stack and random generator,
+   // the generator as its seed and draw count unless loaded as text.
+   // States of earlier versions, without hires display, planes or memory
+   // above 4K or with the generator as text, are still loaded.
+   bool loadState(std::istream &in);
+   void saveState(std::ostream &out) const;
+
+   // Machine states are zero filled, padding included, so they may be
+   // hashed and compared bytewise.
+   void saveMachine(MachineState &state) const;
+   void loadMachine(const MachineState &state);
+
+   // Copies the machine state and display of another CPU without any
+   // parsing or allocation, e.g. to reset from a cached initial state.
+   void copyState(const CPU &other);
+
+   Quirks quirks() const;
+   std::uint32_t cyclesPerFrame() const;
+   std::uint64_t romHash() const;
+   std::uint64_t instructions() const; // Instructions executed since construction
+
+   std::uint16_t pc() const;
+   std::uint16_t index() const;
+   std::uint8_t reg(std::uint8_t reg) const;
+   std::uint8_t peek(std::uint16_t addr) const;
+   std::uint8_t delayTimer() const;
+   std::uint8_t soundTimer() const;
+   std::size_t stackDepth() const;
+
    void debugRegisters();
    void debugMemory();
    
 private:
-   std::shared_ptr<PPU> mGfx; // Display of 64x32 px
-   std::shared_ptr<Keyboard> mKeyboard; // Current keypad state
+   template <typename Q> void runQuirks(std::uint32_t cycles);
+   template <typename Hooks, typename Q> void runCycles(std::uint32_t cycles);
+   template <typename Hooks, typename Q> void execute();
+   template <typename Q> std::uint16_t skip() const;
+
+   bool isPadKeyDown(std::uint8_t key) const;
+   void push(std::uint16_t addr);
+   void tickFrame();
+   // Puts the generator 'draws' values after its origin.
+   void restoreDraws(std::uint64_t draws);
+
+   std::shared_ptr<PPU> mGfx; // Display, its mode picked by loadRom()
+   std::uint16_t mKeys; // Current keypad state, one bit per key
+   std::shared_ptr<Trace> mTrace; // Execution trace, if enabled
+   bool mTraceDumped; // Trace already written for an invalid opcode
+   std::shared_ptr<Debugger> mDebugger; // Attached debugger, if any
+   std::shared_ptr<QuirkDatabase> mQuirkDb; // Profiles looked up by loadRom()
+   Quirks mQuirks; // Quirk profile of the loaded rom
+   std::uint64_t mRomHash; // Hash of the loaded rom image
+   std::uint64_t mInstructions; // Instructions executed so far
+   
+   std::uint32_t mEvents; // Events raised since the last run
+   std::uint32_t mCyclesPerFrame; // Instructions executed per 60Hz frame
+   std::uint32_t mFrameCycles; // Instructions executed in the current frame
+   bool mFrameDirty; // Display modified during the current frame
    
    std::uint16_t mOp; // the current opcode
-   std::vector<std::uint8_t> mMem; // 4k of memory
-   std::vector<std::uint8_t> mReg; // 15 8-bit registers + carry flag
+   std::array<std::uint8_t, MEMORY_SIZE> mMem; // 64k of memory
+   std::array<std::uint8_t, 16> mReg; // 15 8-bit registers + carry flag
+   std::array<std::uint8_t, 16> mRpl; // SUPER-CHIP user flags of FX75/FX85
 
    std::uint16_t mI; // Index register
    std::uint16_t mPc; // Instruction pointer
@@ -44,30 +167,17 @@ private:
    std::uint8_t mDelayTimer; // Delay timer at 60Hz
    std::uint8_t mSoundTimer; // Sound timer at 60Hz
 
-   std::vector<std::uint16_t> mStk; // Jump stack
+   std::array<std::uint16_t, STACK_SIZE> mStk; // Jump stack, ...
+   std::size_t mStackDepth; // ... holding this many return addresses
 
-   std::function<std::uint16_t()> rnd;
-
-   std::map<std::uint16_t, std::function<void()>> mOpcodes;
-   
-   std::vector<std::uint8_t> mFontset {
-      0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
-      0x20, 0x60, 0x20, 0x20, 0x70, // 1
-      0xF0, 0x10, 0xF0, 0x80, 0xF0, // 2
-      0xF0, 0x10, 0xF0, 0x10, 0xF0, // 3
-      0x90, 0x90, 0xF0, 0x10, 0x10, // 4
-      0xF0, 0x80, 0xF0, 0x10, 0xF0, // 5
-      0xF0, 0x80, 0xF0, 0x90, 0xF0, // 6
-      0xF0, 0x10, 0x20, 0x40, 0x40, // 7
-      0xF0, 0x90, 0xF0, 0x90, 0xF0, // 8
-      0xF0, 0x90, 0xF0, 0x10, 0xF0, // 9
-      0xF0, 0x90, 0xF0, 0x90, 0x90, // A
-      0xE0, 0x90, 0xE0, 0x90, 0xE0, // B
-      0xF0, 0x80, 0x80, 0x80, 0xF0, // C
-      0xE0, 0x90, 0x90, 0x90, 0xE0, // D
-      0xF0, 0x80, 0xF0, 0x80, 0xF0, // E
-      0xF0, 0x80, 0xF0, 0x80, 0x80  // F
-   };
+   std::mt19937 mRng; // Random generator of CXNN
+   std::mt19937 mRngOrigin; // mRng before the first draw
+   std::uint64_t mRandomDraws; // Values drawn from mRng since seeding
+   std::mt19937 mRngMark; // mRng as of the last loadMachine(), ...
+   std::uint64_t mRngMarkDraws; // ... after this many draws
+   std::uint32_t mSeed; // Seed of mRngOrigin, ...
+   bool mSeeded; // ... unless it was loaded from a state as text
+   std::uniform_int_distribution<std::uint16_t> mRndDist; // Maps mRng to 0-255
 };
 
 }
@@ -0,0 +1,417 @@
+#include "debugger.h"
+
+#include "cpu.h"
+#include "disasm.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iomanip>
+#include <sstream>
+#include <thread>
+
+namespace
+{
+
+// Parses a number, addresses default to hexadecimal, values to decimal.
+bool parseNumber(const std::string &text, unsigned long max, int base, unsigned long &value)
+{
+   if(text.empty()) {
+      return false;
+   }
+
+   char *end = nullptr;
+   value = std::strtoul(text.c_str(), &end, base);
+   return *end == '\0' && value <= max;
+}
+
+bool parseRegister(const std::string &text, std::uint8_t &reg)
+{
+   unsigned long value = 0;
+   if(text.size() != 2 || (text[0] != 'V' && text[0] != 'v') || !parseNumber(text.substr(1), 0xF, 16, value)) {
+      return false;
+   }
+
+   reg = static_cast<std::uint8_t>(value);
+   return true;
+}
+
+bool compare(const std::string &cmp, std::uint8_t lhs, std::uint8_t rhs)
+{
+   if(cmp == "==") {
+      return lhs == rhs;
+   } else if(cmp == "!=") {
+      return lhs != rhs;
+   } else if(cmp == "<") {
+      return lhs < rhs;
+   } else if(cmp == "<=") {
+      return lhs <= rhs;
+   } else if(cmp == ">") {
+      return lhs > rhs;
+   } else if(cmp == ">=") {
+      return lhs >= rhs;
+   }
+
+   return true;
+}
+
+bool isComparison(const std::string &cmp)
+{
+   return cmp == "==" || cmp == "!=" || cmp == "<" || cmp == "<=" || cmp == ">" || cmp == ">=";
+}
+
+}
+
+chip8emu::Debugger::Debugger(std::ostream &out)
+   : mOut(out), mFlags(0x10000, 0), mPaused(false), mStop(STOP_NONE), mStepping(false), mResuming(false),
+     mWatchHit(false), mWatchAddr(0), mWatchFlag(0), mTemporary(0xFFFF)
+{
+
+}
+
+chip8emu::Debugger::~Debugger()
+{
+
+}
+
+void chip8emu::Debugger::addBreakpoint(std::uint16_t pc)
+{
+   addBreakpoint(pc, 0, "", 0);
+}
+
+void chip8emu::Debugger::addBreakpoint(std::uint16_t pc, std::uint8_t reg, const std::string &cmp, std::uint8_t value)
+{
+   mBreakpoints.push_back(Breakpoint { pc, reg, cmp, value });
+   rebuildFlags();
+}
+
+void chip8emu::Debugger::removeBreakpoint(std::uint16_t pc)
+{
+   mBreakpoints.erase(std::remove_if(mBreakpoints.begin(), mBreakpoints.end(),
+                                     [pc](const Breakpoint &bp) { return bp.pc == pc; }),
+                      mBreakpoints.end());
+   rebuildFlags();
+}
+
+void chip8emu::Debugger::addWatchpoint(std::uint16_t first, std::uint16_t last, std::uint8_t flags)
+{
+   mWatchpoints.push_back(Watchpoint { first, last,
+                                       static_cast<std::uint8_t>(flags & (FLAG_READ | FLAG_WRITE)) });
+   rebuildFlags();
+}
+
+void chip8emu::Debugger::removeWatchpoint(std::uint16_t first)
+{
+   mWatchpoints.erase(std::remove_if(mWatchpoints.begin(), mWatchpoints.end(),
+                                     [first](const Watchpoint &wp) { return wp.first == first; }),
+                      mWatchpoints.end());
+   rebuildFlags();
+}
+
+void chip8emu::Debugger::pause()
+{
+   mStop = STOP_PAUSE;
+   mPaused = true;
+}
+
+void chip8emu::Debugger::resume()
+{
+   // Leave the breakpoint at the current PC before checking breakpoints again.
+   mResuming = true;
+   mPaused = false;
+}
+
+void chip8emu::Debugger::step()
+{
+   mStepping = true;
+   resume();
+}
+
+void chip8emu::Debugger::stepOver(const CPU &cpu)
+{
+   const std::uint16_t pc = cpu.pc();
+   const std::uint16_t op = (cpu.peek(pc) << 8) | cpu.peek(pc + 1);
+
+   // Run subroutine calls up to the return address, step everything else.
+   if((op & 0xF000) != 0x2000) {
+      step();
+      return;
+   }
+
+   mTemporary = (pc + 2) & 0xFFFF;
+   mFlags[mTemporary] |= FLAG_TEMPORARY;
+   resume();
+}
+
+bool chip8emu::Debugger::paused() const
+{
+   return mPaused;
+}
+
+void chip8emu::Debugger::startConsole()
+{
+   // The thread blocks in getline until stdin is closed and is never joined.
+   std::thread([this]() {
+      std::string line;
+      while(std::getline(std::cin, line)) {
+         post(line);
+      }
+   }).detach();
+
+   mOut << "Debugger ready, type 'h' for help." << std::endl;
+}
+
+void chip8emu::Debugger::post(const std::string &command)
+{
+   std::lock_guard<std::mutex> lock(mQueueMutex);
+   mQueue.push_back(command);
+}
+
+void chip8emu::Debugger::poll(CPU &cpu)
+{
+   std::deque<std::string> commands;
+   {
+      std::lock_guard<std::mutex> lock(mQueueMutex);
+      commands.swap(mQueue);
+   }
+
+   for(const std::string &command : commands) {
+      execute(command, cpu);
+   }
+}
+
+void chip8emu::Debugger::execute(const std::string &command, CPU &cpu)
+{
+   std::istringstream in(command);
+   std::string name;
+   std::vector<std::string> args;
+   std::string arg;
+
+   in >> name;
+   while(in >> arg) {
+      args.push_back(arg);
+   }
+
+   unsigned long first = 0;
+   unsigned long last = 0;
+
+   if(name.empty()) {
+      return;
+   } else if(name == "b" && (args.size() == 1 || args.size() == 5) && parseNumber(args[0], 0xFFFF, 16, first)) {
+      if(args.size() == 1) {
+         addBreakpoint(first);
+      } else {
+         // b <addr> if V<x> <cmp> <value>
+         std::uint8_t reg = 0;
+         if(args[1] != "if" || !parseRegister(args[2], reg) || !isComparison(args[3]) || !parseNumber(args[4], 0xFF, 0, last)) {
+            mOut << "Usage: b <addr> [if V<x> <cmp> <value>]" << std::endl;
+            return;
+         }
+
+         addBreakpoint(first, reg, args[3], static_cast<std::uint8_t>(last));
+      }
+   } else if(name == "d" && args.size() == 1 && parseNumber(args[0], 0xFFFF, 16, first)) {
+      removeBreakpoint(first);
+   } else if(name == "w" && (args.size() == 1 || args.size() == 2)) {
+      // w <first>[-<last>] [r|w|rw]
+      const std::size_t dash = args[0].find('-');
+      if(!parseNumber(args[0].substr(0, dash), 0xFFFF, 16, first)) {
+         mOut << "Usage: w <first>[-<last>] [r|w|rw]" << std::endl;
+         return;
+      }
+
+      last = first;
+      if(dash != std::string::npos && (!parseNumber(args[0].substr(dash + 1), 0xFFFF, 16, last) || last < first)) {
+         mOut << "Usage: w <first>[-<last>] [r|w|rw]" << std::endl;
+         return;
+      }
+
+      const std::string mode = args.size() == 2 ? args[1] : "rw";
+      std::uint8_t flags = 0;
+      flags |= mode.find('r') != std::string::npos ? FLAG_READ : 0;
+      flags |= mode.find('w') != std::string::npos ? FLAG_WRITE : 0;
+      addWatchpoint(first, last, flags);
+   } else if(name == "dw" && args.size() == 1 && parseNumber(args[0], 0xFFFF, 16, first)) {
+      removeWatchpoint(first);
+   } else if(name == "c") {
+      resume();
+   } else if(name == "s") {
+      step();
+   } else if(name == "n") {
+      stepOver(cpu);
+   } else if(name == "p") {
+      pause();
+      printRegisters(cpu);
+   } else if(name == "r") {
+      printRegisters(cpu);
+   } else if(name == "m" && !args.empty() && parseNumber(args[0], 0xFFFF, 16, first)) {
+      last = 16;
+      if(args.size() > 1 && !parseNumber(args[1], 0x1000, 0, last)) {
+         mOut << "Usage: m <addr> [length]" << std::endl;
+         return;
+      }
+
+      printMemory(cpu, first, last);
+   } else if(name == "l") {
+      first = cpu.pc();
+      last = 8;
+      if((!args.empty() && !parseNumber(args[0], 0xFFFF, 16, first)) || (args.size() > 1 && !parseNumber(args[1], 0x800, 0, last))) {
+         mOut << "Usage: l [addr] [count]" << std::endl;
+         return;
+      }
+
+      printListing(cpu, first, last);
+   } else if(name == "i") {
+      printBreakpoints();
+   } else {
+      printHelp();
+   }
+}
+
+void chip8emu::Debugger::reportBreak(const CPU &cpu)
+{
+   switch(mStop) {
+   case STOP_BREAKPOINT:
+      mOut << "Breakpoint at 0x" << std::hex << cpu.pc() << std::dec << std::endl;
+      break;
+   case STOP_WATCHPOINT:
+      mOut << "Watchpoint: " << (mWatchFlag == FLAG_READ ? "read" : "write") << " of 0x"
+           << std::hex << mWatchAddr << std::dec << std::endl;
+      break;
+   default:
+      break;
+   }
+
+   printRegisters(cpu);
+   printListing(cpu, cpu.pc(), 1);
+}
+
+bool chip8emu::Debugger::checkBreakpoint(std::uint16_t pc, const std::uint8_t *reg)
+{
+   bool hit = (mFlags[pc] & FLAG_TEMPORARY) != 0;
+
+   for(const Breakpoint &bp : mBreakpoints) {
+      if(bp.pc == pc && (bp.cmp.empty() || compare(bp.cmp, reg[bp.reg], bp.value))) {
+         hit = true;
+      }
+   }
+
+   if(hit) {
+      stop(STOP_BREAKPOINT);
+   }
+
+   return hit;
+}
+
+void chip8emu::Debugger::stop(Stop reason)
+{
+   // A step-over breakpoint is dropped by any stop, not only its own.
+   if(mTemporary != 0xFFFF) {
+      mFlags[mTemporary] &= ~FLAG_TEMPORARY;
+      mTemporary = 0xFFFF;
+   }
+
+   mStop = reason;
+   mStepping = false;
+   mPaused = true;
+}
+
+void chip8emu::Debugger::rebuildFlags()
+{
+   for(std::uint8_t &flags : mFlags) {
+      flags &= FLAG_TEMPORARY;
+   }
+
+   for(const Breakpoint &bp : mBreakpoints) {
+      mFlags[bp.pc] |= FLAG_BREAK;
+   }
+
+   for(const Watchpoint &wp : mWatchpoints) {
+      // A wider counter, a 16 bit one would wrap before passing 0xFFFF.
+      for(std::uint32_t addr = wp.first; addr <= wp.last; addr++) {
+         mFlags[addr] |= wp.flags;
+      }
+   }
+}
+
+void chip8emu::Debugger::printRegisters(const CPU &cpu)
+{
+   mOut << std::hex << std::uppercase << std::setfill('0');
+   mOut << "PC=" << std::setw(3) << cpu.pc() << " I=" << std::setw(3) << cpu.index()
+        << " DT=" << std::setw(2) << static_cast<int>(cpu.delayTimer())
+        << " ST=" << std::setw(2) << static_cast<int>(cpu.soundTimer())
+        << " SP=" << cpu.stackDepth() << std::endl;
+
+   for(std::uint8_t i = 0; i < 16; i++) {
+      mOut << "V" << static_cast<int>(i) << "=" << std::setw(2) << static_cast<int>(cpu.reg(i)) << (i % 8 == 7 ? "\n" : " ");
+   }
+
+   mOut << std::dec << std::nouppercase << std::setfill(' ') << std::flush;
+}
+
+void chip8emu::Debugger::printMemory(const CPU &cpu, std::uint16_t addr, std::uint16_t length)
+{
+   mOut << std::hex << std::uppercase << std::setfill('0');
+
+   for(std::uint16_t i = 0; i < length; i++) {
+      if(i % 16 == 0) {
+         mOut << (i > 0 ? "\n" : "") << std::setw(3) << ((addr + i) & 0xFFFF) << ":";
+      }
+
+      mOut << " " << std::setw(2) << static_cast<int>(cpu.peek(addr + i));
+   }
+
+   mOut << std::dec << std::nouppercase << std::setfill(' ') << std::endl;
+}
+
+void chip8emu::Debugger::printListing(const CPU &cpu, std::uint16_t addr, std::uint16_t count)
+{
+   mOut << std::hex << std::uppercase << std::setfill('0');
+
+   for(std::uint16_t i = 0; i < count; i++) {
+      const std::uint16_t pc = (addr + 2 * i) & 0xFFFF;
+      const std::uint16_t op = (cpu.peek(pc) << 8) | cpu.peek(pc + 1);
+
+      mOut << (pc == cpu.pc() ? "> " : "  ") << std::setw(3) << pc << ": " << std::setw(4) << op
+           << (mFlags[pc] & FLAG_BREAK ? " * " : "   ") << disassemble(op) << std::endl;
+   }
+
+   mOut << std::dec << std::nouppercase << std::setfill(' ');
+}
+
+void chip8emu::Debugger::printBreakpoints()
+{
+   mOut << std::hex << std::uppercase;
+
+   for(const Breakpoint &bp : mBreakpoints) {
+      mOut << "Breakpoint 0x" << bp.pc;
+      if(!bp.cmp.empty()) {
+         mOut << " if V" << static_cast<int>(bp.reg) << " " << bp.cmp << " " << std::dec << static_cast<int>(bp.value) << std::hex;
+      }
+      mOut << std::endl;
+   }
+
+   for(const Watchpoint &wp : mWatchpoints) {
+      mOut << "Watchpoint 0x" << wp.first << "-0x" << wp.last
+           << (wp.flags & FLAG_READ ? " r" : " ") << (wp.flags & FLAG_WRITE ? "w" : "") << std::endl;
+   }
+
+   mOut << std::dec << std::nouppercase;
+}
+
+void chip8emu::Debugger::printHelp()
+{
+   mOut << "Commands:\n"
+        << "  b <addr> [if V<x> <cmp> <value>]  Set a breakpoint, cmp is one of == != < <= > >=\n"
+        << "  d <addr>                          Delete the breakpoints at addr\n"
+        << "  w <first>[-<last>] [r|w|rw]       Watch memory reads and/or writes\n"
+        << "  dw <first>                        Delete the watchpoints starting at first\n"
+        << "  c                                 Continue\n"
+        << "  s                                 Step one instruction\n"
+        << "  n                                 Step over subroutine calls\n"
+        << "  p                                 Pause\n"
+        << "  r                                 Print the registers\n"
+        << "  m <addr> [length]                 Print memory\n"
+        << "  l [addr] [count]                  Disassemble, starting at PC by default\n"
+        << "  i                                 List breakpoints and watchpoints\n"
+        << "Addresses are hexadecimal, values decimal unless prefixed with 0x." << std::endl;
+}
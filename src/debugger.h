@@ -0,0 +1,170 @@
+#ifndef DEBUGGER_H
+#define DEBUGGER_H
+
+#include <cstdint>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace chip8emu
+{
+
+class CPU;
+
+// Interactive debugger with PC breakpoints, register conditions, memory
+// watchpoints and single stepping.
+//
+// Breakpoints and watchpoints are kept as flags in a bitmap with one byte per
+// address, so the CPU only tests a flag per instruction and per memory access
+// and conditions are evaluated for flagged addresses only. The CPU runs its
+// hook-free interpreter as long as no debugger is attached.
+//
+// Commands are read from stdin by a console thread and queued, poll() then
+// executes them on the emulation thread between frames.
+class Debugger
+{
+public:
+   enum Flag : std::uint8_t
+   {
+      FLAG_BREAK = 1 << 0, // Breakpoint, possibly conditional
+      FLAG_TEMPORARY = 1 << 1, // One-shot breakpoint of step-over
+      FLAG_READ = 1 << 2, // Break on memory reads
+      FLAG_WRITE = 1 << 3 // Break on memory writes
+   };
+
+   Debugger(std::ostream &out = std::cout);
+   ~Debugger();
+
+   // Called by the CPU before executing the instruction at 'pc', returns
+   // true to stop in front of it.
+   inline bool breakBefore(std::uint16_t pc, const std::uint8_t *reg)
+   {
+      if(mResuming) {
+         mResuming = false;
+         return false;
+      }
+
+      return (mFlags[pc & 0xFFFF] & (FLAG_BREAK | FLAG_TEMPORARY)) != 0 && checkBreakpoint(pc, reg);
+   }
+
+   // Called by the CPU for every memory access of an instruction, 'mask'
+   // being where the address space wraps, e.g. 0xFFF for 4K machines.
+   inline void onRead(std::uint16_t addr, std::uint16_t length, std::uint16_t mask)
+   {
+      checkAccess(addr, length, mask, FLAG_READ);
+   }
+
+   inline void onWrite(std::uint16_t addr, std::uint16_t length, std::uint16_t mask)
+   {
+      checkAccess(addr, length, mask, FLAG_WRITE);
+   }
+
+   // Called by the CPU after executing an instruction, returns true to stop
+   // behind it.
+   inline bool breakAfter()
+   {
+      if(!mStepping && !mWatchHit) {
+         return false;
+      }
+
+      stop(mWatchHit ? STOP_WATCHPOINT : STOP_STEP);
+      mWatchHit = false;
+      return true;
+   }
+
+   void addBreakpoint(std::uint16_t pc);
+   void addBreakpoint(std::uint16_t pc, std::uint8_t reg, const std::string &cmp, std::uint8_t value);
+   void removeBreakpoint(std::uint16_t pc);
+   void addWatchpoint(std::uint16_t first, std::uint16_t last, std::uint8_t flags);
+   void removeWatchpoint(std::uint16_t first);
+
+   void pause();
+   void resume();
+   void step();
+   void stepOver(const CPU &cpu);
+   bool paused() const;
+
+   // Starts reading commands from stdin on a background thread.
+   void startConsole();
+
+   // Queues a command, may be called from any thread.
+   void post(const std::string &command);
+
+   // Executes the queued commands, to be called on the emulation thread.
+   void poll(CPU &cpu);
+
+   void execute(const std::string &command, CPU &cpu);
+
+   // Prints why the CPU stopped, after it returned EVENT_BREAK.
+   void reportBreak(const CPU &cpu);
+
+private:
+   enum Stop
+   {
+      STOP_NONE,
+      STOP_BREAKPOINT,
+      STOP_STEP,
+      STOP_WATCHPOINT,
+      STOP_PAUSE
+   };
+
+   struct Breakpoint
+   {
+      std::uint16_t pc; // Address of the breakpoint
+      std::uint8_t reg; // Compared register VX
+      std::string cmp; // One of ==, !=, <, <=, >, >=, empty if unconditional
+      std::uint8_t value; // Compared value
+   };
+
+   struct Watchpoint
+   {
+      std::uint16_t first; // First watched address
+      std::uint16_t last; // Last watched address
+      std::uint8_t flags; // FLAG_READ and/or FLAG_WRITE
+   };
+
+   inline void checkAccess(std::uint16_t addr, std::uint16_t length, std::uint16_t mask, std::uint8_t flag)
+   {
+      for(std::uint16_t i = 0; i < length; i++) {
+         if(mFlags[(addr + i) & mask] & flag) {
+            mWatchHit = true;
+            mWatchAddr = (addr + i) & mask;
+            mWatchFlag = flag;
+            return;
+         }
+      }
+   }
+
+   bool checkBreakpoint(std::uint16_t pc, const std::uint8_t *reg);
+   void stop(Stop reason);
+   void rebuildFlags();
+   void printRegisters(const CPU &cpu);
+   void printMemory(const CPU &cpu, std::uint16_t addr, std::uint16_t length);
+   void printListing(const CPU &cpu, std::uint16_t addr, std::uint16_t count);
+   void printBreakpoints();
+   void printHelp();
+
+   std::ostream &mOut;
+
+   std::vector<std::uint8_t> mFlags; // Flags per address of the 64k memory
+   std::vector<Breakpoint> mBreakpoints; // Breakpoints with their conditions
+   std::vector<Watchpoint> mWatchpoints; // Watched memory ranges
+
+   bool mPaused; // Emulation halted, waiting for commands
+   Stop mStop; // Reason of the last stop
+   bool mStepping; // Stop after the next instruction
+   bool mResuming; // Ignore breakpoints at the current PC once
+   bool mWatchHit; // A watched address was accessed
+   std::uint16_t mWatchAddr; // Address of the last watchpoint hit
+   std::uint8_t mWatchFlag; // Kind of access of the last watchpoint hit
+   std::uint16_t mTemporary; // Address of the step-over breakpoint, or 0xFFFF
+
+   std::mutex mQueueMutex;
+   std::deque<std::string> mQueue; // Commands read by the console
+};
+
+}
+
+#endif // DEBUGGER_H
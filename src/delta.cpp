@@ -0,0 +1,86 @@
+#include "delta.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+
+void writeVarint(std::vector<std::uint8_t> &out, std::size_t value)
+{
+   while(value >= 0x80) {
+      out.push_back(static_cast<std::uint8_t>(value | 0x80));
+      value >>= 7;
+   }
+
+   out.push_back(static_cast<std::uint8_t>(value));
+}
+
+bool readVarint(const std::uint8_t *in, std::size_t size, std::size_t &pos, std::size_t &value)
+{
+   value = 0;
+
+   for(unsigned shift = 0; pos < size && shift < 64; shift += 7) {
+      const std::uint8_t byte = in[pos++];
+      value |= static_cast<std::size_t>(byte & 0x7F) << shift;
+      if((byte & 0x80) == 0) {
+         return true;
+      }
+   }
+
+   return false;
+}
+
+}
+
+void chip8emu::encodeDelta(const std::uint8_t *reference, std::size_t referenceSize, const std::uint8_t *bytes, std::size_t size,
+                           std::vector<std::uint8_t> &out)
+{
+   const auto same = [reference, referenceSize, bytes](std::size_t pos) {
+      return bytes[pos] == (pos < referenceSize ? reference[pos] : 0);
+   };
+
+   for(std::size_t pos = 0; pos < size;) {
+      const std::size_t unchanged = pos;
+      while(pos < size && same(pos)) {
+         pos++;
+      }
+
+      // A single unchanged byte is cheaper to keep in the changed run.
+      const std::size_t changed = pos;
+      while(pos < size && (!same(pos) || (pos + 1 < size && !same(pos + 1)))) {
+         pos++;
+      }
+
+      writeVarint(out, changed - unchanged);
+      writeVarint(out, pos - changed);
+      out.insert(out.end(), bytes + changed, bytes + pos);
+   }
+}
+
+bool chip8emu::decodeDelta(const std::uint8_t *reference, std::size_t referenceSize, const std::uint8_t *delta, std::size_t deltaSize,
+                           std::uint8_t *bytes, std::size_t size)
+{
+   const std::size_t common = std::min(referenceSize, size);
+   std::memcpy(bytes, reference, common);
+   std::memset(bytes + common, 0, size - common);
+
+   std::size_t pos = 0;
+   for(std::size_t offset = 0; offset < deltaSize;) {
+      std::size_t unchanged, changed;
+      if(!readVarint(delta, deltaSize, offset, unchanged) || !readVarint(delta, deltaSize, offset, changed)) {
+         return false;
+      }
+
+      pos += unchanged;
+      if(pos > size || changed > size - pos || changed > deltaSize - offset) {
+         return false;
+      }
+
+      std::memcpy(bytes + pos, delta + offset, changed);
+      pos += changed;
+      offset += changed;
+   }
+
+   return true;
+}
@@ -0,0 +1,24 @@
+#ifndef DELTA_H
+#define DELTA_H
+
+#include <cstdint>
+#include <vector>
+
+namespace chip8emu
+{
+
+// Stores bytes as their difference to a reference, alternating the lengths
+// of unchanged and changed runs (as varints) with the changed bytes. Bytes
+// past the end of the reference are compared against zero. Used for machine
+// states, most of whose memory never changes.
+void encodeDelta(const std::uint8_t *reference, std::size_t referenceSize, const std::uint8_t *bytes, std::size_t size,
+                 std::vector<std::uint8_t> &out);
+
+// Rebuilds 'size' bytes from the reference and their difference, returns
+// false if the difference is truncated or does not fit.
+bool decodeDelta(const std::uint8_t *reference, std::size_t referenceSize, const std::uint8_t *delta, std::size_t deltaSize,
+                 std::uint8_t *bytes, std::size_t size);
+
+}
+
+#endif // DELTA_H
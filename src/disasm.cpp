@@ -0,0 +1,99 @@
+#include "disasm.h"
+
+#include <cstdio>
+
+std::string chip8emu::disassemble(std::uint16_t op)
+{
+   const unsigned x = (op & 0x0F00) >> 8;
+   const unsigned y = (op & 0x00F0) >> 4;
+   const unsigned n = op & 0x000F;
+   const unsigned nn = op & 0x00FF;
+   const unsigned nnn = op & 0x0FFF;
+
+   char text[32];
+
+   switch(op & 0xF000) {
+   case 0x0000:
+      if(op == 0x00E0) {
+         return "CLS";
+      } else if(op == 0x00EE) {
+         return "RET";
+      } else if(op >= 0x00FB && op <= 0x00FF) {
+         static const char *schip[5] = { "SCR", "SCL", "EXIT", "LOW", "HIGH" };
+         return schip[op - 0x00FB];
+      } else if((op & 0xFFF0) == 0x00C0) {
+         std::snprintf(text, sizeof(text), "SCD %u", n);
+      } else if((op & 0xFFF0) == 0x00D0) {
+         std::snprintf(text, sizeof(text), "SCU %u", n);
+      } else {
+         std::snprintf(text, sizeof(text), "SYS 0x%03X", nnn);
+      }
+      break;
+   case 0x1000: std::snprintf(text, sizeof(text), "JP 0x%03X", nnn); break;
+   case 0x2000: std::snprintf(text, sizeof(text), "CALL 0x%03X", nnn); break;
+   case 0x3000: std::snprintf(text, sizeof(text), "SE V%X, 0x%02X", x, nn); break;
+   case 0x4000: std::snprintf(text, sizeof(text), "SNE V%X, 0x%02X", x, nn); break;
+   case 0x5000:
+      if(n == 0x2) {
+         std::snprintf(text, sizeof(text), "SAVE V%X-V%X", x, y);
+      } else if(n == 0x3) {
+         std::snprintf(text, sizeof(text), "LOAD V%X-V%X", x, y);
+      } else {
+         std::snprintf(text, sizeof(text), "SE V%X, V%X", x, y);
+      }
+      break;
+   case 0x6000: std::snprintf(text, sizeof(text), "LD V%X, 0x%02X", x, nn); break;
+   case 0x7000: std::snprintf(text, sizeof(text), "ADD V%X, 0x%02X", x, nn); break;
+   case 0x8000:
+      {
+         static const char *alu[16] = {
+            "LD", "OR", "AND", "XOR", "ADD", "SUB", "SHR", "SUBN",
+            nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, "SHL", nullptr
+         };
+
+         if(alu[n] == nullptr) {
+            std::snprintf(text, sizeof(text), "DW 0x%04X", op);
+         } else {
+            std::snprintf(text, sizeof(text), "%s V%X, V%X", alu[n], x, y);
+         }
+      }
+      break;
+   case 0x9000: std::snprintf(text, sizeof(text), "SNE V%X, V%X", x, y); break;
+   case 0xA000: std::snprintf(text, sizeof(text), "LD I, 0x%03X", nnn); break;
+   case 0xB000: std::snprintf(text, sizeof(text), "JP V0, 0x%03X", nnn); break;
+   case 0xC000: std::snprintf(text, sizeof(text), "RND V%X, 0x%02X", x, nn); break;
+   case 0xD000: std::snprintf(text, sizeof(text), "DRW V%X, V%X, %u", x, y, n); break;
+   case 0xE000:
+      if(nn == 0x9E) {
+         std::snprintf(text, sizeof(text), "SKP V%X", x);
+      } else if(nn == 0xA1) {
+         std::snprintf(text, sizeof(text), "SKNP V%X", x);
+      } else {
+         std::snprintf(text, sizeof(text), "DW 0x%04X", op);
+      }
+      break;
+   default:
+      switch(nn) {
+      case 0x00: std::snprintf(text, sizeof(text), x == 0 ? "LD I, LONG" : "DW 0x%04X", op); break;
+      case 0x01: std::snprintf(text, sizeof(text), "PLANE %u", x); break;
+      case 0x02: std::snprintf(text, sizeof(text), x == 0 ? "AUDIO" : "DW 0x%04X", op); break;
+      case 0x07: std::snprintf(text, sizeof(text), "LD V%X, DT", x); break;
+      case 0x0A: std::snprintf(text, sizeof(text), "LD V%X, K", x); break;
+      case 0x15: std::snprintf(text, sizeof(text), "LD DT, V%X", x); break;
+      case 0x18: std::snprintf(text, sizeof(text), "LD ST, V%X", x); break;
+      case 0x1E: std::snprintf(text, sizeof(text), "ADD I, V%X", x); break;
+      case 0x29: std::snprintf(text, sizeof(text), "LD F, V%X", x); break;
+      case 0x30: std::snprintf(text, sizeof(text), "LD HF, V%X", x); break;
+      case 0x33: std::snprintf(text, sizeof(text), "LD B, V%X", x); break;
+      case 0x3A: std::snprintf(text, sizeof(text), "PITCH V%X", x); break;
+      case 0x55: std::snprintf(text, sizeof(text), "LD [I], V%X", x); break;
+      case 0x65: std::snprintf(text, sizeof(text), "LD V%X, [I]", x); break;
+      case 0x75: std::snprintf(text, sizeof(text), "LD R, V%X", x); break;
+      case 0x85: std::snprintf(text, sizeof(text), "LD V%X, R", x); break;
+      default: std::snprintf(text, sizeof(text), "DW 0x%04X", op); break;
+      }
+      break;
+   }
+
+   return text;
+}
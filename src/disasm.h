@@ -0,0 +1,15 @@
+#ifndef DISASM_H
+#define DISASM_H
+
+#include <cstdint>
+#include <string>
+
+namespace chip8emu
+{
+
+// Returns the assembly mnemonic of a CHIP-8 opcode, e.g. "ADD V1, V2".
+std::string disassemble(std::uint16_t op);
+
+}
+
+#endif // DISASM_H
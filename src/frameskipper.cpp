@@ -0,0 +1,86 @@
+#include "frameskipper.h"
+
+#include <algorithm>
+
+namespace
+{
+
+double microseconds(chip8emu::FrameSkipper::Clock::duration duration)
+{
+   return std::chrono::duration<double, std::micro>(duration).count();
+}
+
+}
+
+chip8emu::FrameSkipper::FrameSkipper(Clock::duration period, std::uint32_t maxSkip)
+   : mPeriod(period), mMaxSkip(maxSkip), mStarted(false), mPresentCost(Clock::duration::zero()), mSkipRun(0),
+     mFrames(0), mDropped(0), mLongestRun(0), mRestarts(0), mPresents(0), mTotalPresentCost(Clock::duration::zero())
+{
+
+}
+
+chip8emu::FrameSkipper::~FrameSkipper()
+{
+
+}
+
+void chip8emu::FrameSkipper::beginFrame(Clock::time_point now)
+{
+   if(!mStarted) {
+      mStarted = true;
+      mStart = now;
+      mDue = now + mPeriod;
+   } else {
+      mDue += mPeriod;
+
+      // Too far behind to catch up by dropping frames, start over.
+      if(now > mDue + MAX_LAG_FRAMES * mPeriod) {
+         mDue = now + mPeriod;
+         mRestarts++;
+      }
+   }
+
+   mFrames++;
+}
+
+bool chip8emu::FrameSkipper::shouldPresent(Clock::time_point now)
+{
+   if(mSkipRun < mMaxSkip && now + mPresentCost > mDue) {
+      mSkipRun++;
+      mDropped++;
+      mLongestRun = std::max(mLongestRun, mSkipRun);
+      return false;
+   }
+
+   mSkipRun = 0;
+   return true;
+}
+
+void chip8emu::FrameSkipper::addPresentCost(Clock::duration cost)
+{
+   // Follow changes of the cost within a few frames, ignoring single spikes.
+   mPresentCost += (cost - mPresentCost) / 8;
+
+   mPresents++;
+   mTotalPresentCost += cost;
+}
+
+chip8emu::FrameSkipper::Clock::time_point chip8emu::FrameSkipper::due() const
+{
+   return mDue;
+}
+
+void chip8emu::FrameSkipper::report(std::ostream &out) const
+{
+   if(!mStarted) {
+      return;
+   }
+
+   const Clock::duration elapsed = Clock::now() - mStart;
+   const double speed = elapsed > Clock::duration::zero()
+                        ? 100.0 * std::chrono::duration<double>(mPeriod * mFrames) / elapsed : 0.0;
+
+   out << "Frame skip: " << mDropped << " of " << mFrames << " frames dropped (at most " << mLongestRun << " in a row, "
+       << mRestarts << " schedule restarts), " << (mPresents ? microseconds(mTotalPresentCost) / mPresents : 0.0)
+       << "us per present, emulated speed " << speed << "% of real time" << std::endl;
+}
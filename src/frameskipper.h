@@ -0,0 +1,64 @@
+#ifndef FRAME_SKIPPER_H
+#define FRAME_SKIPPER_H
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+
+namespace chip8emu
+{
+
+// Keeps emulation on its real-time schedule when presenting frames is slow.
+// Every emulated frame has a slot of one period. Presenting a frame is
+// dropped if it would not be finished within the slot, judged by the
+// average cost of earlier presents, so the next frame is emulated in time.
+// At most 'maxSkip' frames are dropped in a row. Dropped frames are never
+// lost, the next presented frame shows the latest framebuffer.
+//
+// If emulation itself falls more than a few frames behind (turbo mode, a
+// paused debugger, a blocked window) the schedule starts over instead of
+// racing to catch up.
+class FrameSkipper
+{
+public:
+   typedef std::chrono::steady_clock Clock;
+
+   FrameSkipper(Clock::duration period, std::uint32_t maxSkip);
+   ~FrameSkipper();
+
+   // Starts the slot of the next emulated frame.
+   void beginFrame(Clock::time_point now);
+
+   // Returns true if the frame should be presented, counting it as dropped
+   // otherwise.
+   bool shouldPresent(Clock::time_point now);
+   void addPresentCost(Clock::duration cost);
+
+   // End of the current slot, when the next frame is due.
+   Clock::time_point due() const;
+
+   void report(std::ostream &out) const;
+
+private:
+   static const std::uint32_t MAX_LAG_FRAMES = 8; // Lag after which the schedule restarts
+
+   const Clock::duration mPeriod;
+   const std::uint32_t mMaxSkip;
+
+   bool mStarted;
+   Clock::time_point mStart; // Start of the session
+   Clock::time_point mDue; // End of the current slot
+   Clock::duration mPresentCost; // Moving average of the present cost
+   std::uint32_t mSkipRun; // Frames dropped in a row
+
+   std::uint64_t mFrames; // Emulated frames
+   std::uint64_t mDropped;
+   std::uint32_t mLongestRun;
+   std::uint64_t mRestarts; // Schedule restarts
+   std::uint64_t mPresents;
+   Clock::duration mTotalPresentCost;
+};
+
+}
+
+#endif // FRAME_SKIPPER_H
@@ -0,0 +1,28 @@
+#include "inputlog.h"
+
+#include <fstream>
+
+std::vector<std::uint16_t> chip8emu::loadInputLog(const std::string &filename)
+{
+   std::vector<std::uint16_t> input;
+   std::ifstream file(filename, std::ios::in | std::ios::binary);
+
+   char bytes[2];
+   while(file.read(bytes, sizeof(bytes))) {
+      input.push_back(static_cast<std::uint8_t>(bytes[0]) | static_cast<std::uint8_t>(bytes[1]) << 8);
+   }
+
+   return input;
+}
+
+bool chip8emu::saveInputLog(const std::string &filename, const std::vector<std::uint16_t> &input)
+{
+   std::ofstream file(filename, std::ios::out | std::ios::binary);
+
+   for(const std::uint16_t keys : input) {
+      file.put(keys & 0xFF);
+      file.put(keys >> 8);
+   }
+
+   return static_cast<bool>(file);
+}
@@ -0,0 +1,18 @@
+#ifndef INPUT_LOG_H
+#define INPUT_LOG_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace chip8emu
+{
+
+// Recorded pad input is stored as one little endian 16 bit key mask per
+// 60Hz frame, as consumed by CPU::setKeys().
+std::vector<std::uint16_t> loadInputLog(const std::string &filename);
+bool saveInputLog(const std::string &filename, const std::vector<std::uint16_t> &input);
+
+}
+
+#endif // INPUT_LOG_H
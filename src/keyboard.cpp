@@ -1,42 +1,74 @@
 #include "keyboard.h"
 
 #include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace
+{
+
+// Default pad layout, the 4x4 block 1234 QWER ASDF ZXCV.
+const SDL_Scancode PAD_KEYS[16] = {
+   SDL_SCANCODE_X, SDL_SCANCODE_1, SDL_SCANCODE_2, SDL_SCANCODE_3,
+   SDL_SCANCODE_Q, SDL_SCANCODE_W, SDL_SCANCODE_E, SDL_SCANCODE_A,
+   SDL_SCANCODE_S, SDL_SCANCODE_D, SDL_SCANCODE_Z, SDL_SCANCODE_C,
+   SDL_SCANCODE_4, SDL_SCANCODE_R, SDL_SCANCODE_F, SDL_SCANCODE_V
+};
+
+const char* const HOTKEY_NAMES[chip8emu::HOTKEY_COUNT] = {
+   "", "quit", "overlay", "trace", "save", "snapshot", "fullscreen", "capture", "turbo"
+};
+
+const SDL_Scancode HOTKEY_KEYS[chip8emu::HOTKEY_COUNT] = {
+   SDL_SCANCODE_UNKNOWN, SDL_SCANCODE_ESCAPE, SDL_SCANCODE_F5, SDL_SCANCODE_F7, SDL_SCANCODE_F8,
+   SDL_SCANCODE_F9, SDL_SCANCODE_F10, SDL_SCANCODE_F11, SDL_SCANCODE_SPACE
+};
+
+double microseconds(chip8emu::Keyboard::Clock::duration duration)
+{
+   return std::chrono::duration<double, std::micro>(duration).count();
+}
+
+}
 
 chip8emu::Keyboard::Keyboard()
-   : mWindowClosed(false), mKeyPad(16, false)
+   : mPad(0), mTapped(0), mHotkeysDown(0), mHotkeysPressed(0),
+     mLatencyCount(0), mLatencySum(Clock::duration::zero()), mLatencyMax(Clock::duration::zero())
 {
+   mPadTable.fill(UNBOUND);
+   mHotkeyTable.fill(HOTKEY_NONE);
+
+   for(std::uint8_t key = 0; key < 16; key++) {
+      bindPad(key, PAD_KEYS[key]);
+   }
+
+   for(int hotkey = HOTKEY_QUIT; hotkey < HOTKEY_COUNT; hotkey++) {
+      bindHotkey(static_cast<Hotkey>(hotkey), HOTKEY_KEYS[hotkey]);
+   }
 }
 
 chip8emu::Keyboard::~Keyboard()
 {
 }
 
-void chip8emu::Keyboard::update()
+void chip8emu::Keyboard::update(std::uint32_t timeout)
 {
    SDL_Event event;
+   bool pending = timeout > 0 ? SDL_WaitEventTimeout(&event, timeout) != 0 : SDL_PollEvent(&event) != 0;
 
-   while (SDL_PollEvent(&event)) {
+   for(; pending; pending = SDL_PollEvent(&event) != 0) {
       switch (event.type) {
       case SDL_QUIT:
-         // TODO: Handle quit here.
-         mWindowClosed = true;
+         // Closing the window quits like the quit hotkey.
+         mHotkeysDown |= 1 << HOTKEY_QUIT;
+         mHotkeysPressed |= 1 << HOTKEY_QUIT;
          break;
 
       case SDL_KEYDOWN:
-         {         
-            std::vector<SDL_Keycode>::const_iterator it = std::find(mPadMap.begin(), mPadMap.end(), event.key.keysym.sym);
-            if(it != mPadMap.end()) {
-               mKeyPad[std::distance(mPadMap.begin(), it)] = true;
-            }
-            
-            this->onKeyDown();
-         }
-         
-         break;
-
       case SDL_KEYUP:
-         mKeyPressed[event.key.keysym.sym] = true;
-         this->onKeyUp();
+         handleKey(event.key, event.type == SDL_KEYDOWN, Clock::now(), SDL_GetTicks());
          break;
 
       default:
@@ -45,48 +77,198 @@ void chip8emu::Keyboard::update()
    }
 }
 
-void chip8emu::Keyboard::onKeyDown()
+void chip8emu::Keyboard::handleKey(const SDL_KeyboardEvent &event, bool down, Clock::time_point now, std::uint32_t ticks)
 {
-   mKeystates = SDL_GetKeyboardState(0);
+   // Auto repeat does not change any state.
+   const SDL_Scancode scancode = event.keysym.scancode;
+   if(event.repeat != 0 || scancode < 0 || scancode >= SDL_NUM_SCANCODES) {
+      return;
+   }
+
+   const Hotkey hotkey = static_cast<Hotkey>(mHotkeyTable[scancode]);
+   if(hotkey != HOTKEY_NONE) {
+      if(down) {
+         mHotkeysDown |= 1 << hotkey;
+         mHotkeysPressed |= 1 << hotkey;
+      } else {
+         mHotkeysDown &= ~(1 << hotkey);
+      }
+   }
+
+   const std::int8_t key = mPadTable[scancode];
+   if(key == UNBOUND || ((mPad >> key) & 1) == down) {
+      return;
+   }
+
+   if(down) {
+      mPad |= 1 << key;
+      mTapped |= 1 << key;
+   } else {
+      mPad &= ~(1 << key);
+   }
+
+   // The event waited in the SDL queue since its timestamp (in ms).
+   if(mPending.size() < MAX_PENDING_EDGES) {
+      const std::uint32_t queued = ticks >= event.timestamp ? ticks - event.timestamp : 0;
+      mPending.push_back(PadEdge {static_cast<std::uint8_t>(key), down, now - std::chrono::milliseconds(queued), 0, Clock::duration::zero()});
+   }
 }
 
-void chip8emu::Keyboard::onKeyUp()
+void chip8emu::Keyboard::reset()
 {
-   mKeystates = SDL_GetKeyboardState(0);
+   mPad = 0;
+   mTapped = 0;
+   mPending.clear();
+   mEdges.clear();
+   mHotkeysDown = 0;
+   mHotkeysPressed = 0;
 }
 
-bool chip8emu::Keyboard::isPadKeyDown(std::uint8_t key)
+bool chip8emu::Keyboard::loadBindings(const std::string &filename)
 {
-   if(key < mKeyPad.size() && mKeyPad[key]) {
-      mKeyPad[key] = false;
-      return true;
+   std::ifstream file(filename);
+   if(!file) {
+      return false;
+   }
+
+   // One line of the file, binding either a pad key or a hotkey.
+   struct Binding
+   {
+      std::int8_t key;
+      Hotkey hotkey;
+      SDL_Scancode scancode;
+   };
+
+   std::vector<Binding> bindings;
+   std::string line;
+
+   for(std::size_t number = 1; std::getline(file, line); number++) {
+      std::istringstream in(line);
+      std::string action, name;
+
+      if(!(in >> action) || action[0] == '#') {
+         continue;
+      }
+
+      Binding binding {UNBOUND, HOTKEY_NONE, SDL_SCANCODE_UNKNOWN};
+      const std::string digits = "0123456789ABCDEF";
+      const std::size_t digit = action.size() == 4 ? digits.find(std::toupper(action[3])) : std::string::npos;
+
+      if(action.compare(0, 3, "pad") == 0 && digit != std::string::npos) {
+         binding.key = digit;
+      } else {
+         const char* const *hotkey = std::find(std::begin(HOTKEY_NAMES) + 1, std::end(HOTKEY_NAMES), action);
+         if(hotkey == std::end(HOTKEY_NAMES)) {
+            std::cerr << filename << ":" << number << ": unknown action '" << action << "'" << std::endl;
+            continue;
+         }
+
+         binding.hotkey = static_cast<Hotkey>(hotkey - std::begin(HOTKEY_NAMES));
+      }
+
+      // Scancode names may contain spaces, e.g. "Left Shift".
+      std::getline(in >> std::ws, name);
+      binding.scancode = SDL_GetScancodeFromName(name.c_str());
+      if(binding.scancode == SDL_SCANCODE_UNKNOWN) {
+         std::cerr << filename << ":" << number << ": unknown key '" << name << "'" << std::endl;
+         continue;
+      }
+
+      bindings.push_back(binding);
+   }
+
+   // Bindings from the file replace the defaults of their actions, ...
+   for(const Binding &binding : bindings) {
+      for(std::size_t scancode = 0; scancode < SDL_NUM_SCANCODES; scancode++) {
+         if(binding.key != UNBOUND && mPadTable[scancode] == binding.key) {
+            mPadTable[scancode] = UNBOUND;
+         }
+
+         if(binding.hotkey != HOTKEY_NONE && mHotkeyTable[scancode] == binding.hotkey) {
+            mHotkeyTable[scancode] = HOTKEY_NONE;
+         }
+      }
    }
 
-   return false;
+   // ... then every key given for an action is bound.
+   for(const Binding &binding : bindings) {
+      if(binding.key != UNBOUND) {
+         bindPad(binding.key, binding.scancode);
+      } else {
+         bindHotkey(binding.hotkey, binding.scancode);
+      }
+   }
+
+   return true;
 }
 
-bool chip8emu::Keyboard::isKeyDown(SDL_Scancode key) const
+void chip8emu::Keyboard::bindPad(std::uint8_t key, SDL_Scancode scancode)
 {
-   if(mWindowClosed && key == SDL_SCANCODE_ESCAPE) {
-      return true;
+   if(key < 16 && scancode >= 0 && scancode < SDL_NUM_SCANCODES) {
+      mPadTable[scancode] = key;
    }
-   
-   if (mKeystates != nullptr) {
-      if (mKeystates[key] == 1) {
-         return true;
-      }
+}
+
+void chip8emu::Keyboard::bindHotkey(Hotkey hotkey, SDL_Scancode scancode)
+{
+   if(scancode >= 0 && scancode < SDL_NUM_SCANCODES) {
+      mHotkeyTable[scancode] = hotkey;
+   }
+}
+
+std::uint16_t chip8emu::Keyboard::padKeys(std::uint64_t frame)
+{
+   const Clock::time_point now = Clock::now();
+
+   // The CPU sees the pending edges from this frame on.
+   mEdges.swap(mPending);
+   mPending.clear();
+
+   for(PadEdge &edge : mEdges) {
+      edge.frame = frame;
+      edge.latency = now - edge.time;
+
+      mLatencyCount++;
+      mLatencySum += edge.latency;
+      mLatencyMax = std::max(mLatencyMax, edge.latency);
    }
 
-   return false;
+   const std::uint16_t keys = mPad | mTapped;
+   mTapped = 0;
+
+   return keys;
 }
 
-bool chip8emu::Keyboard::isKeyPressed(SDL_Keycode key)
+const std::vector<chip8emu::Keyboard::PadEdge>& chip8emu::Keyboard::padEdges() const
 {
-   std::map<SDL_Keycode, bool>::iterator it = mKeyPressed.find(key);
-   if(it != mKeyPressed.end() && it->second) {
-      mKeyPressed[key] = false;
-      return true;
+   return mEdges;
+}
+
+bool chip8emu::Keyboard::isPadKeyDown(std::uint8_t key) const
+{
+   return key < 16 && (mPad & (1 << key)) != 0;
+}
+
+bool chip8emu::Keyboard::hotkeyPressed(Hotkey hotkey)
+{
+   const std::uint32_t bit = 1 << hotkey;
+   const bool pressed = (mHotkeysPressed & bit) != 0;
+   mHotkeysPressed &= ~bit;
+
+   return pressed;
+}
+
+bool chip8emu::Keyboard::isHotkeyDown(Hotkey hotkey) const
+{
+   return (mHotkeysDown & (1 << hotkey)) != 0;
+}
+
+void chip8emu::Keyboard::reportLatency(std::ostream &out) const
+{
+   if(mLatencyCount == 0) {
+      return;
    }
 
-   return false;
-}
\ No newline at end of file
+   out << "Input latency: " << microseconds(mLatencySum) / mLatencyCount << "us average, "
+       << microseconds(mLatencyMax) << "us max over " << mLatencyCount << " key edges" << std::endl;
+}
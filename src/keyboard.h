@@ -3,47 +3,106 @@
 
 #include <SDL2/SDL.h>
 
-#include <iostream>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
 #include <vector>
-#include <map>
 
 namespace chip8emu
 {
 
+// Emulator functions bound to keys besides the pad.
+enum Hotkey
+{
+   HOTKEY_NONE,
+   HOTKEY_QUIT,
+   HOTKEY_OVERLAY,
+   HOTKEY_TRACE,
+   HOTKEY_SAVE_STATE,
+   HOTKEY_SNAPSHOT,
+   HOTKEY_FULLSCREEN,
+   HOTKEY_CAPTURE,
+   HOTKEY_TURBO,
+   HOTKEY_COUNT
+};
+
+// Translates SDL key events into the 16 bit pad mask of the CPU and hotkey
+// presses. Keys are looked up by scancode, i.e. by their position on the
+// keyboard whatever the layout, in tables filled from the default bindings
+// and an optional config file.
+//
+// The pad is updated on key down and up events. A key pressed and released
+// between two frames is still reported down for one frame. Every change of
+// a pad key is kept as an edge, stamped with the emulated frame the CPU
+// first sees it in, and the time from the SDL event to that frame is the
+// input latency.
 class Keyboard
 {
 public:
+   typedef std::chrono::steady_clock Clock;
+
+   struct PadEdge
+   {
+      std::uint8_t key;
+      bool pressed;
+      Clock::time_point time; // Host time of the SDL event
+      std::uint64_t frame; // Emulated frame the CPU first sees the edge in
+      Clock::duration latency; // From the SDL event to that frame
+   };
+
    Keyboard();
    ~Keyboard();
 
-   void update();
+   // Handles all pending events, waiting up to 'timeout' ms for the first.
+   void update(std::uint32_t timeout = 0);
    void reset();
 
-   bool isPadKeyDown(std::uint8_t key);
-   bool isKeyDown(SDL_Scancode key) const;
-   bool isKeyPressed(SDL_Keycode key);
+   // Reads a config file of "<action> <SDL scancode name>" lines, actions
+   // being pad0 to padF and the hotkey names (quit, overlay, trace, save,
+   // snapshot, fullscreen, capture, turbo). Actions listed in the file lose
+   // their default keys. Empty lines and lines starting with '#' are
+   // skipped.
+   bool loadBindings(const std::string &filename);
+   void bindPad(std::uint8_t key, SDL_Scancode scancode);
+   void bindHotkey(Hotkey hotkey, SDL_Scancode scancode);
+
+   // Returns the pad mask for emulated frame 'frame' and stamps the edges
+   // since the previous call with it.
+   std::uint16_t padKeys(std::uint64_t frame);
+   const std::vector<PadEdge>& padEdges() const;
+   bool isPadKeyDown(std::uint8_t key) const;
 
-   void onKeyDown();
-   void onKeyUp();
+   // Returns true once per press of the hotkey.
+   bool hotkeyPressed(Hotkey hotkey);
+   bool isHotkeyDown(Hotkey hotkey) const;
+
+   void reportLatency(std::ostream &out) const;
 
 private:
-   bool mWindowClosed;
-   const Uint8* mKeystates;
-    
-   std::vector<bool> mKeyPad;
-   const std::vector<SDL_Keycode> mPadMap {
-      SDLK_x, SDLK_1, SDLK_2, SDLK_3,
-      SDLK_q, SDLK_w, SDLK_e, SDLK_a,
-      SDLK_s, SDLK_d, SDLK_y, SDLK_c,
-      SDLK_4, SDLK_r, SDLK_f, SDLK_v
-   };
+   static const std::int8_t UNBOUND = -1;
+   static const std::size_t MAX_PENDING_EDGES = 256;
 
-   std::map<SDL_Keycode, bool> mKeyPressed;
-   const std::vector<SDL_Keycode> mEmuMap {
-      SDLK_ESCAPE, SDLK_F8, SDLK_F9, SDLK_F10, SDLK_SPACE
-   };
+   void handleKey(const SDL_KeyboardEvent &event, bool down, Clock::time_point now, std::uint32_t ticks);
+
+   std::array<std::int8_t, SDL_NUM_SCANCODES> mPadTable; // Scancode to pad key
+   std::array<std::uint8_t, SDL_NUM_SCANCODES> mHotkeyTable; // Scancode to Hotkey
+
+   std::uint16_t mPad; // Pad keys down
+   std::uint16_t mTapped; // Pad keys pressed since the last frame
+   std::vector<PadEdge> mPending; // Edges not seen by the CPU yet
+   std::vector<PadEdge> mEdges; // Edges of the last frame
+
+   std::uint32_t mHotkeysDown;
+   std::uint32_t mHotkeysPressed; // Presses not handled yet
+
+   // Input latency over the whole session
+   std::uint64_t mLatencyCount;
+   Clock::duration mLatencySum;
+   Clock::duration mLatencyMax;
 };
 
 }
 
-#endif // KEYBOARD_H
\ No newline at end of file
+#endif // KEYBOARD_H
@@ -1,46 +1,420 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
 #include <iostream>
 #include <memory>
+#include <string>
+#include <thread>
 
 #include "chip8emu.h"
+#include "frameskipper.h"
+#include "inputlog.h"
+#include "server.h"
+#include "startuptimer.h"
+#include "terminal.h"
 
-const int FPS = 180;
-const int DELAY_TIME = 1000.0f / FPS;
+#include <csignal>
+
+struct Options
+{
+   std::string rom;
+   int zoom = 10;
+   chip8emu::Scaler::Filter filter = chip8emu::Scaler::FILTER_NONE;
+
+   bool headless = false;
+   bool terminal = false; // Headless, but shown on the terminal in real time
+   std::uint32_t frames = 3600;
+   std::string input;
+   bool seeded = false; // Fixed seed of the random generator, e.g. to replay a search result
+   std::uint32_t seed = 0;
+   std::uint32_t cyclesPerFrame = 10; // Instructions per 60Hz frame
+   std::string capture;
+   std::string trace;
+   bool debug = false;
+   std::string romDb = "chip8roms.db";
+   std::string keys = "chip8keys.cfg";
+   bool keysGiven = false; // Missing default key bindings are fine
+   std::string quirks;
+   std::string server;
+   std::string metrics;
+   bool overlay = false;
+   bool startup = false;
+   std::uint32_t frameSkip = 4; // Changed frames dropped in a row at most
+};
+
+// Creates the execution trace requested on the command line, if any.
+std::shared_ptr<chip8emu::Trace> createTrace(const Options &options)
+{
+   if(options.trace.empty()) {
+      return nullptr;
+   }
+
+   std::shared_ptr<chip8emu::Trace> trace = std::make_shared<chip8emu::Trace>(options.trace);
+   trace->installCrashHandler();
+
+   return trace;
+}
+
+// Creates the debugger and its console if requested, halted before the rom starts.
+std::shared_ptr<chip8emu::Debugger> createDebugger(const Options &options)
+{
+   if(!options.debug) {
+      return nullptr;
+   }
+
+   std::shared_ptr<chip8emu::Debugger> debugger = std::make_shared<chip8emu::Debugger>();
+   debugger->startConsole();
+   debugger->pause();
+
+   return debugger;
+}
+
+// Applies the speed and quirk profile given on the command line, or otherwise
+// lets the CPU look up the profile of the rom in the database while loading it.
+void setupCpu(const Options &options, chip8emu::CPU &cpu)
+{
+   cpu.setCyclesPerFrame(options.cyclesPerFrame);
+
+   chip8emu::Quirks quirks;
+   if(chip8emu::parseQuirks(options.quirks, quirks)) {
+      cpu.setQuirks(quirks);
+      return;
+   }
+
+   std::shared_ptr<chip8emu::QuirkDatabase> database = std::make_shared<chip8emu::QuirkDatabase>();
+   database->load(options.romDb);
+   cpu.setQuirkDatabase(database);
+}
+
+volatile std::sig_atomic_t sInterrupted = 0; // Terminal run stopped by SIGINT
+
+void interrupt(int)
+{
+   sInterrupted = 1;
+}
+
+// Runs the rom without any window at maximum speed, feeding recorded input,
+// or in real time on the terminal.
+int runHeadless(const Options &options, chip8emu::StartupTimer *startup)
+{
+   std::shared_ptr<chip8emu::PPU> ppu = std::make_shared<chip8emu::PPU>();
+   chip8emu::CPU cpu(ppu);
+   {
+      chip8emu::StartupTimer::Phase phase(startup, "rom database");
+      setupCpu(options, cpu);
+   }
+
+   if(options.seeded) {
+      cpu.seed(options.seed);
+   }
+
+   {
+      chip8emu::StartupTimer::Phase phase(startup, "rom");
+      cpu.loadRom(options.rom);
+   }
+
+   std::cout << "Rom hash " << std::hex << std::setw(16) << std::setfill('0') << cpu.romHash() << std::dec
+             << std::setfill(' ') << ", quirk profile " << chip8emu::quirksName(cpu.quirks()) << std::endl;
+
+   std::shared_ptr<chip8emu::Trace> trace = createTrace(options);
+   cpu.setTrace(trace);
+
+   std::shared_ptr<chip8emu::Debugger> debugger = createDebugger(options);
+   cpu.setDebugger(debugger);
+
+   std::vector<std::uint16_t> input;
+   {
+      chip8emu::StartupTimer::Phase phase(startup, "input");
+      input = chip8emu::loadInputLog(options.input);
+   }
+
+   std::unique_ptr<chip8emu::Capture> capture;
+   if(!options.capture.empty()) {
+      capture = std::make_unique<chip8emu::Capture>(options.capture);
+      capture->setBlocking(true);
+
+      if(!capture->start()) {
+         std::cerr << "Failed to open " << options.capture << "!" << std::endl;
+         return 1;
+      }
+   }
+
+   // Headless runs report metrics per emulated second, reading the clock
+   // once per 60 frames only.
+   std::unique_ptr<chip8emu::Metrics> metrics;
+   if(!options.metrics.empty()) {
+      metrics = std::make_unique<chip8emu::Metrics>(options.metrics);
+   }
+
+   if(startup != nullptr) {
+      startup->print(std::cout);
+   }
+
+   // The terminal shows frames on the real-time schedule of the window,
+   // dropping some if the link is too slow.
+   std::unique_ptr<chip8emu::TerminalRenderer> terminal;
+   std::unique_ptr<chip8emu::FrameSkipper> schedule;
+   if(options.terminal) {
+      terminal = std::make_unique<chip8emu::TerminalRenderer>();
+      schedule = std::make_unique<chip8emu::FrameSkipper>(std::chrono::microseconds(1000000 / 60), options.frameSkip);
+
+      if(!terminal->start()) {
+         std::cerr << "Failed to write to the terminal!" << std::endl;
+         return 1;
+      }
+
+      std::signal(SIGINT, interrupt);
+   }
+
+   chip8emu::Metrics::Clock::time_point batchStart = chip8emu::Metrics::Clock::now();
+   std::uint64_t reported = 0;
+
+   for(std::uint32_t frame = 0; frame < options.frames && !sInterrupted;) {
+      if(debugger != nullptr) {
+         debugger->poll(cpu);
+         if(debugger->paused()) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            continue;
+         }
+      }
+
+      if(schedule != nullptr) {
+         schedule->beginFrame(chip8emu::FrameSkipper::Clock::now());
+      }
+
+      cpu.setKeys(frame < input.size() ? input[frame] : 0);
+
+      // A frame interrupted by the debugger is finished on the next pass.
+      if(cpu.runFrames(1) & chip8emu::EVENT_BREAK) {
+         debugger->reportBreak(cpu);
+         continue;
+      }
+
+      if(capture != nullptr) {
+         capture->push(*ppu);
+      }
+
+      frame++;
+
+      if(terminal != nullptr) {
+         const chip8emu::FrameSkipper::Clock::time_point start = chip8emu::FrameSkipper::Clock::now();
+         if(ppu->isDrawFlagSet() && schedule->shouldPresent(start)) {
+            if(!terminal->render(*ppu)) {
+               break;
+            }
+
+            ppu->resetDrawFlag();
+            schedule->addPresentCost(chip8emu::FrameSkipper::Clock::now() - start);
+         }
+
+         std::this_thread::sleep_until(schedule->due());
+      }
+
+      if(metrics != nullptr && (frame % 60 == 0 || frame == options.frames)) {
+         const chip8emu::Metrics::Clock::time_point now = chip8emu::Metrics::Clock::now();
+         metrics->addPhase(chip8emu::Metrics::PHASE_CYCLE, now - batchStart);
+         metrics->addInstructions(cpu.instructions() - reported);
+         metrics->update(now, frame == options.frames);
+
+         reported = cpu.instructions();
+         batchStart = now;
+      }
+   }
+
+   if(terminal != nullptr) {
+      terminal->stop();
+      std::cout << "Sent " << terminal->frames() << " frames in " << terminal->bytes() << " bytes to the terminal" << std::endl;
+      schedule->report(std::cout);
+   }
+
+   if(capture != nullptr) {
+      capture->stop();
+      std::cout << "Saved capture as " << options.capture << " (" << capture->frames() << " frames, "
+                << capture->stored() << " distinct) ..." << std::endl;
+   }
+
+   if(trace != nullptr && trace->dump()) {
+      std::cout << "Saved execution trace as " << options.trace << " ..." << std::endl;
+   }
+
+   return 0;
+}
+
+chip8emu::Server *sServer = nullptr; // Server stopped by SIGINT and SIGTERM
+
+void stopServer(int)
+{
+   if(sServer != nullptr) {
+      sServer->stop();
+   }
+}
+
+// Serves sessions of the rom to other processes until interrupted.
+int runServer(const Options &options)
+{
+   chip8emu::Server server(options.server, [&options](chip8emu::CPU &cpu) {
+      setupCpu(options, cpu);
+      cpu.loadRom(options.rom);
+   });
+
+   if(!server.start()) {
+      return 1;
+   }
+
+   sServer = &server;
+   std::signal(SIGINT, stopServer);
+   std::signal(SIGTERM, stopServer);
+
+   std::cout << "Serving " << options.rom << " on " << options.server << " ..." << std::endl;
+   server.run();
+
+   std::signal(SIGINT, SIG_DFL);
+   std::signal(SIGTERM, SIG_DFL);
+   sServer = nullptr;
+   return 0;
+}
 
 int main(int argc, char **argv)
 {
+   // Startup is timed from here, the timer is dropped unless requested.
+   std::shared_ptr<chip8emu::StartupTimer> startup = std::make_shared<chip8emu::StartupTimer>();
+
    std::cout << "Starting chip8 emulator ..." << std::endl;
 
-   if(argc > 1) {
+   Options options;
+
+   for(int i = 1; i < argc; i++) {
+      const std::string arg = argv[i];
+      if(arg == "-zoom" && i + 1 < argc) {
+         options.zoom = std::min(std::max(std::atoi(argv[++i]), 1), 20);
+      } else if(arg == "-filter" && i + 1 < argc) {
+         if(!chip8emu::Scaler::parseFilter(argv[++i], options.filter)) {
+            std::cerr << "Unknown filter '" << argv[i] << "'" << std::endl;
+            return 1;
+         }
+      } else if(arg == "-headless") {
+         options.headless = true;
+      } else if(arg == "-terminal") {
+         options.headless = true;
+         options.terminal = true;
+      } else if(arg == "-frames" && i + 1 < argc) {
+         options.frames = std::strtoul(argv[++i], nullptr, 10);
+      } else if(arg == "-input" && i + 1 < argc) {
+         options.input = argv[++i];
+      } else if(arg == "-seed" && i + 1 < argc) {
+         options.seeded = true;
+         options.seed = std::strtoul(argv[++i], nullptr, 10);
+      } else if(arg == "-cycles" && i + 1 < argc) {
+         options.cyclesPerFrame = std::strtoul(argv[++i], nullptr, 10);
+      } else if(arg == "-capture" && i + 1 < argc) {
+         options.capture = argv[++i];
+      } else if(arg == "-trace" && i + 1 < argc) {
+         options.trace = argv[++i];
+      } else if(arg == "-quirks" && i + 1 < argc) {
+         options.quirks = argv[++i];
+
+         chip8emu::Quirks quirks;
+         if(!chip8emu::parseQuirks(options.quirks, quirks)) {
+            std::cerr << "Unknown quirk profile '" << options.quirks << "'" << std::endl;
+            return 1;
+         }
+      } else if(arg == "-romdb" && i + 1 < argc) {
+         options.romDb = argv[++i];
+      } else if(arg == "-keys" && i + 1 < argc) {
+         options.keys = argv[++i];
+         options.keysGiven = true;
+      } else if(arg == "-server" && i + 1 < argc) {
+         options.server = argv[++i];
+      } else if(arg == "-metrics" && i + 1 < argc) {
+         options.metrics = argv[++i];
+      } else if(arg == "-overlay") {
+         options.overlay = true;
+      } else if(arg == "-debug") {
+         options.debug = true;
+      } else if(arg == "-frameskip" && i + 1 < argc) {
+         options.frameSkip = std::strtoul(argv[++i], nullptr, 10);
+      } else if(arg == "-startup") {
+         options.startup = true;
+      } else {
+         options.rom = arg;
+      }
+   }
+
+   if(!options.startup) {
+      startup.reset();
+   }
+
+   if(!options.rom.empty() && !options.server.empty()) {
+      return runServer(options);
+   }
+
+   if(!options.rom.empty() && options.headless) {
+      return runHeadless(options, startup.get());
+   }
+
+   if(!options.rom.empty()) {
       std::cout << "Initializing Picture Processing Unit (PPU) ..." << std::endl;
-      std::shared_ptr<chip8emu::PPU> ppu = std::make_shared<chip8emu::PPU>(64, 32);
+      std::shared_ptr<chip8emu::PPU> ppu = std::make_shared<chip8emu::PPU>();
       
       std::cout << "Initializing Keypad ..." << std::endl;
       std::shared_ptr<chip8emu::Keyboard> keyboard = std::make_shared<chip8emu::Keyboard>();
+      if(!keyboard->loadBindings(options.keys) && options.keysGiven) {
+         std::cerr << "Failed to load key bindings from " << options.keys << "!" << std::endl;
+         return 1;
+      }
       
       std::cout << "Initializing Central Processing Unit (CPU) ..." << std::endl;
-      std::unique_ptr<chip8emu::CPU> cpu = std::make_unique<chip8emu::CPU>(ppu, keyboard);
+      std::unique_ptr<chip8emu::CPU> cpu = std::make_unique<chip8emu::CPU>(ppu);
+      {
+         chip8emu::StartupTimer::Phase phase(startup.get(), "rom database");
+         setupCpu(options, *cpu);
+      }
       
       std::cout << "Initializing Emulator ..." << std::endl;
       chip8emu::Chip8Emu chip8(std::move(cpu), ppu, keyboard);
-      chip8.init();
+      chip8.setScale(options.zoom);
+      chip8.setFilter(options.filter);
+      chip8.setTrace(createTrace(options));
+      chip8.setDebugger(createDebugger(options));
+      // Collecting metrics reads the clock per phase, so only when asked.
+      if(!options.metrics.empty() || options.overlay) {
+         chip8.setMetrics(std::make_shared<chip8emu::Metrics>(options.metrics), options.overlay);
+      }
+      chip8.setStartupTimer(startup);
+      chip8.setFrameSkip(options.frameSkip);
 
-      std::cout << "Loading rom '" << argv[1] << "' ..." << std::endl;
-      chip8.loadRom(argv[1]);
-      
-      int frameStart, frameTime;
+      // The rom is loaded while the window is created.
+      std::cout << "Loading rom '" << options.rom << "' ..." << std::endl;
+      if(!chip8.init(options.rom)) {
+         chip8.clean();
+         return 1;
+      }
 
+      if(!options.capture.empty()) {
+         chip8.toggleCapture(options.capture);
+      }
+      
       while(chip8.running()) {
-         frameStart = SDL_GetTicks();
-         
          chip8.handleEvents();
          chip8.cycle();
          chip8.render();
 
-         frameTime = SDL_GetTicks() - frameStart;
+         // Startup ends with the first presented frame.
+         if(startup != nullptr) {
+            startup->print(std::cout);
+            startup.reset();
+            chip8.setStartupTimer(nullptr);
+         }
 
-         while(frameTime < DELAY_TIME && chip8.speedTrottled()) {
-            chip8.handleEvents();
-            frameTime = SDL_GetTicks() - frameStart;
+         // Sleep until the next frame is due, waking up for input events
+         // only. Frames are due on a fixed schedule, so time spent in one
+         // frame is not added to the next.
+         chip8emu::FrameSkipper::Clock::time_point now = chip8emu::FrameSkipper::Clock::now();
+         while(now < chip8.frameDue() && chip8.speedTrottled() && chip8.running()) {
+            const auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(chip8.frameDue() - now);
+            chip8.handleEvents(std::max<std::uint32_t>(wait.count(), 1));
+            now = chip8emu::FrameSkipper::Clock::now();
          }
          
          if(!chip8.speedTrottled()) {
@@ -52,4 +426,4 @@ int main(int argc, char **argv)
    }
 
    return 0;
-}
\ No newline at end of file
+}
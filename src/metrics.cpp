@@ -0,0 +1,217 @@
+#include "metrics.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+
+namespace
+{
+
+const char* const PHASE_NAMES[] = { "cycle", "render", "events" };
+
+double seconds(chip8emu::Metrics::Clock::duration duration)
+{
+   return std::chrono::duration<double>(duration).count();
+}
+
+}
+
+chip8emu::Metrics::Timer::Timer(Metrics *metrics, Phase phase)
+   : mMetrics(metrics), mPhase(phase)
+{
+   if(mMetrics != nullptr) {
+      mStart = Clock::now();
+   }
+}
+
+chip8emu::Metrics::Timer::~Timer()
+{
+   if(mMetrics != nullptr) {
+      mMetrics->addPhase(mPhase, Clock::now() - mStart);
+   }
+}
+
+chip8emu::Metrics::Metrics(const std::string &filename, Clock::duration interval)
+   : mFilename(filename), mInterval(interval), mWindowStart(Clock::now()), mFrameStarted(false),
+     mFrameTimes(BUCKETS, 0), mFrames(0), mInstructions(0), mPresented(0), mSkipped(0), mDropped(0),
+     mInputEdges(0), mInputLatency(Clock::duration::zero()), mInputLatencyMax(Clock::duration::zero()),
+     mTotalInstructions(0), mTotalPresented(0), mTotalSkipped(0), mTotalDropped(0),
+     mTotalInputEdges(0), mTotalInputLatency(Clock::duration::zero()), mSnapshot {}
+{
+   std::fill(std::begin(mPhaseTime), std::end(mPhaseTime), Clock::duration::zero());
+   std::fill(std::begin(mTotalPhaseTime), std::end(mTotalPhaseTime), Clock::duration::zero());
+}
+
+chip8emu::Metrics::~Metrics()
+{
+
+}
+
+void chip8emu::Metrics::beginFrame(Clock::time_point now)
+{
+   if(mFrameStarted) {
+      const std::uint64_t us = std::chrono::duration_cast<std::chrono::microseconds>(now - mFrameStart).count();
+      mFrameTimes[std::min<std::uint64_t>(us / BUCKET_US, BUCKETS - 1)]++;
+      mFrames++;
+   }
+
+   mFrameStart = now;
+   mFrameStarted = true;
+}
+
+void chip8emu::Metrics::addPhase(Phase phase, Clock::duration duration)
+{
+   mPhaseTime[phase] += duration;
+}
+
+void chip8emu::Metrics::addInstructions(std::uint64_t count)
+{
+   mInstructions += count;
+}
+
+void chip8emu::Metrics::addPresented(std::uint64_t count)
+{
+   mPresented += count;
+}
+
+void chip8emu::Metrics::addSkipped(std::uint64_t count)
+{
+   mSkipped += count;
+}
+
+void chip8emu::Metrics::addDropped(std::uint64_t count)
+{
+   mDropped += count;
+}
+
+void chip8emu::Metrics::addInputLatency(Clock::duration latency)
+{
+   mInputEdges++;
+   mInputLatency += latency;
+   mInputLatencyMax = std::max(mInputLatencyMax, latency);
+}
+
+bool chip8emu::Metrics::update(Clock::time_point now, bool force)
+{
+   if(now - mWindowStart < mInterval && !force) {
+      return false;
+   }
+
+   const double window = std::max(seconds(now - mWindowStart), 1e-9);
+   const double frames = std::max<std::uint64_t>(mFrames, 1);
+
+   mSnapshot.instructionsPerSecond = mInstructions / window;
+   mSnapshot.framesPerSecond = mFrames / window;
+   mSnapshot.frameTimeP50 = percentile(0.5);
+   mSnapshot.frameTimeP99 = percentile(0.99);
+   mSnapshot.presentedPerSecond = mPresented / window;
+   mSnapshot.skippedPerSecond = mSkipped / window;
+   mSnapshot.droppedPerSecond = mDropped / window;
+
+   // Keep the last latencies while no key changes.
+   if(mInputEdges > 0) {
+      mSnapshot.inputLatencyAverage = seconds(mInputLatency) / mInputEdges;
+      mSnapshot.inputLatencyMax = seconds(mInputLatencyMax);
+   }
+
+   for(std::size_t phase = 0; phase < PHASE_COUNT; phase++) {
+      mSnapshot.phaseTime[phase] = seconds(mPhaseTime[phase]) / frames;
+      mTotalPhaseTime[phase] += mPhaseTime[phase];
+      mPhaseTime[phase] = Clock::duration::zero();
+   }
+
+   mTotalInstructions += mInstructions;
+   mTotalPresented += mPresented;
+   mTotalSkipped += mSkipped;
+   mTotalDropped += mDropped;
+   mTotalInputEdges += mInputEdges;
+   mTotalInputLatency += mInputLatency;
+
+   // Start the next interval.
+   std::fill(mFrameTimes.begin(), mFrameTimes.end(), 0);
+   mFrames = 0;
+   mInstructions = 0;
+   mPresented = 0;
+   mSkipped = 0;
+   mDropped = 0;
+   mInputEdges = 0;
+   mInputLatency = Clock::duration::zero();
+   mInputLatencyMax = Clock::duration::zero();
+   mWindowStart = now;
+
+   if(!mFilename.empty()) {
+      write(mFilename);
+   }
+
+   return true;
+}
+
+const chip8emu::Metrics::Snapshot& chip8emu::Metrics::snapshot() const
+{
+   return mSnapshot;
+}
+
+bool chip8emu::Metrics::write(const std::string &filename) const
+{
+   // Write a temporary file and rename it, so scrapers never see a partial file.
+   const std::string temporary = filename + ".tmp";
+   {
+      std::ofstream out(temporary);
+
+      out << "# HELP chip8_instructions_per_second Emulated instructions per second.\n"
+          << "# TYPE chip8_instructions_per_second gauge\n"
+          << "chip8_instructions_per_second " << mSnapshot.instructionsPerSecond << "\n"
+          << "# HELP chip8_instructions_total Emulated instructions.\n"
+          << "# TYPE chip8_instructions_total counter\n"
+          << "chip8_instructions_total " << mTotalInstructions << "\n"
+          << "# HELP chip8_frame_time_seconds Host frame time.\n"
+          << "# TYPE chip8_frame_time_seconds summary\n"
+          << "chip8_frame_time_seconds{quantile=\"0.5\"} " << mSnapshot.frameTimeP50 << "\n"
+          << "chip8_frame_time_seconds{quantile=\"0.99\"} " << mSnapshot.frameTimeP99 << "\n"
+          << "# HELP chip8_frames_presented_total Frames presented on screen.\n"
+          << "# TYPE chip8_frames_presented_total counter\n"
+          << "chip8_frames_presented_total " << mTotalPresented << "\n"
+          << "# HELP chip8_frames_skipped_total Emulated frames not presented, the screen being unchanged.\n"
+          << "# TYPE chip8_frames_skipped_total counter\n"
+          << "chip8_frames_skipped_total " << mTotalSkipped << "\n"
+          << "# HELP chip8_frames_dropped_total Changed frames not presented to keep emulation in time.\n"
+          << "# TYPE chip8_frames_dropped_total counter\n"
+          << "chip8_frames_dropped_total " << mTotalDropped << "\n"
+          << "# HELP chip8_input_latency_seconds Time from a key event to the emulated frame seeing it.\n"
+          << "# TYPE chip8_input_latency_seconds summary\n"
+          << "chip8_input_latency_seconds_sum " << seconds(mTotalInputLatency) << "\n"
+          << "chip8_input_latency_seconds_count " << mTotalInputEdges << "\n"
+          << "# HELP chip8_phase_seconds_total Host time spent per phase of the main loop.\n"
+          << "# TYPE chip8_phase_seconds_total counter\n";
+
+      for(std::size_t phase = 0; phase < PHASE_COUNT; phase++) {
+         out << "chip8_phase_seconds_total{phase=\"" << PHASE_NAMES[phase] << "\"} " << seconds(mTotalPhaseTime[phase]) << "\n";
+      }
+
+      if(!out) {
+         return false;
+      }
+   }
+
+   return std::rename(temporary.c_str(), filename.c_str()) == 0;
+}
+
+double chip8emu::Metrics::percentile(double fraction) const
+{
+   if(mFrames == 0) {
+      return 0.0;
+   }
+
+   // Report the upper edge of the bucket holding the percentile.
+   const std::uint64_t rank = static_cast<std::uint64_t>(fraction * (mFrames - 1));
+   std::uint64_t count = 0;
+
+   for(std::size_t bucket = 0; bucket < BUCKETS; bucket++) {
+      count += mFrameTimes[bucket];
+      if(count > rank) {
+         return (bucket + 1) * BUCKET_US * 1e-6;
+      }
+   }
+
+   return BUCKETS * BUCKET_US * 1e-6;
+}
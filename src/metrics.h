@@ -0,0 +1,119 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace chip8emu
+{
+
+// Performance counters of a running emulator. The host reports frames,
+// presented, skipped or dropped screens, executed instructions, input latencies and
+// the time spent in each phase of its loop; once per interval the counters are condensed into
+// a snapshot (rates and frame time percentiles) and optionally written to a
+// file in the Prometheus text format. Collecting costs a few clock reads per
+// host frame and frame times go into a fixed histogram, nothing is
+// allocated after construction.
+class Metrics
+{
+public:
+   typedef std::chrono::steady_clock Clock;
+
+   enum Phase
+   {
+      PHASE_CYCLE,
+      PHASE_RENDER,
+      PHASE_EVENTS,
+      PHASE_COUNT
+   };
+
+   struct Snapshot
+   {
+      double instructionsPerSecond;
+      double framesPerSecond; // Host frames, emulated frames while running
+      double frameTimeP50; // Host frame time percentiles in seconds
+      double frameTimeP99;
+      double presentedPerSecond;
+      double skippedPerSecond; // Frames without changes
+      double droppedPerSecond; // Changed frames not presented to keep up
+      double phaseTime[PHASE_COUNT]; // Average seconds per host frame
+      double inputLatencyAverage; // Seconds from key event to emulated frame
+      double inputLatencyMax;
+   };
+
+   // Measures the time until it goes out of scope, if metrics are enabled.
+   class Timer
+   {
+   public:
+      Timer(Metrics *metrics, Phase phase);
+      ~Timer();
+
+   private:
+      Metrics *mMetrics;
+      const Phase mPhase;
+      Clock::time_point mStart;
+   };
+
+   Metrics(const std::string &filename = "", Clock::duration interval = std::chrono::seconds(1));
+   ~Metrics();
+
+   // Marks the start of a host frame, the frame time being the distance to
+   // the previous start.
+   void beginFrame(Clock::time_point now);
+
+   void addPhase(Phase phase, Clock::duration duration);
+   void addInstructions(std::uint64_t count);
+   void addPresented(std::uint64_t count = 1);
+   void addSkipped(std::uint64_t count = 1);
+   void addDropped(std::uint64_t count = 1);
+   void addInputLatency(Clock::duration latency);
+
+   // Takes a new snapshot and writes the file once the interval has passed,
+   // or right away if forced. Returns true if the snapshot changed.
+   bool update(Clock::time_point now, bool force = false);
+
+   const Snapshot& snapshot() const;
+   bool write(const std::string &filename) const;
+
+private:
+   static const std::size_t BUCKETS = 2000; // Histogram buckets ...
+   static const std::uint32_t BUCKET_US = 50; // ... of 50us, the last one open ended
+
+   double percentile(double fraction) const;
+
+   const std::string mFilename;
+   const Clock::duration mInterval;
+
+   Clock::time_point mWindowStart; // Start of the current interval
+   Clock::time_point mFrameStart; // Start of the current host frame
+   bool mFrameStarted;
+
+   // Counters of the current interval
+   std::vector<std::uint32_t> mFrameTimes; // Histogram of host frame times
+   std::uint64_t mFrames;
+   std::uint64_t mInstructions;
+   std::uint64_t mPresented;
+   std::uint64_t mSkipped;
+   std::uint64_t mDropped;
+   Clock::duration mPhaseTime[PHASE_COUNT];
+   std::uint64_t mInputEdges;
+   Clock::duration mInputLatency;
+   Clock::duration mInputLatencyMax;
+
+   // Totals since construction, exported as Prometheus counters
+   std::uint64_t mTotalInstructions;
+   std::uint64_t mTotalPresented;
+   std::uint64_t mTotalSkipped;
+   std::uint64_t mTotalDropped;
+   Clock::duration mTotalPhaseTime[PHASE_COUNT];
+   std::uint64_t mTotalInputEdges;
+   Clock::duration mTotalInputLatency;
+
+   Snapshot mSnapshot;
+};
+
+}
+
+#endif // METRICS_H
@@ -0,0 +1,99 @@
+#include "overlay.h"
+
+#include "cpu.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+
+// Glyphs are 4x5 pixels, spaced by one pixel in both directions.
+const std::size_t GLYPH_WIDTH = 4;
+const std::size_t GLYPH_HEIGHT = 5;
+const std::size_t ADVANCE_X = GLYPH_WIDTH + 1;
+const std::size_t ADVANCE_Y = GLYPH_HEIGHT + 1;
+
+std::string formatRow(std::initializer_list<double> values)
+{
+   std::string row;
+
+   for(const double value : values) {
+      row += (row.empty() ? "" : " ") + std::to_string(static_cast<std::uint64_t>(std::llround(value)));
+   }
+
+   return row;
+}
+
+}
+
+chip8emu::Overlay::Overlay(std::uint32_t foreground, std::uint32_t background)
+   : mForeground(foreground), mBackground(background)
+{
+
+}
+
+chip8emu::Overlay::~Overlay()
+{
+
+}
+
+void chip8emu::Overlay::update(const Metrics::Snapshot &snapshot)
+{
+   mRows = {
+      formatRow({ snapshot.instructionsPerSecond, snapshot.framesPerSecond }),
+      formatRow({ snapshot.frameTimeP50 * 1e6, snapshot.frameTimeP99 * 1e6 }),
+      formatRow({ snapshot.presentedPerSecond, snapshot.skippedPerSecond, snapshot.droppedPerSecond }),
+      formatRow({ snapshot.phaseTime[Metrics::PHASE_CYCLE] * 1e6,
+                  snapshot.phaseTime[Metrics::PHASE_RENDER] * 1e6,
+                  snapshot.phaseTime[Metrics::PHASE_EVENTS] * 1e6 }),
+      formatRow({ snapshot.inputLatencyAverage * 1e6, snapshot.inputLatencyMax * 1e6 })
+   };
+}
+
+void chip8emu::Overlay::render(std::uint32_t *pixels, std::size_t pitch, std::size_t width, std::size_t height) const
+{
+   std::size_t columns = 0;
+   for(const std::string &row : mRows) {
+      columns = std::max(columns, row.size());
+   }
+
+   // Scale the font with the surface, 32 text rows fill its height.
+   const std::size_t scale = std::max<std::size_t>(height / (32 * ADVANCE_Y), 1);
+   const std::size_t boxWidth = std::min((columns * ADVANCE_X + 1) * scale, width);
+   const std::size_t boxHeight = std::min((mRows.size() * ADVANCE_Y + 1) * scale, height);
+
+   for(std::size_t y = 0; y < boxHeight; y++) {
+      std::fill_n(pixels + y * pitch, boxWidth, mBackground);
+   }
+
+   for(std::size_t row = 0; row < mRows.size(); row++) {
+      for(std::size_t column = 0; column < mRows[row].size(); column++) {
+         const std::size_t x = (column * ADVANCE_X + 1) * scale;
+         const std::size_t y = (row * ADVANCE_Y + 1) * scale;
+
+         if(x + GLYPH_WIDTH * scale <= width && y + GLYPH_HEIGHT * scale <= height) {
+            drawGlyph(mRows[row][column], pixels, pitch, x, y, scale);
+         }
+      }
+   }
+}
+
+void chip8emu::Overlay::drawGlyph(char c, std::uint32_t *pixels, std::size_t pitch, std::size_t x, std::size_t y, std::size_t scale) const
+{
+   if(c < '0' || c > '9') {
+      return;
+   }
+
+   const std::uint8_t *glyph = &FONTSET[(c - '0') * GLYPH_HEIGHT];
+
+   for(std::size_t gy = 0; gy < GLYPH_HEIGHT * scale; gy++) {
+      std::uint32_t *line = pixels + (y + gy) * pitch + x;
+
+      for(std::size_t gx = 0; gx < GLYPH_WIDTH * scale; gx++) {
+         if(glyph[gy / scale] & (0x80 >> (gx / scale))) {
+            line[gx] = mForeground;
+         }
+      }
+   }
+}
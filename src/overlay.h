@@ -0,0 +1,46 @@
+#ifndef OVERLAY_H
+#define OVERLAY_H
+
+#include "metrics.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace chip8emu
+{
+
+// Draws the metrics snapshot into the top left corner of the screen surface
+// using the 4x5 hex font of the machine, so only digits are available. The
+// rows show, in this order:
+//
+//    instructions and frames per second
+//    host frame time p50 p99 in microseconds
+//    presented, skipped and dropped frames per second
+//    cycle render events time per frame in microseconds
+//    input latency average max in microseconds
+class Overlay
+{
+public:
+   Overlay(std::uint32_t foreground, std::uint32_t background);
+   ~Overlay();
+
+   // Formats the rows once per snapshot instead of once per frame.
+   void update(const Metrics::Snapshot &snapshot);
+
+   // Renders into a surface of 'width' x 'height' pixels, 'pitch' being the
+   // row length in pixels.
+   void render(std::uint32_t *pixels, std::size_t pitch, std::size_t width, std::size_t height) const;
+
+private:
+   void drawGlyph(char c, std::uint32_t *pixels, std::size_t pitch, std::size_t x, std::size_t y, std::size_t scale) const;
+
+   const std::uint32_t mForeground; // ARGB color of the digits
+   const std::uint32_t mBackground; // ARGB color of the box behind them
+
+   std::vector<std::string> mRows;
+};
+
+}
+
+#endif // OVERLAY_H
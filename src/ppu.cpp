@@ -1,34 +1,344 @@
 #include "ppu.h"
 
+#include <algorithm>
 #include <iostream>
+#include <string>
 
-chip8emu::PPU::PPU(const std::uint8_t width, const std::uint8_t height)
-      : mWidth(width), mHeight(height), mGfx(width*height, 0)
+template <std::uint8_t Width, std::uint8_t Height, std::uint8_t Planes>
+const std::uint8_t chip8emu::Framebuffer<Width, Height, Planes>::WIDTH;
+template <std::uint8_t Width, std::uint8_t Height, std::uint8_t Planes>
+const std::uint8_t chip8emu::Framebuffer<Width, Height, Planes>::HEIGHT;
+template <std::uint8_t Width, std::uint8_t Height, std::uint8_t Planes>
+const std::uint8_t chip8emu::Framebuffer<Width, Height, Planes>::PLANES;
+template <std::uint8_t Width, std::uint8_t Height, std::uint8_t Planes>
+const std::size_t chip8emu::Framebuffer<Width, Height, Planes>::WORDS;
+template <std::uint8_t Width, std::uint8_t Height, std::uint8_t Planes>
+const std::size_t chip8emu::Framebuffer<Width, Height, Planes>::PLANE_WORDS;
+template <std::uint8_t Width, std::uint8_t Height, std::uint8_t Planes>
+const std::size_t chip8emu::Framebuffer<Width, Height, Planes>::SIZE;
+
+template <std::uint8_t Width, std::uint8_t Height, std::uint8_t Planes>
+bool chip8emu::Framebuffer<Width, Height, Planes>::drawSprite(std::uint64_t *gfx, std::uint8_t planes, std::uint8_t x, std::uint8_t y,
+                                                              const std::uint8_t *sprite, std::uint8_t rows, bool wide, bool clip)
+{
+   std::uint64_t collision = 0;
+
+   x %= Width;
+   y %= Height;
+
+   const std::uint8_t visible = clip ? std::min<std::uint8_t>(rows, Height - y) : rows;
+   const std::size_t word = x / 64;
+   const unsigned shift = x % 64;
+
+   for(std::uint8_t plane = 0; plane < Planes; plane++) {
+      if((planes & (1 << plane)) == 0) {
+         continue;
+      }
+
+      std::uint64_t *pixels = gfx + plane * PLANE_WORDS;
+
+      for(std::uint8_t i = 0; i < visible; i++) {
+         std::uint64_t *line = pixels + ((y + i) % Height) * WORDS;
+         const std::uint64_t bits = wide ? std::uint64_t(sprite[2 * i] << 8 | sprite[2 * i + 1]) << 48
+                                         : std::uint64_t(sprite[i]) << 56;
+
+         // Shift the sprite row into place, ...
+         const std::uint64_t head = bits >> shift;
+         collision |= line[word] & head;
+         line[word] ^= head;
+
+         // ... the pixels beyond the word moving into the next one or
+         // wrapping around the edge unless clipped.
+         if(shift > 0 && (word + 1 < WORDS || !clip)) {
+            const std::uint64_t tail = bits << (64 - shift);
+            std::uint64_t &next = line[(word + 1) % WORDS];
+
+            collision |= next & tail;
+            next ^= tail;
+         }
+      }
+
+      sprite += rows * (wide ? 2 : 1);
+   }
+
+   return collision != 0;
+}
+
+template <std::uint8_t Width, std::uint8_t Height, std::uint8_t Planes>
+void chip8emu::Framebuffer<Width, Height, Planes>::scrollDown(std::uint64_t *gfx, std::uint8_t planes, std::uint8_t rows)
+{
+   const std::size_t shifted = std::min<std::size_t>(rows, Height) * WORDS;
+
+   for(std::uint8_t plane = 0; plane < Planes; plane++) {
+      if(planes & (1 << plane)) {
+         std::uint64_t *pixels = gfx + plane * PLANE_WORDS;
+         std::copy_backward(pixels, pixels + PLANE_WORDS - shifted, pixels + PLANE_WORDS);
+         std::fill(pixels, pixels + shifted, 0);
+      }
+   }
+}
+
+template <std::uint8_t Width, std::uint8_t Height, std::uint8_t Planes>
+void chip8emu::Framebuffer<Width, Height, Planes>::scrollUp(std::uint64_t *gfx, std::uint8_t planes, std::uint8_t rows)
+{
+   const std::size_t shifted = std::min<std::size_t>(rows, Height) * WORDS;
+
+   for(std::uint8_t plane = 0; plane < Planes; plane++) {
+      if(planes & (1 << plane)) {
+         std::uint64_t *pixels = gfx + plane * PLANE_WORDS;
+         std::copy(pixels + shifted, pixels + PLANE_WORDS, pixels);
+         std::fill(pixels + PLANE_WORDS - shifted, pixels + PLANE_WORDS, 0);
+      }
+   }
+}
+
+template <std::uint8_t Width, std::uint8_t Height, std::uint8_t Planes>
+void chip8emu::Framebuffer<Width, Height, Planes>::scrollRight(std::uint64_t *gfx, std::uint8_t planes, std::uint8_t pixels)
 {
+   if(pixels == 0 || pixels >= 64) {
+      return;
+   }
+
+   for(std::uint8_t plane = 0; plane < Planes; plane++) {
+      if((planes & (1 << plane)) == 0) {
+         continue;
+      }
+
+      // Shift every row right, carrying the low bits into the next word.
+      for(std::uint64_t *line = gfx + plane * PLANE_WORDS; line < gfx + (plane + 1) * PLANE_WORDS; line += WORDS) {
+         for(std::size_t word = WORDS; word-- > 0;) {
+            line[word] = (line[word] >> pixels) | (word > 0 ? line[word - 1] << (64 - pixels) : 0);
+         }
+      }
+   }
+}
+
+template <std::uint8_t Width, std::uint8_t Height, std::uint8_t Planes>
+void chip8emu::Framebuffer<Width, Height, Planes>::scrollLeft(std::uint64_t *gfx, std::uint8_t planes, std::uint8_t pixels)
+{
+   if(pixels == 0 || pixels >= 64) {
+      return;
+   }
+
+   for(std::uint8_t plane = 0; plane < Planes; plane++) {
+      if((planes & (1 << plane)) == 0) {
+         continue;
+      }
+
+      // Shift every row left, carrying the high bits into the previous word.
+      for(std::uint64_t *line = gfx + plane * PLANE_WORDS; line < gfx + (plane + 1) * PLANE_WORDS; line += WORDS) {
+         for(std::size_t word = 0; word < WORDS; word++) {
+            line[word] = (line[word] << pixels) | (word + 1 < WORDS ? line[word + 1] >> (64 - pixels) : 0);
+         }
+      }
+   }
+}
+
+template <std::uint8_t Width, std::uint8_t Height, std::uint8_t Planes>
+void chip8emu::Framebuffer<Width, Height, Planes>::clear(std::uint64_t *gfx, std::uint8_t planes)
+{
+   for(std::uint8_t plane = 0; plane < Planes; plane++) {
+      if(planes & (1 << plane)) {
+         std::fill(gfx + plane * PLANE_WORDS, gfx + (plane + 1) * PLANE_WORDS, 0);
+      }
+   }
+}
+
+template struct chip8emu::Framebuffer<64, 32, 1>;
+template struct chip8emu::Framebuffer<128, 64, 1>;
+template struct chip8emu::Framebuffer<64, 32, 2>;
+template struct chip8emu::Framebuffer<128, 64, 2>;
+
+chip8emu::PPU::PPU(DisplayMode mode)
+      : mDrawFlag(false)
+{
+   setMode(mode);
 }
 
 chip8emu::PPU::~PPU()
 {
 }
 
-std::uint8_t& chip8emu::PPU::operator[](std::size_t idx)
-{ 
+void chip8emu::PPU::setMode(DisplayMode mode)
+{
+   mMode = mode;
+
+   withFramebuffer(mode, [this](auto framebuffer) {
+      typedef decltype(framebuffer) Layout;
+
+      mWidth = Layout::WIDTH;
+      mHeight = Layout::HEIGHT;
+      mPlanes = Layout::PLANES;
+      mWords = Layout::WORDS;
+      mSize = Layout::SIZE;
+   });
+
+   // Only the first plane is drawn until a rom selects others.
+   mSelected = 1;
+
+   std::fill(std::begin(mGfx), std::end(mGfx), 0);
    mDrawFlag = true;
-   return mGfx[idx]; 
 }
 
-const std::uint8_t& chip8emu::PPU::operator[](std::size_t idx) const 
+chip8emu::DisplayMode chip8emu::PPU::mode() const
+{
+   return mMode;
+}
+
+void chip8emu::PPU::setHires(bool hires)
+{
+   const std::uint8_t selected = mSelected;
+
+   if(mPlanes > 1) {
+      setMode(hires ? DISPLAY_XO_HIRES : DISPLAY_XO_LORES);
+   } else {
+      setMode(hires ? DISPLAY_HIRES : DISPLAY_LORES);
+   }
+
+   mSelected = selected;
+}
+
+bool chip8emu::PPU::isHires() const
+{
+   return mMode == DISPLAY_HIRES || mMode == DISPLAY_XO_HIRES;
+}
+
+std::uint8_t chip8emu::PPU::planes() const
+{
+   return mPlanes;
+}
+
+void chip8emu::PPU::selectPlanes(std::uint8_t planes)
+{
+   mSelected = planes & ((1 << mPlanes) - 1);
+}
+
+std::uint8_t chip8emu::PPU::selectedPlanes() const
 {
-   return mGfx[idx]; 
+   return mSelected;
+}
+
+bool chip8emu::PPU::pixel(std::uint8_t x, std::uint8_t y) const
+{
+   return color(x, y) != 0;
+}
+
+std::uint8_t chip8emu::PPU::color(std::uint8_t x, std::uint8_t y) const
+{
+   const std::size_t index = y * mWords + x / 64;
+   std::uint8_t color = 0;
+
+   for(std::uint8_t plane = 0; plane < mPlanes; plane++) {
+      color |= ((mGfx[plane * mHeight * mWords + index] >> (63 - x % 64)) & 1) << plane;
+   }
+
+   return color;
+}
+
+void chip8emu::PPU::setPixel(std::uint8_t x, std::uint8_t y, bool on)
+{
+   const std::uint64_t mask = std::uint64_t(1) << (63 - x % 64);
+   std::uint64_t &word = mGfx[y * mWords + x / 64];
+
+   word = on ? (word | mask) : (word & ~mask);
+   mDrawFlag = true;
+}
+
+bool chip8emu::PPU::drawSprite(std::uint8_t x, std::uint8_t y, const std::uint8_t *sprite, std::uint8_t rows, bool clip, bool wide)
+{
+   mDrawFlag = true;
+
+   return withFramebuffer(mMode, [&](auto framebuffer) {
+      return decltype(framebuffer)::drawSprite(mGfx, mSelected, x, y, sprite, rows, wide, clip);
+   });
+}
+
+void chip8emu::PPU::scrollDown(std::uint8_t rows)
+{
+   withFramebuffer(mMode, [&](auto framebuffer) { decltype(framebuffer)::scrollDown(mGfx, mSelected, rows); });
+   mDrawFlag = true;
+}
+
+void chip8emu::PPU::scrollUp(std::uint8_t rows)
+{
+   withFramebuffer(mMode, [&](auto framebuffer) { decltype(framebuffer)::scrollUp(mGfx, mSelected, rows); });
+   mDrawFlag = true;
+}
+
+void chip8emu::PPU::scrollRight(std::uint8_t pixels)
+{
+   withFramebuffer(mMode, [&](auto framebuffer) { decltype(framebuffer)::scrollRight(mGfx, mSelected, pixels); });
+   mDrawFlag = true;
+}
+
+void chip8emu::PPU::scrollLeft(std::uint8_t pixels)
+{
+   withFramebuffer(mMode, [&](auto framebuffer) { decltype(framebuffer)::scrollLeft(mGfx, mSelected, pixels); });
+   mDrawFlag = true;
+}
+
+const std::uint64_t* chip8emu::PPU::row(std::uint8_t y, std::uint8_t plane) const
+{
+   return &mGfx[(plane * mHeight + y) * mWords];
+}
+
+void chip8emu::PPU::setRow(std::uint8_t y, const std::uint64_t *words, std::uint8_t plane)
+{
+   std::copy(words, words + mWords, &mGfx[(plane * mHeight + y) * mWords]);
+   mDrawFlag = true;
+}
+
+std::size_t chip8emu::PPU::wordsPerRow() const
+{
+   return mWords;
+}
+
+const std::uint64_t* chip8emu::PPU::data() const
+{
+   return mGfx;
+}
+
+void chip8emu::PPU::setData(const std::uint64_t *words)
+{
+   std::copy(words, words + mSize, mGfx);
+   mDrawFlag = true;
+}
+
+std::size_t chip8emu::PPU::size() const
+{
+   return mSize;
+}
+
+std::uint64_t chip8emu::PPU::hash() const
+{
+   // Multiply-xorshift over the packed rows, cheap enough to run every frame.
+   std::uint64_t h = 0x9E3779B97F4A7C15ULL ^ mSize;
+   for(std::size_t i = 0; i < mSize; i++) {
+      h = (h ^ mGfx[i]) * 0xFF51AFD7ED558CCDULL;
+      h ^= h >> 32;
+   }
+
+   return h;
 }
 
 void chip8emu::PPU::clear()
 {
-   // Clear all pixel.
-   std::fill(mGfx.begin(), mGfx.end(), 0);
+   // Clear all pixel of the selected planes.
+   withFramebuffer(mMode, [this](auto framebuffer) { decltype(framebuffer)::clear(mGfx, mSelected); });
+   mDrawFlag = true;
+}
+
+void chip8emu::PPU::copyFrom(const PPU &other)
+{
+   if(mMode != other.mMode) {
+      setMode(other.mMode);
+   }
+
+   mSelected = other.mSelected;
+   std::copy(other.mGfx, other.mGfx + other.mSize, mGfx);
    mDrawFlag = true;
 }
-   
+
 bool chip8emu::PPU::isDrawFlagSet()
 {
    return mDrawFlag;
@@ -39,28 +349,35 @@ void chip8emu::PPU::resetDrawFlag()
    mDrawFlag = false;
 }
 
-const std::uint8_t chip8emu::PPU::width()
+std::uint8_t chip8emu::PPU::width() const
 {
    return mWidth;
 }
 
-const std::uint8_t chip8emu::PPU::height()
+std::uint8_t chip8emu::PPU::height() const
 {
    return mHeight;
 }
 
-void chip8emu::PPU::debugGfx()
+void chip8emu::PPU::dumpGfx(std::ostream &out) const
 {
-   std::cout << "\033[2J\033[1;1H";
+   // Assemble the rows and hand them over at once.
+   std::string text;
+   text.reserve((mWidth + 1) * mHeight);
+
    for(std::uint8_t y = 0; y < mHeight; ++y) {
       for(std::uint8_t x = 0; x < mWidth; ++x) {
-         if (mGfx[y * mWidth + x]) {
-            std::cout << " ";
-         } else {
-            std::cout << "#";
-         }
+         text += pixel(x, y) ? '#' : ' ';
       }
 
-      std::cout << std::endl;
+      text += '\n';
    }
-}
\ No newline at end of file
+
+   out << text << std::flush;
+}
+
+void chip8emu::PPU::debugGfx()
+{
+   std::cout << "\033[2J\033[1;1H";
+   dumpGfx(std::cout);
+}
@@ -3,36 +3,150 @@
 
 #include <vector>
 #include <cstdint>
+#include <ostream>
 
 namespace chip8emu
 {
 
+// Display modes of CHIP-8 and its extensions.
+enum DisplayMode
+{
+   DISPLAY_LORES, // 64x32, one plane
+   DISPLAY_HIRES, // 128x64, one plane (SUPER-CHIP)
+   DISPLAY_XO_LORES, // 64x32, two planes (XO-CHIP)
+   DISPLAY_XO_HIRES // 128x64, two planes (XO-CHIP)
+};
+
+// Framebuffer layout of one display mode. Pixel rows are packed into 64 bit
+// words, the leftmost pixel being the most significant bit of the first
+// word, and the planes follow each other. Strides and masks are constants,
+// every mode being its own instantiation.
+//
+// The operations take the packed pixels and a mask of the planes they apply
+// to, one bit per plane.
+template <std::uint8_t Width, std::uint8_t Height, std::uint8_t Planes>
+struct Framebuffer
+{
+   static const std::uint8_t WIDTH = Width;
+   static const std::uint8_t HEIGHT = Height;
+   static const std::uint8_t PLANES = Planes;
+   static const std::size_t WORDS = Width / 64; // Words per pixel row
+   static const std::size_t PLANE_WORDS = WORDS * Height;
+   static const std::size_t SIZE = PLANE_WORDS * Planes;
+
+   // Xors a sprite, 8 or (if 'wide') 16 pixels wide, onto every plane in
+   // 'planes' and returns true on collision. The sprite data of the planes
+   // follow each other. The position always wraps, the sprite itself wraps
+   // around the edges or is clipped at them if 'clip' is set.
+   static bool drawSprite(std::uint64_t *gfx, std::uint8_t planes, std::uint8_t x, std::uint8_t y,
+                          const std::uint8_t *sprite, std::uint8_t rows, bool wide, bool clip);
+
+   // Scrolls by whole rows or by 'pixels' columns, shifting in blank pixels.
+   static void scrollDown(std::uint64_t *gfx, std::uint8_t planes, std::uint8_t rows);
+   static void scrollUp(std::uint64_t *gfx, std::uint8_t planes, std::uint8_t rows);
+   static void scrollRight(std::uint64_t *gfx, std::uint8_t planes, std::uint8_t pixels);
+   static void scrollLeft(std::uint64_t *gfx, std::uint8_t planes, std::uint8_t pixels);
+
+   static void clear(std::uint64_t *gfx, std::uint8_t planes);
+};
+
+typedef Framebuffer<64, 32, 1> LoresFramebuffer;
+typedef Framebuffer<128, 64, 1> HiresFramebuffer;
+typedef Framebuffer<64, 32, 2> XoLoresFramebuffer;
+typedef Framebuffer<128, 64, 2> XoHiresFramebuffer;
+
+// Calls 'f' with the framebuffer layout of 'mode', so the operation is
+// compiled once per mode instead of computing strides per pixel.
+template <typename F>
+auto withFramebuffer(DisplayMode mode, F f) -> decltype(f(LoresFramebuffer()))
+{
+   switch(mode) {
+   case DISPLAY_HIRES:
+      return f(HiresFramebuffer());
+   case DISPLAY_XO_LORES:
+      return f(XoLoresFramebuffer());
+   case DISPLAY_XO_HIRES:
+      return f(XoHiresFramebuffer());
+   default:
+      return f(LoresFramebuffer());
+   }
+}
+
 class PPU
 {
 public:
-   PPU(const std::uint8_t width, const std::uint8_t height);
+   static const std::uint8_t LORES_WIDTH = LoresFramebuffer::WIDTH;
+   static const std::uint8_t LORES_HEIGHT = LoresFramebuffer::HEIGHT;
+   static const std::size_t MAX_WORDS = XoHiresFramebuffer::SIZE; // Largest framebuffer
+
+   PPU(DisplayMode mode = DISPLAY_LORES);
    ~PPU();
-   
+
+   // Switches the display mode and clears the screen. The mode is picked by
+   // the CPU when it loads a rom and switched by 00FE/00FF.
+   void setMode(DisplayMode mode);
+   DisplayMode mode() const;
+   void setHires(bool hires);
+   bool isHires() const;
+   std::uint8_t planes() const;
+
+   // Planes drawn, scrolled and cleared, one bit per plane (XO-CHIP FN01).
+   void selectPlanes(std::uint8_t planes);
+   std::uint8_t selectedPlanes() const;
+
    void clear();
-   
+
+   // Copies the mode and pixels of another PPU.
+   void copyFrom(const PPU &other);
+
    bool isDrawFlagSet();
    void resetDrawFlag();
-   
-   const std::uint8_t width();
-   const std::uint8_t height();
-   
-   std::uint8_t& operator[](std::size_t idx);
-   const std::uint8_t& operator[](std::size_t idx) const;
-   
+
+   std::uint8_t width() const;
+   std::uint8_t height() const;
+
+   // A pixel is lit if it is set in any plane, its color holding one bit
+   // per plane.
+   bool pixel(std::uint8_t x, std::uint8_t y) const;
+   std::uint8_t color(std::uint8_t x, std::uint8_t y) const;
+   void setPixel(std::uint8_t x, std::uint8_t y, bool on);
+
+   // Xors a sprite onto the selected planes and returns true on collision,
+   // see Framebuffer::drawSprite().
+   bool drawSprite(std::uint8_t x, std::uint8_t y, const std::uint8_t *sprite, std::uint8_t rows, bool clip = false, bool wide = false);
+
+   void scrollDown(std::uint8_t rows);
+   void scrollUp(std::uint8_t rows);
+   void scrollRight(std::uint8_t pixels);
+   void scrollLeft(std::uint8_t pixels);
+
+   // Packed pixel rows of a plane, see Framebuffer.
+   const std::uint64_t* row(std::uint8_t y, std::uint8_t plane = 0) const;
+   void setRow(std::uint8_t y, const std::uint64_t *words, std::uint8_t plane = 0);
+   std::size_t wordsPerRow() const;
+
+   // All planes of the current mode, size() words.
+   const std::uint64_t* data() const;
+   void setData(const std::uint64_t *words);
+   std::size_t size() const;
+
+   std::uint64_t hash() const;
+
+   void dumpGfx(std::ostream &out) const;
    void debugGfx();
-   
+
 private:
    bool mDrawFlag; // Drawing flag
-   
-   const std::uint8_t mWidth;
-   const std::uint8_t mHeight;
-   
-   std::vector<std::uint8_t> mGfx; // Display of 64x32 px
+
+   DisplayMode mMode;
+   std::uint8_t mWidth;
+   std::uint8_t mHeight;
+   std::uint8_t mPlanes;
+   std::uint8_t mSelected; // Mask of the selected planes
+   std::size_t mWords; // Words per pixel row
+   std::size_t mSize; // Words of all planes
+
+   std::uint64_t mGfx[MAX_WORDS]; // One bit per pixel, see Framebuffer
 };
 
 }
@@ -0,0 +1,101 @@
+#include "quirks.h"
+
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+bool chip8emu::parseQuirks(const std::string &name, Quirks &quirks)
+{
+   if(name == "default") {
+      quirks = QUIRKS_DEFAULT;
+   } else if(name == "cosmac") {
+      quirks = QUIRKS_COSMAC;
+   } else if(name == "schip") {
+      quirks = QUIRKS_SCHIP;
+   } else if(name == "xochip") {
+      quirks = QUIRKS_XOCHIP;
+   } else {
+      return false;
+   }
+
+   return true;
+}
+
+const char* chip8emu::quirksName(Quirks quirks)
+{
+   switch(quirks) {
+   case QUIRKS_COSMAC:
+      return "cosmac";
+   case QUIRKS_SCHIP:
+      return "schip";
+   case QUIRKS_XOCHIP:
+      return "xochip";
+   default:
+      return "default";
+   }
+}
+
+std::uint64_t chip8emu::hashRom(const std::uint8_t *data, std::size_t size)
+{
+   std::uint64_t hash = 0xCBF29CE484222325ull;
+
+   for(std::size_t i = 0; i < size; i++) {
+      hash = (hash ^ data[i]) * 0x100000001B3ull;
+   }
+
+   return hash;
+}
+
+chip8emu::QuirkDatabase::QuirkDatabase()
+{
+
+}
+
+chip8emu::QuirkDatabase::~QuirkDatabase()
+{
+
+}
+
+bool chip8emu::QuirkDatabase::load(const std::string &filename)
+{
+   std::ifstream file(filename);
+   if(!file.is_open()) {
+      return false;
+   }
+
+   std::string line;
+   while(std::getline(file, line)) {
+      std::istringstream in(line);
+      std::string hash;
+      std::string profile;
+      Quirks quirks;
+
+      if(!(in >> hash >> profile) || hash[0] == '#' || !parseQuirks(profile, quirks)) {
+         continue;
+      }
+
+      char *end = nullptr;
+      const std::uint64_t value = std::strtoull(hash.c_str(), &end, 16);
+      if(*end == '\0') {
+         add(value, quirks);
+      }
+   }
+
+   return true;
+}
+
+void chip8emu::QuirkDatabase::add(std::uint64_t hash, Quirks quirks)
+{
+   mRoms[hash] = quirks;
+}
+
+chip8emu::Quirks chip8emu::QuirkDatabase::lookup(std::uint64_t hash, Quirks fallback) const
+{
+   std::map<std::uint64_t, Quirks>::const_iterator it = mRoms.find(hash);
+   return it != mRoms.end() ? it->second : fallback;
+}
+
+std::size_t chip8emu::QuirkDatabase::size() const
+{
+   return mRoms.size();
+}
@@ -0,0 +1,68 @@
+#ifndef QUIRKS_H
+#define QUIRKS_H
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace chip8emu
+{
+
+// Behavior profiles of the CHIP-8 interpreters roms were written for.
+enum Quirks
+{
+   QUIRKS_DEFAULT, // Behavior of earlier releases, used for unknown roms
+   QUIRKS_COSMAC, // Original COSMAC VIP interpreter
+   QUIRKS_SCHIP, // SUPER-CHIP 1.1 on the HP48
+   QUIRKS_XOCHIP // Octo's XO-CHIP
+};
+
+// Compile-time quirk set. The CPU instantiates its interpreter once per
+// profile, so quirks are resolved while compiling instead of per instruction.
+template <bool ShiftVy, bool IncrementI, bool ClipSprites, bool JumpVx, bool ResetVf, bool XoExtensions>
+struct QuirkSet
+{
+   static const bool SHIFT_VY = ShiftVy; // 8XY6/8XYE shift VY into VX instead of VX
+   static const bool INCREMENT_I = IncrementI; // FX55/FX65 leave I behind the last register
+   static const bool CLIP_SPRITES = ClipSprites; // DXYN clips at the edges instead of wrapping
+   static const bool JUMP_VX = JumpVx; // BNNN jumps to XNN plus VX instead of NNN plus V0
+   static const bool RESET_VF = ResetVf; // 8XY1/8XY2/8XY3 clear VF
+   static const bool XO_EXTENSIONS = XoExtensions; // XO-CHIP opcodes (00DN, 5XY2, 5XY3, F000, FN01)
+   static const std::uint16_t ADDRESS_MASK = XoExtensions ? 0xFFFF : 0x0FFF; // Memory wraps at 64K or 4K
+};
+
+typedef QuirkSet<false, false, false, false, false, false> DefaultQuirks;
+typedef QuirkSet<true, true, true, false, true, false> CosmacQuirks;
+typedef QuirkSet<false, false, true, true, false, false> SchipQuirks;
+typedef QuirkSet<true, true, false, false, false, true> XochipQuirks;
+
+bool parseQuirks(const std::string &name, Quirks &quirks);
+const char* quirksName(Quirks quirks);
+
+// 64 bit FNV-1a hash identifying a rom image.
+std::uint64_t hashRom(const std::uint8_t *data, std::size_t size);
+
+// Maps rom hashes to quirk profiles. The database is a text file with one
+// rom per line, "<hash> <profile> [title]", the hash written as 16 hex
+// digits and the profile as cosmac, schip or xochip. Lines starting with
+// '#' are ignored.
+class QuirkDatabase
+{
+public:
+   QuirkDatabase();
+   ~QuirkDatabase();
+
+   bool load(const std::string &filename);
+   void add(std::uint64_t hash, Quirks quirks);
+
+   Quirks lookup(std::uint64_t hash, Quirks fallback = QUIRKS_DEFAULT) const;
+   std::size_t size() const;
+
+private:
+   std::map<std::uint64_t, Quirks> mRoms;
+};
+
+}
+
+#endif // QUIRKS_H
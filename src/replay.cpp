@@ -0,0 +1,309 @@
+#include "replay.h"
+
+#include "delta.h"
+
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+
+namespace
+{
+
+const char MAGIC[4] = { 'C', '8', 'R', 'P' };
+const std::uint8_t VERSION = 1;
+const std::size_t KEYFRAME_HEADER = 8; // State and difference size
+
+void putU32(std::vector<std::uint8_t> &out, std::uint32_t value)
+{
+   for(unsigned shift = 0; shift < 32; shift += 8) {
+      out.push_back(static_cast<std::uint8_t>(value >> shift));
+   }
+}
+
+void writeU16(std::ostream &out, std::uint16_t value)
+{
+   out.put(static_cast<char>(value & 0xFF));
+   out.put(static_cast<char>(value >> 8));
+}
+
+void writeU32(std::ostream &out, std::uint32_t value)
+{
+   writeU16(out, value & 0xFFFF);
+   writeU16(out, value >> 16);
+}
+
+void writeU64(std::ostream &out, std::uint64_t value)
+{
+   writeU32(out, value & 0xFFFFFFFF);
+   writeU32(out, value >> 32);
+}
+
+std::uint64_t readUint(std::istream &in, std::size_t bytes)
+{
+   std::uint8_t buffer[8] = {};
+   in.read(reinterpret_cast<char*>(buffer), bytes);
+
+   std::uint64_t value = 0;
+   for(std::size_t i = 0; i < bytes; i++) {
+      value |= static_cast<std::uint64_t>(buffer[i]) << (8 * i);
+   }
+
+   return value;
+}
+
+std::uint32_t getU32(const std::uint8_t *bytes)
+{
+   return bytes[0] | bytes[1] << 8 | bytes[2] << 16 | static_cast<std::uint32_t>(bytes[3]) << 24;
+}
+
+}
+
+chip8emu::ReplayWriter::ReplayWriter(std::uint64_t romHash, std::uint32_t keyframeInterval)
+   : mRomHash(romHash), mKeyframeInterval(std::max<std::uint32_t>(keyframeInterval, 1)), mQuirks(QUIRKS_DEFAULT),
+     mCyclesPerFrame(0)
+{
+
+}
+
+chip8emu::ReplayWriter::~ReplayWriter()
+{
+
+}
+
+void chip8emu::ReplayWriter::addFrame(const CPU &cpu, std::uint16_t keys)
+{
+   if(mInput.size() % mKeyframeInterval == 0) {
+      std::ostringstream out;
+      cpu.saveState(out);
+      const std::string state = out.str();
+
+      // The first keyframe is stored in full, as difference to nothing.
+      if(mKeyframes.empty()) {
+         mBase = state;
+         mQuirks = cpu.quirks();
+         mCyclesPerFrame = cpu.cyclesPerFrame();
+      }
+
+      std::vector<std::uint8_t> difference;
+      encodeDelta(reinterpret_cast<const std::uint8_t*>(mBase.data()), mKeyframes.empty() ? 0 : mBase.size(),
+                  reinterpret_cast<const std::uint8_t*>(state.data()), state.size(), difference);
+
+      std::vector<std::uint8_t> keyframe;
+      keyframe.reserve(KEYFRAME_HEADER + difference.size());
+      putU32(keyframe, state.size());
+      putU32(keyframe, difference.size());
+      keyframe.insert(keyframe.end(), difference.begin(), difference.end());
+      mKeyframes.push_back(std::move(keyframe));
+   }
+
+   mInput.push_back(keys);
+}
+
+bool chip8emu::ReplayWriter::save(const std::string &filename) const
+{
+   std::ofstream out(filename, std::ios::out | std::ios::binary);
+
+   out.write(MAGIC, sizeof(MAGIC));
+   out.put(VERSION);
+   out.put(static_cast<char>(mQuirks));
+   writeU32(out, mCyclesPerFrame);
+   writeU64(out, mRomHash);
+   writeU32(out, mInput.size());
+   writeU32(out, mKeyframeInterval);
+   writeU32(out, mKeyframes.size());
+
+   for(const std::uint16_t keys : mInput) {
+      writeU16(out, keys);
+   }
+
+   // Keyframes follow the index.
+   std::uint64_t offset = static_cast<std::uint64_t>(out.tellp()) + mKeyframes.size() * sizeof(std::uint64_t);
+   for(const std::vector<std::uint8_t> &keyframe : mKeyframes) {
+      writeU64(out, offset);
+      offset += keyframe.size();
+   }
+
+   for(const std::vector<std::uint8_t> &keyframe : mKeyframes) {
+      out.write(reinterpret_cast<const char*>(keyframe.data()), keyframe.size());
+   }
+
+   return static_cast<bool>(out);
+}
+
+std::uint32_t chip8emu::ReplayWriter::frames() const
+{
+   return mInput.size();
+}
+
+std::size_t chip8emu::ReplayWriter::keyframes() const
+{
+   return mKeyframes.size();
+}
+
+chip8emu::Replay::Replay()
+   : mQuirks(QUIRKS_DEFAULT), mCyclesPerFrame(0), mRomHash(0), mKeyframeInterval(1)
+{
+
+}
+
+chip8emu::Replay::~Replay()
+{
+
+}
+
+bool chip8emu::Replay::open(const std::string &filename)
+{
+   mFile.close();
+   mFile.clear();
+   mFile.open(filename, std::ios::in | std::ios::binary);
+
+   char magic[sizeof(MAGIC)];
+   if(!mFile.read(magic, sizeof(magic)) || std::memcmp(magic, MAGIC, sizeof(MAGIC)) != 0 || mFile.get() != VERSION) {
+      return false;
+   }
+
+   const int quirks = mFile.get();
+   if(quirks < QUIRKS_DEFAULT || quirks > QUIRKS_XOCHIP) {
+      return false;
+   }
+
+   mQuirks = static_cast<Quirks>(quirks);
+   mCyclesPerFrame = readUint(mFile, 4);
+   mRomHash = readUint(mFile, 8);
+   const std::uint32_t frames = readUint(mFile, 4);
+   mKeyframeInterval = readUint(mFile, 4);
+   const std::uint32_t keyframes = readUint(mFile, 4);
+
+   // A session has a keyframe at each interval start before its end.
+   if(!mFile || mKeyframeInterval == 0 || keyframes != (frames + mKeyframeInterval - 1) / mKeyframeInterval
+      || keyframes == 0) {
+      return false;
+   }
+
+   // The input and index must fit into the file, so a damaged header cannot
+   // ask for huge buffers.
+   const std::streamoff start = mFile.tellg();
+   mFile.seekg(0, std::ios::end);
+   const std::uint64_t remaining = mFile.tellg() - start;
+   mFile.seekg(start);
+   if(frames * 2ull + keyframes * 8ull > remaining) {
+      return false;
+   }
+
+   mInput.resize(frames);
+   for(std::uint16_t &keys : mInput) {
+      keys = readUint(mFile, 2);
+   }
+
+   mOffsets.resize(keyframes);
+   for(std::uint64_t &offset : mOffsets) {
+      offset = readUint(mFile, 8);
+   }
+
+   // Later keyframes are differences to the first one.
+   mBase.clear();
+   return mFile && keyframe(0, mBase);
+}
+
+chip8emu::Quirks chip8emu::Replay::quirks() const
+{
+   return mQuirks;
+}
+
+std::uint32_t chip8emu::Replay::cyclesPerFrame() const
+{
+   return mCyclesPerFrame;
+}
+
+std::uint64_t chip8emu::Replay::romHash() const
+{
+   return mRomHash;
+}
+
+std::uint32_t chip8emu::Replay::frames() const
+{
+   return mInput.size();
+}
+
+std::uint32_t chip8emu::Replay::keyframeInterval() const
+{
+   return mKeyframeInterval;
+}
+
+std::size_t chip8emu::Replay::keyframes() const
+{
+   return mOffsets.size();
+}
+
+const std::vector<std::uint16_t>& chip8emu::Replay::input() const
+{
+   return mInput;
+}
+
+std::size_t chip8emu::Replay::keyframeFor(std::uint32_t frame) const
+{
+   return std::min<std::size_t>(frame / mKeyframeInterval, mOffsets.size() - 1);
+}
+
+bool chip8emu::Replay::keyframe(std::size_t index, std::string &state)
+{
+   if(index >= mOffsets.size()) {
+      return false;
+   }
+
+   mFile.clear();
+   mFile.seekg(mOffsets[index]);
+
+   std::uint8_t header[KEYFRAME_HEADER];
+   if(!mFile.read(reinterpret_cast<char*>(header), sizeof(header))) {
+      return false;
+   }
+
+   // States are a few KB, anything larger is a damaged file.
+   const std::uint32_t size = getU32(header);
+   const std::uint32_t length = getU32(header + 4);
+   if(size > 2 * MEMORY_SIZE || length > 4 * MEMORY_SIZE) {
+      return false;
+   }
+
+   std::vector<std::uint8_t> difference(length);
+   if(!mFile.read(reinterpret_cast<char*>(difference.data()), length)) {
+      return false;
+   }
+
+   // The first keyframe is a difference to nothing.
+   state.resize(size);
+   return decodeDelta(reinterpret_cast<const std::uint8_t*>(mBase.data()), index > 0 ? mBase.size() : 0,
+                      difference.data(), length, reinterpret_cast<std::uint8_t*>(&state[0]), size);
+}
+
+std::int64_t chip8emu::Replay::seek(CPU &cpu, std::uint32_t frame)
+{
+   if(frame > frames()) {
+      return -1;
+   }
+
+   // Load the nearest keyframe, ...
+   const std::size_t index = keyframeFor(frame);
+   std::string state;
+   if(!keyframe(index, state)) {
+      return -1;
+   }
+
+   std::istringstream in(state);
+   cpu.setQuirks(mQuirks);
+   if(!cpu.loadState(in)) {
+      return -1;
+   }
+
+   // ... which starts a frame, and emulate up to the requested one.
+   cpu.setCyclesPerFrame(mCyclesPerFrame);
+
+   std::uint32_t current = index * mKeyframeInterval;
+   for(; current < frame; current++) {
+      cpu.setKeys(mInput[current]);
+      cpu.runFrames(1);
+   }
+
+   return frame - index * static_cast<std::int64_t>(mKeyframeInterval);
+}
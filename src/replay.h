@@ -0,0 +1,104 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include "cpu.h"
+#include "quirks.h"
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace chip8emu
+{
+
+// Replay files hold a recorded session: the pad input of every frame and,
+// every 'keyframe interval' frames, the complete machine state as written
+// by CPU::saveState(). The first keyframe holds the machine right after
+// loading the rom and seeding it, so no rom is needed to replay. Later
+// keyframes are stored as their difference to the first one, and an index
+// of their file offsets lets any frame be reached by loading one keyframe
+// and emulating at most one interval.
+//
+// All numbers are little endian:
+//
+//    "C8RP", u8 version, u8 quirks, u32 cycles per frame, u64 rom hash,
+//    u32 frames, u32 keyframe interval, u32 keyframes,
+//    u16 keys per frame,
+//    u64 file offset per keyframe,
+//    per keyframe: u32 state size, u32 difference size, difference
+
+// Records a session frame by frame.
+class ReplayWriter
+{
+public:
+   ReplayWriter(std::uint64_t romHash, std::uint32_t keyframeInterval);
+   ~ReplayWriter();
+
+   // Adds the keys of the next frame, to be called before emulating it.
+   // Keyframes are taken from 'cpu', whose quirks and frame length apply
+   // to the whole recording.
+   void addFrame(const CPU &cpu, std::uint16_t keys);
+
+   bool save(const std::string &filename) const;
+
+   std::uint32_t frames() const;
+   std::size_t keyframes() const;
+
+private:
+   const std::uint64_t mRomHash;
+   const std::uint32_t mKeyframeInterval;
+   Quirks mQuirks;
+   std::uint32_t mCyclesPerFrame;
+
+   std::vector<std::uint16_t> mInput;
+   std::string mBase; // First keyframe, the reference of the others
+   std::vector<std::vector<std::uint8_t>> mKeyframes; // Sizes and differences as stored
+};
+
+// Reads a replay file, loading keyframes only when seeking.
+class Replay
+{
+public:
+   Replay();
+   ~Replay();
+
+   // Reads the header, the input and the keyframe index.
+   bool open(const std::string &filename);
+
+   Quirks quirks() const;
+   std::uint32_t cyclesPerFrame() const;
+   std::uint64_t romHash() const;
+   std::uint32_t frames() const;
+   std::uint32_t keyframeInterval() const;
+   std::size_t keyframes() const;
+   const std::vector<std::uint16_t>& input() const;
+
+   // Index of the last keyframe at or before 'frame'.
+   std::size_t keyframeFor(std::uint32_t frame) const;
+
+   // Reads a keyframe as written by CPU::saveState().
+   bool keyframe(std::size_t index, std::string &state);
+
+   // Puts 'cpu' into the state before emulating 'frame', up to frames()
+   // for the end of the session, by loading the nearest keyframe and
+   // emulating the frames after it. Returns the frames emulated, or -1 if
+   // the frame is out of range or the file is damaged.
+   std::int64_t seek(CPU &cpu, std::uint32_t frame);
+
+private:
+   std::ifstream mFile;
+
+   Quirks mQuirks;
+   std::uint32_t mCyclesPerFrame;
+   std::uint64_t mRomHash;
+   std::uint32_t mKeyframeInterval;
+
+   std::vector<std::uint16_t> mInput;
+   std::vector<std::uint64_t> mOffsets; // File offset per keyframe
+   std::string mBase; // First keyframe, decoded on open
+};
+
+}
+
+#endif // REPLAY_H
@@ -0,0 +1,243 @@
+#include "scaler.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace
+{
+
+// Extra pixels behind the expanded row, so the last pixel may be written
+// with full vector stores.
+const std::size_t ROW_SLACK = 8;
+
+// Colors of pixels set in the second plane only and in both planes.
+const std::uint32_t PLANE2_COLOR = 0xFFFF6600;
+const std::uint32_t BOTH_PLANES_COLOR = 0xFF662200;
+
+}
+
+chip8emu::Scaler::Scaler(Filter filter, std::uint8_t scale, std::uint32_t light, std::uint32_t dark)
+   : mFilter(filter), mFactor(factor(filter)),
+     mScale(std::max<std::uint8_t>(scale / mFactor, 1) * mFactor),
+     mPalette {dark, light, PLANE2_COLOR, BOTH_PLANES_COLOR}, mCost(0), mFrames(0)
+{
+   // Scale2x: P is the center pixel, A above, B right, C left and D below.
+   for(std::uint8_t i = 0; i < 32; i++) {
+      const bool P = i & 16, A = i & 8, B = i & 4, C = i & 2, D = i & 1;
+      const bool E0 = C == A && C != D && A != B ? A : P;
+      const bool E1 = A == B && A != C && B != D ? B : P;
+      const bool E2 = D == C && D != B && C != A ? C : P;
+      const bool E3 = B == D && B != A && D != C ? D : P;
+      mScale2x[i] = E0 | E1 << 1 | E2 << 2 | E3 << 3;
+   }
+
+   // Scale3x: A-I is the 3x3 neighborhood in row order, E being the center.
+   for(std::uint16_t i = 0; i < 512; i++) {
+      const bool A = i & 256, B = i & 128, C = i & 64, D = i & 32, E = i & 16;
+      const bool F = i & 8, G = i & 4, H = i & 2, I = i & 1;
+      const bool E0 = D == B && B != F && D != H ? D : E;
+      const bool E1 = (D == B && B != F && D != H && E != C) || (B == F && B != D && F != H && E != A) ? B : E;
+      const bool E2 = B == F && B != D && F != H ? F : E;
+      const bool E3 = (D == B && B != F && D != H && E != G) || (D == H && D != B && H != F && E != A) ? D : E;
+      const bool E5 = (B == F && B != D && F != H && E != I) || (H == F && D != H && B != F && E != C) ? F : E;
+      const bool E6 = D == H && D != B && H != F ? D : E;
+      const bool E7 = (D == H && D != B && H != F && E != I) || (H == F && D != H && B != F && E != G) ? H : E;
+      const bool E8 = H == F && D != H && B != F ? F : E;
+      mScale3x[i] = E0 | E1 << 1 | E2 << 2 | E3 << 3 | E << 4 | E5 << 5 | E6 << 6 | E7 << 7 | E8 << 8;
+   }
+}
+
+chip8emu::Scaler::~Scaler()
+{
+}
+
+bool chip8emu::Scaler::parseFilter(const std::string &name, Filter &filter)
+{
+   if(name == "none") {
+      filter = FILTER_NONE;
+   } else if(name == "scale2x") {
+      filter = FILTER_SCALE2X;
+   } else if(name == "scale3x") {
+      filter = FILTER_SCALE3X;
+   } else {
+      return false;
+   }
+
+   return true;
+}
+
+std::uint8_t chip8emu::Scaler::factor(Filter filter)
+{
+   switch(filter) {
+   case FILTER_SCALE2X: return 2;
+   case FILTER_SCALE3X: return 3;
+   default: return 1;
+   }
+}
+
+std::uint8_t chip8emu::Scaler::scale() const
+{
+   return mScale;
+}
+
+std::uint8_t chip8emu::Scaler::repeat(std::uint8_t width) const
+{
+   return std::max<std::size_t>(mScale / mFactor * PPU::LORES_WIDTH / width, 1);
+}
+
+void chip8emu::Scaler::outputSize(std::uint8_t width, std::uint8_t height, int &outWidth, int &outHeight) const
+{
+   outWidth = width * mFactor * repeat(width);
+   outHeight = height * mFactor * repeat(width);
+}
+
+template <typename Layout>
+void chip8emu::Scaler::unpack(const std::uint64_t *gfx)
+{
+   // Gather the plane bits of every pixel with the strides of the mode.
+   for(std::size_t y = 0; y < Layout::HEIGHT; y++) {
+      std::uint8_t *dst = &mPixels[y * Layout::WIDTH];
+
+      for(std::size_t x = 0; x < Layout::WIDTH; x++) {
+         std::uint8_t color = 0;
+         for(std::size_t plane = 0; plane < Layout::PLANES; plane++) {
+            const std::uint64_t word = gfx[plane * Layout::PLANE_WORDS + y * Layout::WORDS + x / 64];
+            color |= ((word >> (63 - x % 64)) & 1) << plane;
+         }
+
+         dst[x] = color;
+      }
+   }
+}
+
+void chip8emu::Scaler::render(const PPU &ppu, std::uint32_t *pixels, std::size_t pitch)
+{
+   const auto start = std::chrono::steady_clock::now();
+
+   const std::uint8_t w = ppu.width(), h = ppu.height();
+   const std::size_t width = w * mFactor;
+   const std::size_t height = h * mFactor;
+   const std::uint8_t times = repeat(w);
+
+   // Unpack the display in the layout of its mode, ...
+   mPixels.resize(w * h);
+   withFramebuffer(ppu.mode(), [this, &ppu](auto framebuffer) { unpack<decltype(framebuffer)>(ppu.data()); });
+
+   // ... build the (filtered) image, ...
+   switch(mFilter) {
+   case FILTER_SCALE2X:
+      mImage.assign(width * height, 0);
+      filterScale2x(w, h, ppu.planes());
+      break;
+   case FILTER_SCALE3X:
+      mImage.assign(width * height, 0);
+      filterScale3x(w, h, ppu.planes());
+      break;
+   default:
+      mImage.swap(mPixels);
+      break;
+   }
+
+   // ... expand every row once and copy it to all surface rows it covers.
+   mRow.resize(width * times + ROW_SLACK);
+   for(std::size_t y = 0; y < height; y++) {
+      expandRow(&mImage[y * width], width, times, mRow.data());
+
+      for(std::uint8_t i = 0; i < times; i++) {
+         std::memcpy(pixels + (y * times + i) * pitch, mRow.data(), width * times * sizeof(std::uint32_t));
+      }
+   }
+
+   mCost += std::chrono::steady_clock::now() - start;
+   mFrames++;
+}
+
+void chip8emu::Scaler::filterScale2x(std::uint8_t w, std::uint8_t h, std::uint8_t planes)
+{
+   const std::size_t width = w * 2;
+
+   for(std::uint8_t plane = 0; plane < planes; plane++) {
+      const auto pixel = [this, w, plane](int x, int y) -> bool { return (mPixels[y * w + x] >> plane) & 1; };
+
+      for(std::uint8_t y = 0; y < h; y++) {
+         for(std::uint8_t x = 0; x < w; x++) {
+            // Neighbors outside of the screen repeat the edge pixel.
+            const bool P = pixel(x, y);
+            const bool A = y > 0 ? pixel(x, y - 1) : P;
+            const bool B = x + 1 < w ? pixel(x + 1, y) : P;
+            const bool C = x > 0 ? pixel(x - 1, y) : P;
+            const bool D = y + 1 < h ? pixel(x, y + 1) : P;
+            const std::uint8_t out = mScale2x[P << 4 | A << 3 | B << 2 | C << 1 | D];
+
+            std::uint8_t *dst = &mImage[y * 2 * width + x * 2];
+            dst[0] |= (out & 1) << plane;
+            dst[1] |= ((out >> 1) & 1) << plane;
+            dst[width] |= ((out >> 2) & 1) << plane;
+            dst[width + 1] |= ((out >> 3) & 1) << plane;
+         }
+      }
+   }
+}
+
+void chip8emu::Scaler::filterScale3x(std::uint8_t w, std::uint8_t h, std::uint8_t planes)
+{
+   const std::size_t width = w * 3;
+
+   for(std::uint8_t plane = 0; plane < planes; plane++) {
+      for(int y = 0; y < h; y++) {
+         for(int x = 0; x < w; x++) {
+            // Gather the 3x3 neighborhood, repeating the edge pixels.
+            std::uint16_t index = 0;
+            for(int dy = -1; dy <= 1; dy++) {
+               for(int dx = -1; dx <= 1; dx++) {
+                  const int nx = std::min(std::max(x + dx, 0), w - 1);
+                  const int ny = std::min(std::max(y + dy, 0), h - 1);
+                  index = index << 1 | ((mPixels[ny * w + nx] >> plane) & 1);
+               }
+            }
+
+            const std::uint16_t out = mScale3x[index];
+            for(int i = 0; i < 9; i++) {
+               mImage[(y * 3 + i / 3) * width + x * 3 + i % 3] |= ((out >> i) & 1) << plane;
+            }
+         }
+      }
+   }
+}
+
+void chip8emu::Scaler::expandRow(const std::uint8_t *src, std::size_t width, std::uint8_t repeat, std::uint32_t *dst) const
+{
+   // Every source pixel is written with overlapping full vector stores, the
+   // next pixel overwriting whatever spilled over.
+   for(std::size_t x = 0; x < width; x++) {
+      const std::uint32_t color = mPalette[src[x] & 3];
+      std::uint32_t *out = dst + x * repeat;
+
+#if defined(__AVX2__)
+      const __m256i c = _mm256_set1_epi32(color);
+      for(std::uint8_t i = 0; i < repeat; i += 8) {
+         _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), c);
+      }
+#elif defined(__SSE2__)
+      const __m128i c = _mm_set1_epi32(color);
+      for(std::uint8_t i = 0; i < repeat; i += 4) {
+         _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), c);
+      }
+#else
+      std::fill_n(out, repeat, color);
+#endif
+   }
+}
+
+void chip8emu::Scaler::reportCost(std::ostream &out) const
+{
+   static const char *names[] = { "none", "scale2x", "scale3x" };
+   const double micros = std::chrono::duration<double, std::micro>(mCost).count();
+
+   out << "Scaler " << names[mFilter] << " at " << static_cast<int>(mScale) << "x: "
+       << (mFrames ? micros / mFrames : 0.0) << "us per frame over " << mFrames << " frames" << std::endl;
+}
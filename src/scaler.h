@@ -0,0 +1,77 @@
+#ifndef SCALER_H
+#define SCALER_H
+
+#include "ppu.h"
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace chip8emu
+{
+
+// Software scaler expanding the framebuffer into an ARGB8888 surface at an
+// integer scale, optionally smoothing edges with Scale2x or Scale3x first.
+// Used instead of drawing one rectangle per pixel on hosts without a GPU.
+//
+// Hires displays are scaled half as much as lores ones, so both cover about
+// the same surface. Displays with two planes are filtered plane by plane and
+// colored by a four color palette.
+class Scaler
+{
+public:
+   enum Filter
+   {
+      FILTER_NONE,
+      FILTER_SCALE2X,
+      FILTER_SCALE3X
+   };
+
+   Scaler(Filter filter, std::uint8_t scale, std::uint32_t light, std::uint32_t dark);
+   ~Scaler();
+
+   static bool parseFilter(const std::string &name, Filter &filter);
+   static std::uint8_t factor(Filter filter);
+
+   // The effective scale of lores displays, rounded down to a multiple of
+   // the filter factor.
+   std::uint8_t scale() const;
+
+   // Size of the surface a display of width x height pixels is rendered to.
+   void outputSize(std::uint8_t width, std::uint8_t height, int &outWidth, int &outHeight) const;
+
+   // Renders the framebuffer into 'pixels', 'pitch' being the row length in
+   // pixels. The surface must have the outputSize() of the display.
+   void render(const PPU &ppu, std::uint32_t *pixels, std::size_t pitch);
+
+   void reportCost(std::ostream &out) const;
+
+private:
+   std::uint8_t repeat(std::uint8_t width) const;
+
+   template <typename Layout> void unpack(const std::uint64_t *gfx);
+   void filterScale2x(std::uint8_t w, std::uint8_t h, std::uint8_t planes);
+   void filterScale3x(std::uint8_t w, std::uint8_t h, std::uint8_t planes);
+   void expandRow(const std::uint8_t *src, std::size_t width, std::uint8_t repeat, std::uint32_t *dst) const;
+
+   const Filter mFilter;
+   const std::uint8_t mFactor; // Resolution multiplier of the filter
+   const std::uint8_t mScale; // Total scale of the output surface
+   std::uint32_t mPalette[4]; // ARGB colors indexed by the plane bits of a pixel
+
+   std::uint8_t mScale2x[32]; // 2x2 output bits indexed by P,A,B,C,D
+   std::uint16_t mScale3x[512]; // 3x3 output bits indexed by the 3x3 neighborhood
+
+   std::vector<std::uint8_t> mPixels; // Display, one color per byte
+   std::vector<std::uint8_t> mImage; // Filtered image, one color per byte
+   std::vector<std::uint32_t> mRow; // Expanded row, padded for wide stores
+
+   std::chrono::steady_clock::duration mCost; // Accumulated render time
+   std::uint64_t mFrames; // Number of rendered frames
+};
+
+}
+
+#endif // SCALER_H
@@ -0,0 +1,437 @@
+#include "search.h"
+
+#include "delta.h"
+#include "ppu.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+namespace
+{
+
+// Mixes the machine state word by word, much faster than hashing bytes.
+std::uint64_t hashState(const chip8emu::MachineState &state)
+{
+   const std::uint8_t *bytes = reinterpret_cast<const std::uint8_t *>(&state);
+   std::uint64_t hash = 0x9E3779B97F4A7C15ull;
+
+   for(std::size_t offset = 0; offset + sizeof(std::uint64_t) <= sizeof(state); offset += sizeof(std::uint64_t)) {
+      std::uint64_t word;
+      std::memcpy(&word, bytes + offset, sizeof(word));
+      hash = (hash ^ (word * 0xC2B2AE3D27D4EB4Full)) * 0x9E3779B97F4A7C15ull;
+      hash ^= hash >> 29;
+   }
+
+   return hash;
+}
+
+}
+
+chip8emu::Search::StateSet::StateSet(std::size_t capacity)
+   : mHashes(capacity), mFrames(capacity), mSize(0)
+{
+   for(std::size_t i = 0; i < capacity; i++) {
+      mHashes[i].store(0, std::memory_order_relaxed);
+      mFrames[i].store(0, std::memory_order_relaxed);
+   }
+}
+
+bool chip8emu::Search::StateSet::insert(std::uint64_t hash, std::uint32_t frames)
+{
+   // 0 marks free slots and frames not stored yet.
+   hash = hash != 0 ? hash : 1;
+   frames++;
+   const std::size_t mask = mHashes.size() - 1;
+
+   for(std::size_t slot = hash & mask, probes = 0; probes < mHashes.size(); slot = (slot + 1) & mask, probes++) {
+      std::uint64_t current = mHashes[slot].load(std::memory_order_acquire);
+
+      if(current == 0) {
+         // Keep a quarter free, probing a full table gets slow.
+         if(mSize.load(std::memory_order_relaxed) >= mHashes.size() / 4 * 3) {
+            return false;
+         }
+
+         // Claim the slot, unless another thread took it meanwhile.
+         if(mHashes[slot].compare_exchange_strong(current, hash, std::memory_order_acq_rel)) {
+            mFrames[slot].store(frames, std::memory_order_release);
+            mSize++;
+            return true;
+         }
+      }
+
+      if(current == hash) {
+         // Lower the frames unless the state was already reached as fast.
+         std::uint32_t best = mFrames[slot].load(std::memory_order_acquire);
+         while(best == 0 || frames < best) {
+            if(best == 0) {
+               // The claiming thread has not stored its frames yet.
+               std::this_thread::yield();
+               best = mFrames[slot].load(std::memory_order_acquire);
+            } else if(mFrames[slot].compare_exchange_weak(best, frames, std::memory_order_acq_rel)) {
+               return true;
+            }
+         }
+
+         return false;
+      }
+   }
+
+   return false;
+}
+
+std::uint64_t chip8emu::Search::StateSet::size() const
+{
+   return mSize.load(std::memory_order_relaxed);
+}
+
+bool chip8emu::Search::ItemOrder::operator()(const Item &a, const Item &b) const
+{
+   // The heap keeps the greatest item on top, so 'a < b' means b goes first.
+   if(mode == MODE_BEST_FIRST && a.score != b.score) {
+      return a.score < b.score;
+   }
+
+   return a.frames > b.frames;
+}
+
+namespace
+{
+
+std::size_t setCapacity(std::size_t states)
+{
+   // Room for the children of all explored states, within reason.
+   const std::size_t wanted = std::min<std::size_t>(states, std::size_t(1) << 26) * 4;
+   std::size_t capacity = 1024;
+   while(capacity < wanted) {
+      capacity <<= 1;
+   }
+
+   return capacity;
+}
+
+}
+
+chip8emu::Search::Search(const Config &config)
+   : mConfig(config), mPool(config.threads), mQueues(mPool.threads()), mSeen(setCapacity(config.maxStates)),
+     mNodeCount(0), mPending(0), mExpanded(0), mQueued(0), mCompressedBytes(0), mStopping(false),
+     mBestNode(NO_NODE), mBestFrames(0), mBestScore(0), mSolved(false), mFrameLimit(config.maxFrames)
+{
+   if(mConfig.actions.empty()) {
+      mConfig.actions.push_back(0);
+      for(std::uint8_t key = 0; key < 16; key++) {
+         mConfig.actions.push_back(1 << key);
+      }
+   }
+
+   mConfig.maxSegment = std::min<std::uint32_t>(std::max<std::uint32_t>(mConfig.maxSegment, 1), 0xFFFF);
+
+   // Every queued state and every improvement of the best trace takes a node.
+   mNodes.resize(setCapacity(config.maxStates) / 4 * 3 + 256 + mConfig.maxFrames);
+
+   const std::unique_ptr<CPU> cpu = createCpu();
+   cpu->saveMachine(mInitial);
+   mBestScore = score(*cpu);
+}
+
+chip8emu::Search::~Search()
+{
+
+}
+
+bool chip8emu::Search::run(const ProgressCallback &progress, std::chrono::milliseconds interval)
+{
+   // States hold the first 4K of memory only, see MachineState.
+   if(mConfig.quirks == QUIRKS_XOCHIP) {
+      std::cerr << "Error: Search does not support the XO-CHIP profile" << std::endl;
+      return false;
+   }
+
+   mStart = std::chrono::steady_clock::now();
+
+   // Start from the freshly loaded machine.
+   Item root;
+   compress(mInitial, root.state);
+   root.node = NO_NODE;
+   root.frames = 0;
+   root.score = mBestScore;
+   mSeen.insert(hashState(mInitial), 0);
+   mPending = 1;
+   push(0, std::move(root));
+
+   mPool.parallelFor(mQueues.size(), 1, [&](std::size_t begin, std::size_t end) {
+      for(std::size_t worker = begin; worker < end; worker++) {
+         work(worker, progress, interval);
+      }
+   });
+
+   if(progress) {
+      progress(this->progress());
+   }
+
+   std::lock_guard<std::mutex> lock(mBestMutex);
+   return mSolved;
+}
+
+void chip8emu::Search::stop()
+{
+   mStopping = true;
+}
+
+chip8emu::Search::Progress chip8emu::Search::progress() const
+{
+   Progress progress;
+   progress.expanded = mExpanded;
+   progress.unique = mSeen.size();
+   progress.queued = mQueued;
+   progress.compressedBytes = mCompressedBytes;
+
+   const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - mStart).count();
+   progress.statesPerSecond = progress.expanded / std::max(seconds, 1e-9);
+
+   std::lock_guard<std::mutex> lock(mBestMutex);
+   progress.solved = mSolved;
+   progress.bestFrames = mBestFrames;
+   progress.bestScore = mBestScore;
+
+   return progress;
+}
+
+std::vector<std::uint16_t> chip8emu::Search::bestTrace() const
+{
+   std::lock_guard<std::mutex> lock(mBestMutex);
+   std::vector<std::uint16_t> trace(mBestFrames);
+
+   // Fill the trace backwards, walking from the last segment to the root.
+   std::size_t end = trace.size();
+   for(std::uint32_t node = mBestNode; node != NO_NODE; node = mNodes[node].parent) {
+      const std::size_t frames = std::min<std::size_t>(mNodes[node].frames, end);
+      std::fill(trace.begin() + (end - frames), trace.begin() + end, mNodes[node].keys);
+      end -= frames;
+   }
+
+   return trace;
+}
+
+void chip8emu::Search::work(std::size_t worker, const ProgressCallback &progress, std::chrono::milliseconds interval)
+{
+   const std::unique_ptr<CPU> cpu = createCpu();
+   std::chrono::steady_clock::time_point reported = std::chrono::steady_clock::now();
+
+   Item item;
+   while(!mStopping) {
+      if(!pop(worker, item)) {
+         if(mPending == 0) {
+            break;
+         }
+
+         std::this_thread::yield();
+         continue;
+      }
+
+      // States as slow as the best solution cannot lead to a better one.
+      if(item.frames < mFrameLimit) {
+         expand(*cpu, worker, item);
+
+         if(++mExpanded >= mConfig.maxStates) {
+            mStopping = true;
+         }
+      }
+
+      // Children are queued before, so the count only drops to 0 once all
+      // work is done.
+      mPending--;
+
+      if(worker == 0 && progress && std::chrono::steady_clock::now() - reported >= interval) {
+         reported = std::chrono::steady_clock::now();
+         progress(this->progress());
+      }
+   }
+}
+
+bool chip8emu::Search::pop(std::size_t worker, Item &item)
+{
+   const ItemOrder order {mConfig.mode};
+
+   // Take from the own queue first, then steal from the others.
+   for(std::size_t i = 0; i < mQueues.size(); i++) {
+      Queue &queue = mQueues[(worker + i) % mQueues.size()];
+      std::lock_guard<std::mutex> lock(queue.mutex);
+
+      if(!queue.heap.empty()) {
+         std::pop_heap(queue.heap.begin(), queue.heap.end(), order);
+         item = std::move(queue.heap.back());
+         queue.heap.pop_back();
+
+         mQueued--;
+         mCompressedBytes -= item.state.size();
+         return true;
+      }
+   }
+
+   return false;
+}
+
+void chip8emu::Search::push(std::size_t worker, Item &&item)
+{
+   const ItemOrder order {mConfig.mode};
+
+   mQueued++;
+   mCompressedBytes += item.state.size();
+
+   Queue &queue = mQueues[worker];
+   std::lock_guard<std::mutex> lock(queue.mutex);
+   queue.heap.push_back(std::move(item));
+   std::push_heap(queue.heap.begin(), queue.heap.end(), order);
+}
+
+void chip8emu::Search::expand(CPU &cpu, std::size_t worker, const Item &item)
+{
+   // Scratch states, large enough to keep off the stack.
+   thread_local std::unique_ptr<MachineState> base = std::make_unique<MachineState>();
+   thread_local std::unique_ptr<MachineState> before = std::make_unique<MachineState>();
+
+   decompress(item.state, *base);
+
+   for(const std::uint16_t keys : mConfig.actions) {
+      cpu.loadMachine(*base);
+      cpu.setKeys(keys);
+
+      std::uint32_t frames = item.frames;
+      std::uint32_t segment = 0;
+      std::uint8_t best = item.score;
+
+      // Hold the keys up to the next frame reading the pad, which is the
+      // next decision point, or until the segment gets too long.
+      while(frames < mFrameLimit) {
+         if(segment > 0) {
+            cpu.saveMachine(*before);
+         }
+
+         const std::uint32_t events = cpu.runFrames(1);
+         frames++;
+         segment++;
+
+         if(reached(cpu)) {
+            record(item.node, keys, segment, frames, 0, true);
+            break;
+         }
+
+         // Without a goal the best trace is the first one reaching a score.
+         if(mConfig.goalAddress == NO_ADDRESS && score(cpu) > best) {
+            best = score(cpu);
+            record(item.node, keys, segment, frames, best, false);
+         }
+
+         const bool decision = segment > 1 && (events & EVENT_KEY_QUERY) != 0;
+         if(!decision && segment < mConfig.maxSegment && frames < mFrameLimit) {
+            continue;
+         }
+
+         // Rewind to the start of the frame reading the pad.
+         if(decision) {
+            frames--;
+            segment--;
+            cpu.loadMachine(*before);
+         } else {
+            cpu.saveMachine(*before);
+         }
+
+         // Sequences at the frame limit are complete.
+         if(frames < mFrameLimit && mSeen.insert(hashState(*before), frames)) {
+            const std::uint32_t node = allocateNode(item.node, keys, segment);
+            if(node != NO_NODE) {
+               Item next;
+               compress(*before, next.state);
+               next.node = node;
+               next.frames = frames;
+               next.score = score(cpu);
+
+               mPending++;
+               push(worker, std::move(next));
+            }
+         }
+
+         break;
+      }
+   }
+}
+
+bool chip8emu::Search::reached(const CPU &cpu) const
+{
+   return mConfig.goalAddress != NO_ADDRESS && cpu.peek(mConfig.goalAddress) == mConfig.goalValue;
+}
+
+std::uint8_t chip8emu::Search::score(const CPU &cpu) const
+{
+   return mConfig.scoreAddress != NO_ADDRESS ? cpu.peek(mConfig.scoreAddress) : 0;
+}
+
+void chip8emu::Search::record(std::uint32_t parent, std::uint16_t keys, std::uint32_t segment, std::uint32_t frames, std::uint8_t score, bool goal)
+{
+   std::lock_guard<std::mutex> lock(mBestMutex);
+
+   if(goal) {
+      if(mSolved && frames >= mBestFrames) {
+         return;
+      }
+   } else if(score <= mBestScore) {
+      return;
+   }
+
+   const std::uint32_t node = allocateNode(parent, keys, segment);
+   if(node == NO_NODE) {
+      return;
+   }
+
+   mBestNode = node;
+   mBestFrames = frames;
+
+   if(goal) {
+      mSolved = true;
+      mFrameLimit = frames - 1;
+   } else {
+      mBestScore = score;
+   }
+}
+
+std::uint32_t chip8emu::Search::allocateNode(std::uint32_t parent, std::uint16_t keys, std::uint32_t frames)
+{
+   const std::uint32_t node = mNodeCount++;
+   if(node >= mNodes.size()) {
+      mNodeCount = mNodes.size();
+      return NO_NODE;
+   }
+
+   mNodes[node] = Node {parent, keys, static_cast<std::uint16_t>(frames)};
+   return node;
+}
+
+std::unique_ptr<chip8emu::CPU> chip8emu::Search::createCpu() const
+{
+   std::unique_ptr<CPU> cpu = std::make_unique<CPU>(std::make_shared<PPU>());
+   cpu->setQuirks(mConfig.quirks);
+   cpu->setCyclesPerFrame(mConfig.cyclesPerFrame);
+   cpu->seed(mConfig.seed);
+   cpu->loadRom(mConfig.rom);
+
+   return cpu;
+}
+
+void chip8emu::Search::compress(const MachineState &state, std::vector<std::uint8_t> &out) const
+{
+   // Store the difference to the initial machine, most of the memory never
+   // changes.
+   out.clear();
+   encodeDelta(reinterpret_cast<const std::uint8_t *>(&mInitial), sizeof(mInitial),
+               reinterpret_cast<const std::uint8_t *>(&state), sizeof(state), out);
+   out.shrink_to_fit();
+}
+
+void chip8emu::Search::decompress(const std::vector<std::uint8_t> &in, MachineState &state) const
+{
+   decodeDelta(reinterpret_cast<const std::uint8_t *>(&mInitial), sizeof(mInitial), in.data(), in.size(),
+               reinterpret_cast<std::uint8_t *>(&state), sizeof(state));
+}
@@ -0,0 +1,185 @@
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include "cpu.h"
+#include "threadpool.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace chip8emu
+{
+
+// Searches the input sequences of a rom for one reaching a goal, e.g. the
+// fastest solution of a puzzle.
+//
+// The machine is forked only at decision points: frames reading the pad
+// (EX9E, EXA1, FX0A). From a decision point every action is tried, each one
+// held until the next decision point, while frames in between are emulated
+// once. Open states are explored breadth-first (fewest frames first) or
+// best-first (highest score byte first) by one worker per pool thread, each
+// with its own queue and stealing from the others once it runs dry.
+//
+// Reached states are deduplicated by a hash of RAM, registers, stack, timers
+// and framebuffer in a lock-free hash set, a state reached again in fewer
+// frames being explored again. Queued states are stored as the difference to
+// the initial machine, run length encoded, and the number of explored states
+// is bounded, so memory stays bounded too.
+class Search
+{
+public:
+   static const std::uint16_t NO_ADDRESS = 0xFFFF;
+
+   enum Mode
+   {
+      MODE_BFS, // Fewest frames first, finds the fastest solution
+      MODE_BEST_FIRST // Highest score first, then fewest frames
+   };
+
+   struct Config
+   {
+      std::string rom;
+      Quirks quirks = QUIRKS_DEFAULT; // Any but QUIRKS_XOCHIP
+      std::uint32_t seed = 0;
+      std::uint32_t cyclesPerFrame = 10;
+      Mode mode = MODE_BFS;
+      std::uint16_t goalAddress = NO_ADDRESS; // The goal is reached once this byte ...
+      std::uint8_t goalValue = 1; // ... equals this value
+      std::uint16_t scoreAddress = NO_ADDRESS; // Byte maximized by best-first search
+      std::uint32_t maxFrames = 3600; // Input sequences are at most this long
+      std::uint32_t maxSegment = 600; // Frames emulated between two decision points at most
+      std::size_t maxStates = 1000000; // States explored at most
+      std::vector<std::uint16_t> actions; // Pad masks tried, no keys and every single key if empty
+      std::size_t threads = 0; // Worker threads, 0 for one per hardware thread
+   };
+
+   struct Progress
+   {
+      std::uint64_t expanded; // States explored
+      std::uint64_t unique; // Distinct states reached
+      std::uint64_t queued; // States waiting to be explored
+      std::uint64_t compressedBytes; // Memory held by queued states
+      double statesPerSecond;
+      bool solved;
+      std::uint32_t bestFrames; // Length of the best trace
+      std::uint8_t bestScore;
+   };
+
+   typedef std::function<void(const Progress &progress)> ProgressCallback;
+
+   Search(const Config &config);
+   ~Search();
+
+   // Runs until the state space is exhausted or the state limit is reached,
+   // calling 'progress' about once per 'interval' from one of the workers.
+   // Returns true if the goal was reached, false without searching for the
+   // XO-CHIP profile.
+   bool run(const ProgressCallback &progress = nullptr, std::chrono::milliseconds interval = std::chrono::seconds(1));
+
+   // Stops a running search, e.g. from a signal handler.
+   void stop();
+
+   Progress progress() const;
+
+   // The best input sequence found: the shortest one reaching the goal, or
+   // without a goal the one reaching the highest score, as one pad mask per
+   // frame for saveInputLog(). Replaying it requires the same seed, quirks
+   // and cycles per frame.
+   std::vector<std::uint16_t> bestTrace() const;
+
+private:
+   static const std::uint32_t NO_NODE = 0xFFFFFFFF;
+
+   // Explored input segment: 'keys' held for 'frames' frames after the
+   // segment of 'parent'.
+   struct Node
+   {
+      std::uint32_t parent;
+      std::uint16_t keys;
+      std::uint16_t frames;
+   };
+
+   struct Item
+   {
+      std::vector<std::uint8_t> state; // Compressed machine state
+      std::uint32_t node;
+      std::uint32_t frames; // Frames since the start
+      std::uint8_t score;
+   };
+
+   struct ItemOrder
+   {
+      Mode mode;
+      bool operator()(const Item &a, const Item &b) const;
+   };
+
+   struct Queue
+   {
+      std::mutex mutex;
+      std::vector<Item> heap;
+   };
+
+   // Open addressing set of state hashes, holding the fewest frames each
+   // state was reached in.
+   class StateSet
+   {
+   public:
+      StateSet(std::size_t capacity);
+
+      // Returns true if the state is new or was reached in fewer frames.
+      bool insert(std::uint64_t hash, std::uint32_t frames);
+      std::uint64_t size() const;
+
+   private:
+      std::vector<std::atomic<std::uint64_t>> mHashes;
+      std::vector<std::atomic<std::uint32_t>> mFrames;
+      std::atomic<std::uint64_t> mSize;
+   };
+
+   void work(std::size_t worker, const ProgressCallback &progress, std::chrono::milliseconds interval);
+   bool pop(std::size_t worker, Item &item);
+   void push(std::size_t worker, Item &&item);
+   void expand(CPU &cpu, std::size_t worker, const Item &item);
+   bool reached(const CPU &cpu) const;
+   std::uint8_t score(const CPU &cpu) const;
+   void record(std::uint32_t parent, std::uint16_t keys, std::uint32_t segment, std::uint32_t frames, std::uint8_t score, bool goal);
+   std::uint32_t allocateNode(std::uint32_t parent, std::uint16_t keys, std::uint32_t frames);
+   std::unique_ptr<CPU> createCpu() const;
+
+   void compress(const MachineState &state, std::vector<std::uint8_t> &out) const;
+   void decompress(const std::vector<std::uint8_t> &in, MachineState &state) const;
+
+   Config mConfig;
+   ThreadPool mPool;
+   MachineState mInitial; // Reference of the compressed states
+
+   std::vector<Queue> mQueues; // One per worker
+   StateSet mSeen;
+   std::vector<Node> mNodes;
+   std::atomic<std::uint32_t> mNodeCount;
+
+   std::atomic<std::uint64_t> mPending; // Queued or expanding states
+   std::atomic<std::uint64_t> mExpanded;
+   std::atomic<std::uint64_t> mQueued;
+   std::atomic<std::uint64_t> mCompressedBytes;
+   std::atomic<bool> mStopping;
+
+   mutable std::mutex mBestMutex;
+   std::uint32_t mBestNode; // Last segment of the best trace
+   std::uint32_t mBestFrames;
+   std::uint8_t mBestScore;
+   bool mSolved;
+   std::atomic<std::uint32_t> mFrameLimit; // Frames of the best solution, or the limit
+
+   std::chrono::steady_clock::time_point mStart;
+};
+
+}
+
+#endif // SEARCH_H
@@ -0,0 +1,353 @@
+#include "server.h"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+namespace
+{
+
+void putU16(std::vector<std::uint8_t> &out, std::uint16_t value)
+{
+   out.push_back(value & 0xFF);
+   out.push_back(value >> 8);
+}
+
+void putU32(std::vector<std::uint8_t> &out, std::uint32_t value)
+{
+   for(int shift = 0; shift < 32; shift += 8) {
+      out.push_back((value >> shift) & 0xFF);
+   }
+}
+
+void putU64(std::vector<std::uint8_t> &out, std::uint64_t value)
+{
+   for(int shift = 0; shift < 64; shift += 8) {
+      out.push_back((value >> shift) & 0xFF);
+   }
+}
+
+std::uint16_t getU16(const std::uint8_t *data)
+{
+   return data[0] | data[1] << 8;
+}
+
+std::uint32_t getU32(const std::uint8_t *data)
+{
+   return data[0] | data[1] << 8 | data[2] << 16 | std::uint32_t(data[3]) << 24;
+}
+
+bool setNonBlocking(int fd)
+{
+   const int flags = fcntl(fd, F_GETFL, 0);
+   return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+}
+
+chip8emu::Server::Server(const std::string &path, SessionSetup setup)
+   : mPath(path), mSetup(setup), mListener(-1), mRunning(false)
+{
+
+}
+
+chip8emu::Server::~Server()
+{
+   for(const std::unique_ptr<Session> &session : mSessions) {
+      close(session->fd);
+   }
+
+   if(mListener >= 0) {
+      close(mListener);
+      unlink(mPath.c_str());
+   }
+}
+
+bool chip8emu::Server::start()
+{
+   sockaddr_un addr;
+   std::memset(&addr, 0, sizeof(addr));
+   addr.sun_family = AF_UNIX;
+
+   if(mPath.size() >= sizeof(addr.sun_path)) {
+      std::cerr << "Socket path " << mPath << " is too long" << std::endl;
+      return false;
+   }
+
+   std::strncpy(addr.sun_path, mPath.c_str(), sizeof(addr.sun_path) - 1);
+
+   // Replace a socket left behind by a previous run.
+   unlink(mPath.c_str());
+
+   mListener = socket(AF_UNIX, SOCK_STREAM, 0);
+   if(mListener < 0 || !setNonBlocking(mListener)
+         || bind(mListener, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0
+         || listen(mListener, 16) != 0) {
+      std::cerr << "Failed to listen on " << mPath << ": " << std::strerror(errno) << std::endl;
+      return false;
+   }
+
+   mRunning = true;
+   return true;
+}
+
+void chip8emu::Server::run()
+{
+   std::vector<pollfd> fds;
+
+   while(mRunning) {
+      // Watch the listener and every session, the latter for writability
+      // only while responses are pending.
+      fds.clear();
+      fds.push_back(pollfd { mListener, POLLIN, 0 });
+      for(const std::unique_ptr<Session> &session : mSessions) {
+         fds.push_back(pollfd { session->fd, static_cast<short>(POLLIN | (session->out.empty() ? 0 : POLLOUT)), 0 });
+      }
+
+      // Wake up regularly to notice stop().
+      if(poll(fds.data(), fds.size(), 100) < 0) {
+         if(errno == EINTR) {
+            continue;
+         }
+
+         std::cerr << "Server poll failed: " << std::strerror(errno) << std::endl;
+         break;
+      }
+
+      // Serve the sessions polled above, closing those that failed, ...
+      std::vector<std::unique_ptr<Session>> alive;
+      for(std::size_t i = 0; i < mSessions.size(); i++) {
+         Session &session = *mSessions[i];
+         const short revents = fds[i + 1].revents;
+
+         bool ok = (revents & (POLLERR | POLLNVAL)) == 0;
+         ok = ok && (!(revents & (POLLIN | POLLHUP)) || receive(session));
+         ok = ok && (session.out.empty() || send(session));
+
+         if(ok) {
+            alive.push_back(std::move(mSessions[i]));
+         } else {
+            close(session.fd);
+         }
+      }
+      mSessions.swap(alive);
+
+      // ... and accept new ones.
+      if(fds[0].revents & POLLIN) {
+         accept();
+      }
+   }
+}
+
+void chip8emu::Server::stop()
+{
+   mRunning = false;
+}
+
+std::size_t chip8emu::Server::sessions() const
+{
+   return mSessions.size();
+}
+
+void chip8emu::Server::accept()
+{
+   int fd;
+   while((fd = ::accept(mListener, nullptr, nullptr)) >= 0) {
+      if(!setNonBlocking(fd)) {
+         close(fd);
+         continue;
+      }
+
+      std::unique_ptr<Session> session = std::make_unique<Session>();
+      session->fd = fd;
+      reset(*session, 0);
+      mSessions.push_back(std::move(session));
+   }
+}
+
+bool chip8emu::Server::receive(Session &session)
+{
+   std::uint8_t buffer[4096];
+
+   // Drain the socket, ...
+   for(;;) {
+      const ssize_t count = recv(session.fd, buffer, sizeof(buffer), 0);
+      if(count > 0) {
+         session.in.insert(session.in.end(), buffer, buffer + count);
+      } else if(count == 0) {
+         return false;
+      } else if(errno == EAGAIN || errno == EWOULDBLOCK) {
+         break;
+      } else if(errno != EINTR) {
+         return false;
+      }
+   }
+
+   // ... then handle every complete request in order.
+   std::size_t offset = 0;
+   while(session.in.size() - offset >= HEADER_SIZE) {
+      const std::uint8_t *header = &session.in[offset];
+      const std::uint32_t length = getU32(header + 4);
+
+      if(length > MAX_PAYLOAD) {
+         return false;
+      }
+
+      if(session.in.size() - offset < HEADER_SIZE + length) {
+         break;
+      }
+
+      handle(session, header[0], header + HEADER_SIZE, length);
+      offset += HEADER_SIZE + length;
+   }
+
+   session.in.erase(session.in.begin(), session.in.begin() + offset);
+   return true;
+}
+
+bool chip8emu::Server::send(Session &session)
+{
+   std::size_t offset = 0;
+
+   while(offset < session.out.size()) {
+      const ssize_t count = ::send(session.fd, &session.out[offset], session.out.size() - offset, MSG_NOSIGNAL);
+      if(count >= 0) {
+         offset += count;
+      } else if(errno == EAGAIN || errno == EWOULDBLOCK) {
+         break;
+      } else if(errno != EINTR) {
+         return false;
+      }
+   }
+
+   session.out.erase(session.out.begin(), session.out.begin() + offset);
+   return true;
+}
+
+void chip8emu::Server::reset(Session &session, std::uint32_t seed)
+{
+   session.ppu = std::make_shared<PPU>();
+   session.cpu = std::make_unique<CPU>(session.ppu);
+   session.cpu->seed(seed);
+   mSetup(*session.cpu);
+}
+
+void chip8emu::Server::handle(Session &session, std::uint8_t command, const std::uint8_t *payload, std::uint32_t length)
+{
+   std::vector<std::uint8_t> response;
+   Status status = STATUS_OK;
+
+   switch(command) {
+   case CMD_STEP: {
+      std::uint32_t events = EVENT_NONE;
+      std::uint32_t frames = 0;
+
+      if(length % 6 != 0) {
+         status = STATUS_ERROR;
+         break;
+      }
+
+      // Check the total first, summed wide enough not to overflow, so other
+      // sessions are not blocked for long.
+      std::uint64_t total = 0;
+      for(std::uint32_t i = 0; i < length; i += 6) {
+         total += getU32(payload + i);
+      }
+
+      if(total > MAX_STEP_FRAMES) {
+         status = STATUS_ERROR;
+         break;
+      }
+
+      for(std::uint32_t i = 0; i < length; i += 6) {
+         session.cpu->setKeys(getU16(payload + i + 4));
+         events |= session.cpu->runFrames(getU32(payload + i));
+      }
+
+      frames = static_cast<std::uint32_t>(total);
+
+      putU32(response, events);
+      putU32(response, frames);
+      break;
+   }
+   case CMD_FRAMEBUFFER: {
+      const PPU &ppu = *session.ppu;
+      response.push_back(ppu.width());
+      response.push_back(ppu.height());
+      putU16(response, ppu.wordsPerRow());
+
+      for(std::uint8_t y = 0; y < ppu.height(); y++) {
+         for(std::size_t word = 0; word < ppu.wordsPerRow(); word++) {
+            putU64(response, ppu.row(y)[word]);
+         }
+      }
+      break;
+   }
+   case CMD_REGISTERS: {
+      const CPU &cpu = *session.cpu;
+      putU16(response, cpu.pc());
+      putU16(response, cpu.index());
+      response.push_back(cpu.delayTimer());
+      response.push_back(cpu.soundTimer());
+      response.push_back(cpu.stackDepth());
+      response.push_back(0);
+
+      for(std::uint8_t reg = 0; reg < 16; reg++) {
+         response.push_back(cpu.reg(reg));
+      }
+      break;
+   }
+   case CMD_SAVE_STATE: {
+      std::ostringstream state;
+      session.cpu->saveState(state);
+
+      const std::string bytes = state.str();
+      response.assign(bytes.begin(), bytes.end());
+      break;
+   }
+   case CMD_LOAD_STATE: {
+      // Loaded into a copy first, so a damaged state leaves the session as it was.
+      std::istringstream state(std::string(reinterpret_cast<const char*>(payload), length));
+      std::unique_ptr<CPU> loaded = std::make_unique<CPU>(std::make_shared<PPU>(), *session.cpu);
+
+      if(loaded->loadState(state)) {
+         session.cpu->copyState(*loaded);
+      } else {
+         status = STATUS_ERROR;
+      }
+      break;
+   }
+   case CMD_RESET:
+      if(length != 4) {
+         status = STATUS_ERROR;
+         break;
+      }
+
+      reset(session, getU32(payload));
+      break;
+   default:
+      status = STATUS_ERROR;
+      break;
+   }
+
+   respond(session, command, status, response);
+}
+
+void chip8emu::Server::respond(Session &session, std::uint8_t command, Status status, const std::vector<std::uint8_t> &payload)
+{
+   std::vector<std::uint8_t> &out = session.out;
+
+   out.push_back(command);
+   out.push_back(status);
+   out.push_back(0);
+   out.push_back(0);
+   putU32(out, payload.size());
+   out.insert(out.end(), payload.begin(), payload.end());
+}
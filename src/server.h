@@ -0,0 +1,103 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "cpu.h"
+#include "ppu.h"
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace chip8emu
+{
+
+// Serves emulator sessions to other processes over a Unix domain socket.
+//
+// Every connection is a session with its own machine. Requests and responses
+// start with an 8 byte header, all integers are little endian:
+//
+//    request:  u8 command, u8[3] reserved, u32 payload length, payload
+//    response: u8 command, u8 status, u8[2] reserved, u32 payload length, payload
+//
+// Commands:
+//
+//    STEP         payload: {u32 frames, u16 keys} repeated, response: u32 events, u32 frames
+//    FRAMEBUFFER  response: u8 width, u8 height, u16 words per row, packed rows as u64
+//    REGISTERS    response: u16 pc, u16 i, u8 delay, u8 sound, u8 stack depth, u8 0, V0-VF
+//    SAVE_STATE   response: the state as written by CPU::saveState()
+//    LOAD_STATE   payload: a state as written by CPU::saveState(), the
+//                 session is left unchanged if it is rejected
+//    RESET        payload: u32 seed, reloads the rom
+//
+// Clients may pipeline any number of requests in one write, they are
+// answered in order. A single STEP can run many pad masks for many frames,
+// so one round trip advances a whole input sequence. All sessions are served
+// by one event loop thread, so a STEP runs at most MAX_STEP_FRAMES frames in
+// total and is answered with an error above that, without running any.
+class Server
+{
+public:
+   enum Command : std::uint8_t
+   {
+      CMD_STEP = 1,
+      CMD_FRAMEBUFFER = 2,
+      CMD_REGISTERS = 3,
+      CMD_SAVE_STATE = 4,
+      CMD_LOAD_STATE = 5,
+      CMD_RESET = 6
+   };
+
+   enum Status : std::uint8_t
+   {
+      STATUS_OK = 0,
+      STATUS_ERROR = 1
+   };
+
+   static const std::size_t HEADER_SIZE = 8;
+   static const std::uint32_t MAX_PAYLOAD = 1 << 20;
+   static const std::uint32_t MAX_STEP_FRAMES = 60 * 60 * 60; // An hour of play
+
+   // Prepares the CPU of a new or reset session, e.g. loads the rom.
+   typedef std::function<void(CPU &cpu)> SessionSetup;
+
+   Server(const std::string &path, SessionSetup setup);
+   ~Server();
+
+   bool start();
+
+   // Serves sessions until stop() is called from another thread or a signal.
+   void run();
+   void stop();
+
+   std::size_t sessions() const;
+
+private:
+   struct Session
+   {
+      int fd;
+      std::shared_ptr<PPU> ppu;
+      std::unique_ptr<CPU> cpu;
+      std::vector<std::uint8_t> in; // Received bytes not yet handled
+      std::vector<std::uint8_t> out; // Responses not yet sent
+   };
+
+   void accept();
+   bool receive(Session &session);
+   bool send(Session &session);
+   void reset(Session &session, std::uint32_t seed);
+   void handle(Session &session, std::uint8_t command, const std::uint8_t *payload, std::uint32_t length);
+   void respond(Session &session, std::uint8_t command, Status status, const std::vector<std::uint8_t> &payload);
+
+   const std::string mPath;
+   SessionSetup mSetup;
+   int mListener; // Listening socket, -1 before start()
+   std::atomic<bool> mRunning;
+   std::vector<std::unique_ptr<Session>> mSessions;
+};
+
+}
+
+#endif // SERVER_H
@@ -0,0 +1,70 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+namespace chip8emu
+{
+
+// Bounded lock-free queue for exactly one producer and one consumer thread.
+// The capacity is rounded up to a power of two, all storage is allocated up
+// front, so pushing never allocates or blocks.
+template <typename T>
+class SpscQueue
+{
+public:
+   SpscQueue(std::size_t capacity)
+      : mMask(roundUp(capacity) - 1), mBuffer(mMask + 1), mHead(0), mTail(0)
+   {
+   }
+
+   // Called by the producer, returns false if the queue is full.
+   bool push(const T &item)
+   {
+      const std::size_t tail = mTail.load(std::memory_order_relaxed);
+      if(tail - mHead.load(std::memory_order_acquire) > mMask) {
+         return false;
+      }
+
+      mBuffer[tail & mMask] = item;
+      mTail.store(tail + 1, std::memory_order_release);
+      return true;
+   }
+
+   // Called by the consumer, returns false if the queue is empty.
+   bool pop(T &item)
+   {
+      const std::size_t head = mHead.load(std::memory_order_relaxed);
+      if(head == mTail.load(std::memory_order_acquire)) {
+         return false;
+      }
+
+      item = mBuffer[head & mMask];
+      mHead.store(head + 1, std::memory_order_release);
+      return true;
+   }
+
+private:
+   static std::size_t roundUp(std::size_t n)
+   {
+      std::size_t capacity = 1;
+      while(capacity < n) {
+         capacity <<= 1;
+      }
+
+      return capacity;
+   }
+
+   const std::size_t mMask;
+   std::vector<T> mBuffer;
+
+   // Keep the indices on separate cache lines, so both sides do not contend.
+   alignas(64) std::atomic<std::size_t> mHead;
+   alignas(64) std::atomic<std::size_t> mTail;
+};
+
+}
+
+#endif // SPSC_QUEUE_H
@@ -0,0 +1,61 @@
+#include "startuptimer.h"
+
+#include <iomanip>
+
+namespace
+{
+
+double milliseconds(chip8emu::StartupTimer::Clock::duration duration)
+{
+   return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+}
+
+chip8emu::StartupTimer::Phase::Phase(StartupTimer *timer, const char *name)
+   : mTimer(timer), mName(name)
+{
+   if(mTimer != nullptr) {
+      mStart = Clock::now();
+   }
+}
+
+chip8emu::StartupTimer::Phase::~Phase()
+{
+   if(mTimer != nullptr) {
+      mTimer->add(mName, Clock::now() - mStart);
+   }
+}
+
+chip8emu::StartupTimer::StartupTimer()
+   : mStart(Clock::now())
+{
+
+}
+
+chip8emu::StartupTimer::~StartupTimer()
+{
+
+}
+
+void chip8emu::StartupTimer::add(const std::string &name, Clock::duration duration)
+{
+   std::lock_guard<std::mutex> lock(mMutex);
+   mPhases.emplace_back(name, duration);
+}
+
+void chip8emu::StartupTimer::print(std::ostream &out) const
+{
+   std::lock_guard<std::mutex> lock(mMutex);
+   const std::ios::fmtflags flags = out.flags();
+   const std::streamsize precision = out.precision();
+
+   out << "Startup times:" << std::endl << std::fixed << std::setprecision(2);
+   for(const std::pair<std::string, Clock::duration> &phase : mPhases) {
+      out << "  " << std::left << std::setw(16) << phase.first << std::right << std::setw(9) << milliseconds(phase.second) << " ms" << std::endl;
+   }
+
+   out << "  " << std::left << std::setw(16) << "total" << std::right << std::setw(9) << milliseconds(Clock::now() - mStart) << " ms" << std::endl;
+   out.flags(flags);
+   out.precision(precision);
+}
@@ -0,0 +1,49 @@
+#ifndef STARTUP_TIMER_H
+#define STARTUP_TIMER_H
+
+#include <chrono>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace chip8emu
+{
+
+// Collects the duration of each startup phase, from any thread, and prints
+// them together with the time since construction. Phases running in
+// parallel are listed one by one, so they may add up to more than the total.
+class StartupTimer
+{
+public:
+   typedef std::chrono::steady_clock Clock;
+
+   // Measures a phase until it goes out of scope, if a timer is given.
+   class Phase
+   {
+   public:
+      Phase(StartupTimer *timer, const char *name);
+      ~Phase();
+
+   private:
+      StartupTimer *mTimer;
+      const char *mName;
+      Clock::time_point mStart;
+   };
+
+   StartupTimer();
+   ~StartupTimer();
+
+   void add(const std::string &name, Clock::duration duration);
+   void print(std::ostream &out) const;
+
+private:
+   const Clock::time_point mStart;
+
+   mutable std::mutex mMutex;
+   std::vector<std::pair<std::string, Clock::duration>> mPhases;
+};
+
+}
+
+#endif // STARTUP_TIMER_H
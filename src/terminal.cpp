@@ -0,0 +1,166 @@
+#include "terminal.h"
+
+#include <unistd.h>
+
+#include <cerrno>
+
+namespace
+{
+
+// Half blocks in UTF-8, indexed by upper pixel lit << 1 | lower pixel lit.
+const char *const GLYPHS[4] = { " ", "\xE2\x96\x84", "\xE2\x96\x80", "\xE2\x96\x88" };
+const char *const UPPER_HALF = "\xE2\x96\x80";
+
+// 256 color codes of the XO-CHIP colors, close to the window palette.
+const int PALETTE[4] = { 16, 255, 208, 94 };
+
+}
+
+chip8emu::TerminalRenderer::TerminalRenderer(int fd)
+   : mFd(fd), mStarted(false), mWidth(0), mHeight(0), mColored(false), mColumn(0), mRow(0),
+     mForeground(-1), mBackground(-1), mFrames(0), mBytes(0)
+{
+
+}
+
+chip8emu::TerminalRenderer::~TerminalRenderer()
+{
+   stop();
+}
+
+bool chip8emu::TerminalRenderer::start()
+{
+   // Hide the cursor, the first frame clears the screen.
+   mBuffer = "\033[?25l";
+   mWidth = 0;
+   mHeight = 0;
+   mStarted = true;
+
+   return write();
+}
+
+bool chip8emu::TerminalRenderer::render(const PPU &ppu)
+{
+   const std::uint8_t width = ppu.width();
+   const std::uint8_t height = ppu.height();
+   const std::uint8_t planes = ppu.planes();
+   const bool colored = planes > 1;
+
+   mBuffer.clear();
+
+   // Redraw everything on a new display mode, ...
+   if(width != mWidth || height != mHeight || colored != mColored) {
+      mWidth = width;
+      mHeight = height;
+      mColored = colored;
+      mCells.assign(static_cast<std::size_t>(width) * (height / 2), BLANK);
+      mColumn = mWidth;
+      mForeground = -1;
+      mBackground = -1;
+
+      mBuffer += "\033[0m\033[2J";
+   }
+
+   // ... otherwise only the cells that changed.
+   for(std::size_t row = 0; row < height / 2u; row++) {
+      std::uint8_t *cells = &mCells[row * width];
+
+      for(std::size_t x = 0; x < width; x++) {
+         const std::size_t word = x / 64;
+         const std::size_t bit = 63 - x % 64;
+
+         std::uint8_t cell = 0;
+         for(std::uint8_t plane = 0; plane < planes; plane++) {
+            cell |= ((ppu.row(2 * row, plane)[word] >> bit) & 1) << (2 + plane);
+            cell |= ((ppu.row(2 * row + 1, plane)[word] >> bit) & 1) << plane;
+         }
+
+         if(cell != cells[x]) {
+            cells[x] = cell;
+            moveTo(x, row);
+            appendCell(cell, colored);
+         }
+      }
+   }
+
+   mFrames++;
+
+   return mBuffer.empty() || write();
+}
+
+void chip8emu::TerminalRenderer::stop()
+{
+   if(!mStarted) {
+      return;
+   }
+
+   // Reset the colors and continue below the screen with a visible cursor.
+   mBuffer = "\033[0m\033[" + std::to_string(mHeight / 2 + 1) + ";1H\033[?25h";
+   write();
+
+   mStarted = false;
+}
+
+std::uint64_t chip8emu::TerminalRenderer::frames() const
+{
+   return mFrames;
+}
+
+std::uint64_t chip8emu::TerminalRenderer::bytes() const
+{
+   return mBytes;
+}
+
+void chip8emu::TerminalRenderer::moveTo(std::size_t column, std::size_t row)
+{
+   // A cell right after the previous one needs no cursor move.
+   if(column != mColumn || row != mRow) {
+      mBuffer += "\033[" + std::to_string(row + 1) + ';' + std::to_string(column + 1) + 'H';
+      mRow = row;
+   }
+
+   // The cursor stays on the last column, forcing a move for the next cell.
+   mColumn = column + 1 < mWidth ? column + 1 : mWidth;
+}
+
+void chip8emu::TerminalRenderer::appendCell(std::uint8_t cell, bool colored)
+{
+   const std::uint8_t upper = cell >> 2;
+   const std::uint8_t lower = cell & 3;
+
+   if(!colored) {
+      mBuffer += GLYPHS[upper << 1 | lower];
+      return;
+   }
+
+   // Colored cells are upper half blocks, the lower pixel being the background.
+   if(PALETTE[upper] != mForeground) {
+      mForeground = PALETTE[upper];
+      mBuffer += "\033[38;5;" + std::to_string(mForeground) + 'm';
+   }
+
+   if(PALETTE[lower] != mBackground) {
+      mBackground = PALETTE[lower];
+      mBuffer += "\033[48;5;" + std::to_string(mBackground) + 'm';
+   }
+
+   mBuffer += UPPER_HALF;
+}
+
+bool chip8emu::TerminalRenderer::write()
+{
+   // One write per frame, continued if the terminal takes it in parts.
+   std::size_t offset = 0;
+   while(offset < mBuffer.size()) {
+      const ssize_t count = ::write(mFd, mBuffer.data() + offset, mBuffer.size() - offset);
+
+      if(count > 0) {
+         offset += count;
+      } else if(count == 0 || errno != EINTR) {
+         return false;
+      }
+   }
+
+   mBytes += offset;
+   return true;
+}
@@ -0,0 +1,64 @@
+#ifndef TERMINAL_H
+#define TERMINAL_H
+
+#include "ppu.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace chip8emu
+{
+
+// Draws the screen on an ANSI terminal, e.g. over SSH.
+//
+// Every character cell shows two pixel rows as a Unicode half block, so a
+// lores screen takes 64x16 cells and a hires one 128x32. Only the cells that
+// changed since the previous frame are sent, each prefixed by a cursor move
+// unless it directly follows the previous one, and the whole frame goes out
+// in a single write(). XO-CHIP colors are sent as 256 color codes, emitted
+// only when they change. A new display mode redraws the whole screen.
+class TerminalRenderer
+{
+public:
+   TerminalRenderer(int fd = 1);
+   ~TerminalRenderer();
+
+   // Clears the terminal and hides the cursor.
+   bool start();
+   // Sends the cells that changed, returns false if writing failed.
+   bool render(const PPU &ppu);
+   // Restores colors and cursor below the screen.
+   void stop();
+
+   std::uint64_t frames() const;
+   std::uint64_t bytes() const; // Bytes written for all frames
+
+private:
+   static const std::uint8_t BLANK = 0xFF; // Cell value never produced by a frame
+
+   void moveTo(std::size_t column, std::size_t row);
+   void appendCell(std::uint8_t cell, bool colored);
+   bool write();
+
+   const int mFd;
+   bool mStarted;
+
+   std::uint8_t mWidth; // Size of the last frame in pixels, 0 before the first one
+   std::uint8_t mHeight;
+   bool mColored; // Last frame had more than one plane
+   std::vector<std::uint8_t> mCells; // Color of the upper pixel << 2 | color of the lower one
+   std::size_t mColumn; // Cursor position, or mWidth if unknown
+   std::size_t mRow;
+   int mForeground; // Colors last sent, -1 for the terminal defaults
+   int mBackground;
+
+   std::string mBuffer; // Frame being assembled, reused
+
+   std::uint64_t mFrames;
+   std::uint64_t mBytes;
+};
+
+}
+
+#endif // TERMINAL_H
@@ -0,0 +1,97 @@
+#include "threadpool.h"
+
+#include <algorithm>
+
+chip8emu::ThreadPool::ThreadPool(std::size_t threads)
+   : mGeneration(0), mBusy(0), mStopping(false), mTask(nullptr), mCount(0), mGrain(1), mNext(0)
+{
+   if(threads == 0) {
+      threads = std::max(std::thread::hardware_concurrency(), 1u);
+   }
+
+   for(std::size_t i = 1; i < threads; i++) {
+      mWorkers.emplace_back(&ThreadPool::work, this);
+   }
+}
+
+chip8emu::ThreadPool::~ThreadPool()
+{
+   {
+      std::lock_guard<std::mutex> lock(mMutex);
+      mStopping = true;
+   }
+
+   mStart.notify_all();
+   for(std::thread &worker : mWorkers) {
+      worker.join();
+   }
+}
+
+void chip8emu::ThreadPool::parallelFor(std::size_t count, std::size_t grain, const std::function<void(std::size_t, std::size_t)> &task)
+{
+   if(mWorkers.empty() || count <= grain) {
+      task(0, count);
+      return;
+   }
+
+   {
+      std::lock_guard<std::mutex> lock(mMutex);
+      mTask = &task;
+      mCount = count;
+      mGrain = std::max<std::size_t>(grain, 1);
+      mNext = 0;
+      mBusy = mWorkers.size();
+      mGeneration++;
+   }
+
+   mStart.notify_all();
+   runChunks();
+
+   // Wait for the workers, the task must outlive their last chunk.
+   std::unique_lock<std::mutex> lock(mMutex);
+   mDone.wait(lock, [this]() { return mBusy == 0; });
+   mTask = nullptr;
+}
+
+std::size_t chip8emu::ThreadPool::threads() const
+{
+   return mWorkers.size() + 1;
+}
+
+void chip8emu::ThreadPool::work()
+{
+   std::uint64_t generation = 0;
+
+   for(;;) {
+      {
+         std::unique_lock<std::mutex> lock(mMutex);
+         mStart.wait(lock, [this, generation]() { return mStopping || mGeneration != generation; });
+
+         if(mStopping) {
+            return;
+         }
+
+         generation = mGeneration;
+      }
+
+      runChunks();
+
+      std::lock_guard<std::mutex> lock(mMutex);
+      if(--mBusy == 0) {
+         mDone.notify_one();
+      }
+   }
+}
+
+void chip8emu::ThreadPool::runChunks()
+{
+   // Claim chunks until the loop is exhausted, balancing uneven tasks.
+   for(;;) {
+      const std::size_t begin = mNext.fetch_add(mGrain);
+      if(begin >= mCount) {
+         return;
+      }
+
+      (*mTask)(begin, std::min(begin + mGrain, mCount));
+   }
+}
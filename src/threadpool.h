@@ -0,0 +1,51 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace chip8emu
+{
+
+// Fixed set of worker threads running parallel loops. The calling thread
+// takes part in every loop, so a pool of n threads starts n - 1 workers.
+class ThreadPool
+{
+public:
+   // Uses one thread per hardware thread if 'threads' is 0.
+   ThreadPool(std::size_t threads = 0);
+   ~ThreadPool();
+
+   // Calls task(begin, end) for consecutive ranges of at most 'grain'
+   // indices covering [0, count) and returns once all of them are done.
+   void parallelFor(std::size_t count, std::size_t grain, const std::function<void(std::size_t, std::size_t)> &task);
+
+   std::size_t threads() const;
+
+private:
+   void work();
+   void runChunks();
+
+   std::vector<std::thread> mWorkers;
+
+   std::mutex mMutex;
+   std::condition_variable mStart; // Signals workers a new loop
+   std::condition_variable mDone; // Signals the caller that workers are idle
+   std::uint64_t mGeneration; // Number of loops started
+   std::size_t mBusy; // Workers still running the current loop
+   bool mStopping;
+
+   const std::function<void(std::size_t, std::size_t)> *mTask; // Body of the current loop
+   std::size_t mCount; // Indices of the current loop
+   std::size_t mGrain; // Indices per chunk
+   std::atomic<std::size_t> mNext; // First index of the next unclaimed chunk
+};
+
+}
+
+#endif // THREAD_POOL_H
@@ -0,0 +1,148 @@
+#include "../chip8core.h"
+#include "../arena.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+// Measures how many emulator instances are created and destroyed per second
+// on the heap and in a MachineArena, counting the heap allocations of each.
+
+namespace
+{
+
+std::atomic<std::uint64_t> sAllocations(0);
+
+struct Result
+{
+   double seconds;
+   std::uint64_t allocations;
+};
+
+template <typename F>
+Result measure(F f)
+{
+   const std::uint64_t allocations = sAllocations;
+   const auto start = std::chrono::steady_clock::now();
+   f();
+   return { std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(), sAllocations - allocations };
+}
+
+void report(const std::string &name, const Result &result, std::size_t instances)
+{
+   std::cout << name << instances / result.seconds / 1e3 << " k instances/s, "
+             << static_cast<double>(result.allocations) / instances << " allocations per instance" << std::endl;
+}
+
+}
+
+void* operator new(std::size_t size)
+{
+   sAllocations++;
+
+   if(void *p = std::malloc(size ? size : 1)) {
+      return p;
+   }
+
+   throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept
+{
+   std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept
+{
+   std::free(p);
+}
+
+int main(int argc, char **argv)
+{
+   std::size_t instances = 100000;
+   std::size_t slots = 1024;
+   std::uint32_t frames = 60;
+   std::string rom;
+
+   for(int i = 1; i < argc; i++) {
+      const std::string arg = argv[i];
+      if(arg == "-instances" && i + 1 < argc) {
+         instances = std::stoul(argv[++i]);
+      } else if(arg == "-slots" && i + 1 < argc) {
+         slots = std::max<std::size_t>(std::stoul(argv[++i]), 1);
+      } else if(arg == "-frames" && i + 1 < argc) {
+         frames = std::stoul(argv[++i]);
+      } else {
+         rom = arg;
+      }
+   }
+
+   if(rom.empty()) {
+      std::cerr << "Usage: chip8arenabench [-instances n] [-slots n] [-frames n] <rom>" << std::endl;
+      return 2;
+   }
+
+   // Instances are created from a prototype holding the loaded rom.
+   chip8emu::Machine prototype(0);
+   prototype.cpu.loadRom(rom);
+
+   std::vector<unsigned char> memory(chip8emu::MachineArena::bytesFor(slots));
+   chip8emu::MachineArena arena(memory.data(), memory.size());
+   std::vector<chip8emu::Machine*> machines(slots);
+
+   // Create and destroy machines on the heap, ...
+   const Result heap = measure([&]() {
+      for(std::size_t i = 0; i < instances; i++) {
+         std::shared_ptr<chip8emu::PPU> ppu = std::make_shared<chip8emu::PPU>();
+         std::unique_ptr<chip8emu::CPU> cpu = std::make_unique<chip8emu::CPU>(ppu, i);
+         cpu->copyState(prototype.cpu);
+      }
+   });
+
+   // ... in the arena, one after another, reusing a cached slot, ...
+   const Result reused = measure([&]() {
+      for(std::size_t i = 0; i < instances; i++) {
+         arena.destroy(arena.create(prototype));
+      }
+   });
+
+   // ... and in batches filling all slots.
+   const Result batched = measure([&]() {
+      for(std::size_t i = 0; i < instances; i += slots) {
+         for(std::size_t slot = 0; slot < slots; slot++) {
+            machines[slot] = arena.create(prototype);
+         }
+
+         for(std::size_t slot = 0; slot < slots; slot++) {
+            arena.destroy(machines[slot]);
+         }
+      }
+   });
+
+   // Running the machines must not allocate either.
+   for(std::size_t slot = 0; slot < slots; slot++) {
+      machines[slot] = arena.create(prototype);
+      machines[slot]->cpu.seed(slot);
+   }
+
+   const Result running = measure([&]() {
+      for(chip8emu::Machine *machine : machines) {
+         machine->cpu.runFrames(frames);
+      }
+   });
+
+   const std::size_t batchedInstances = (instances + slots - 1) / slots * slots;
+
+   std::cout << "instance:  " << sizeof(chip8emu::Machine) << " bytes, " << slots << " slots" << std::endl;
+   report("heap:      ", heap, instances);
+   report("reused:    ", reused, instances);
+   report("batched:   ", batched, batchedInstances);
+   std::cout << "running:   " << running.allocations << " allocations in " << slots * frames << " frames" << std::endl;
+
+   return running.allocations == 0 && reused.allocations == 0 && batched.allocations == 0 ? 0 : 1;
+}
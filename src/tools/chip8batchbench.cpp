@@ -0,0 +1,130 @@
+#include "../chip8core.h"
+#include "../batchcpu.h"
+
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Compares the lockstep BatchCPU against the same number of independent CPU
+// instances running one rom, reporting aggregate emulated instructions/s.
+// Then checks that a lane computes the same machine as a CPU.
+
+namespace
+{
+
+// Runs a BatchCPU lane and a CPU with the same seed frame by frame,
+// comparing registers and display. Returns the frames that matched.
+std::uint32_t check(const std::string &rom, chip8emu::Quirks quirks, std::uint32_t frames, std::uint32_t cyclesPerFrame)
+{
+   chip8emu::BatchCPU batch(1);
+   batch.setQuirks(quirks);
+   batch.setCyclesPerFrame(cyclesPerFrame);
+   batch.loadRom(rom);
+
+   std::shared_ptr<chip8emu::PPU> ppu = std::make_shared<chip8emu::PPU>();
+   chip8emu::CPU cpu(ppu, 0);
+   cpu.setQuirks(quirks);
+   cpu.setCyclesPerFrame(cyclesPerFrame);
+   cpu.loadRom(rom);
+
+   for(std::uint32_t frame = 0; frame < frames; frame++) {
+      batch.runFrames(1);
+      cpu.runFrames(1);
+
+      bool equal = batch.pc(0) == cpu.pc() && batch.index(0) == cpu.index();
+      for(std::uint8_t reg = 0; reg < 16; reg++) {
+         equal = equal && batch.reg(0, reg) == cpu.reg(reg);
+      }
+      for(std::uint8_t y = 0; y < 32; y++) {
+         equal = equal && batch.gfx(0)[y] == ppu->row(y)[0];
+      }
+
+      if(!equal) {
+         return frame;
+      }
+   }
+
+   return frames;
+}
+
+}
+
+int main(int argc, char **argv)
+{
+   std::size_t lanes = 256;
+   std::uint32_t frames = 600;
+   std::uint32_t cyclesPerFrame = 10;
+   chip8emu::Quirks quirks = chip8emu::QUIRKS_DEFAULT;
+   std::string rom;
+
+   for(int i = 1; i < argc; i++) {
+      const std::string arg = argv[i];
+      if(arg == "-lanes" && i + 1 < argc) {
+         lanes = std::stoul(argv[++i]);
+      } else if(arg == "-frames" && i + 1 < argc) {
+         frames = std::stoul(argv[++i]);
+      } else if(arg == "-cycles" && i + 1 < argc) {
+         cyclesPerFrame = std::stoul(argv[++i]);
+      } else if(arg == "-quirks" && i + 1 < argc) {
+         if(!chip8emu::parseQuirks(argv[++i], quirks) || quirks == chip8emu::QUIRKS_XOCHIP) {
+            std::cerr << "Unsupported quirk profile " << argv[i] << std::endl;
+            return 2;
+         }
+      } else {
+         rom = arg;
+      }
+   }
+
+   if(rom.empty()) {
+      std::cerr << "Usage: chip8batchbench [-lanes n] [-frames n] [-cycles n] [-quirks profile] <rom>" << std::endl;
+      return 2;
+   }
+
+   // Run all lanes in lockstep, ...
+   chip8emu::BatchCPU batch(lanes);
+   lanes = batch.lanes();
+   batch.setQuirks(quirks);
+   batch.setCyclesPerFrame(cyclesPerFrame);
+   batch.loadRom(rom);
+
+   auto start = std::chrono::steady_clock::now();
+   batch.runFrames(frames);
+   const double batchSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+   // ... and the same number of independent scalar machines.
+   std::vector<std::unique_ptr<chip8emu::CPU>> cpus;
+   for(std::size_t lane = 0; lane < lanes; lane++) {
+      cpus.push_back(std::make_unique<chip8emu::CPU>(std::make_shared<chip8emu::PPU>()));
+      cpus.back()->seed(lane);
+      cpus.back()->setQuirks(quirks);
+      cpus.back()->setCyclesPerFrame(cyclesPerFrame);
+      cpus.back()->loadRom(rom);
+   }
+
+   start = std::chrono::steady_clock::now();
+   for(std::unique_ptr<chip8emu::CPU> &cpu : cpus) {
+      cpu->runFrames(frames);
+   }
+   const double scalarSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+   const double instructions = static_cast<double>(lanes) * frames * cyclesPerFrame;
+   const double lockstep = static_cast<double>(batch.groupInstructions())
+         / (batch.groupInstructions() + batch.scalarInstructions());
+
+   std::cout << "lanes:       " << lanes << ", " << frames << " frames of " << cyclesPerFrame << " cycles" << std::endl;
+   std::cout << "batch:       " << instructions / batchSeconds / 1e6 << " M instructions/s ("
+             << lockstep * 100.0 << "% in lockstep)" << std::endl;
+   std::cout << "independent: " << instructions / scalarSeconds / 1e6 << " M instructions/s" << std::endl;
+   std::cout << "speedup:     " << scalarSeconds / batchSeconds << "x" << std::endl;
+
+   const std::uint32_t matched = check(rom, quirks, frames, cyclesPerFrame);
+   if(matched < frames) {
+      std::cout << "check:       lane differs from the CPU in frame " << matched << std::endl;
+      return 1;
+   }
+
+   std::cout << "check:       lane matches the CPU for " << frames << " frames" << std::endl;
+   return 0;
+}
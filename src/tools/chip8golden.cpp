@@ -0,0 +1,213 @@
+#include "../chip8core.h"
+#include "../inputlog.h"
+
+#include <dirent.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Golden frame regression runner.
+//
+// Runs every rom (*.ch8) of a directory headless at maximum speed and hashes
+// the framebuffer at each 60Hz frame boundary. For a rom 'foo.ch8' the pad
+// state per frame is read from 'foo.input' (one 16 bit mask per frame) and
+// the expected hash stream from 'foo.golden'. With -record the golden files
+// are (re)written instead of being checked. Quirk profiles are looked up in
+// 'chip8roms.db' of the directory, if present.
+
+namespace
+{
+
+const char GOLDEN_MAGIC[4] = { 'C', '8', 'G', 'F' };
+
+struct Golden
+{
+   std::uint32_t seed;
+   std::uint32_t cyclesPerFrame;
+   std::vector<std::uint64_t> hashes;
+};
+
+struct Options
+{
+   bool record = false;
+   std::uint32_t frames = 600;
+   std::uint32_t seed = 0;
+   std::uint32_t cyclesPerFrame = 10;
+   std::string dir;
+   std::shared_ptr<chip8emu::QuirkDatabase> quirkDb;
+};
+
+bool readGolden(const std::string &filename, Golden &golden)
+{
+   std::ifstream file(filename, std::ios::in | std::ios::binary);
+   char magic[4];
+   std::uint32_t frames;
+
+   if(!file.read(magic, sizeof(magic)) || std::memcmp(magic, GOLDEN_MAGIC, sizeof(magic)) != 0) {
+      return false;
+   }
+
+   file.read(reinterpret_cast<char*>(&frames), sizeof(frames));
+   file.read(reinterpret_cast<char*>(&golden.seed), sizeof(golden.seed));
+   file.read(reinterpret_cast<char*>(&golden.cyclesPerFrame), sizeof(golden.cyclesPerFrame));
+
+   if(!file) {
+      return false;
+   }
+
+   // The hashes must fit into the file, so a damaged count cannot ask for a
+   // huge buffer.
+   const std::streamoff start = file.tellg();
+   file.seekg(0, std::ios::end);
+   const std::uint64_t remaining = file.tellg() - start;
+   file.seekg(start);
+   if(frames * 8ull > remaining) {
+      return false;
+   }
+
+   golden.hashes.resize(frames);
+   file.read(reinterpret_cast<char*>(golden.hashes.data()), frames * sizeof(std::uint64_t));
+
+   return static_cast<bool>(file);
+}
+
+bool writeGolden(const std::string &filename, const Golden &golden)
+{
+   std::ofstream file(filename, std::ios::out | std::ios::binary);
+   const std::uint32_t frames = golden.hashes.size();
+
+   file.write(GOLDEN_MAGIC, sizeof(GOLDEN_MAGIC));
+   file.write(reinterpret_cast<const char*>(&frames), sizeof(frames));
+   file.write(reinterpret_cast<const char*>(&golden.seed), sizeof(golden.seed));
+   file.write(reinterpret_cast<const char*>(&golden.cyclesPerFrame), sizeof(golden.cyclesPerFrame));
+   file.write(reinterpret_cast<const char*>(golden.hashes.data()), frames * sizeof(std::uint64_t));
+
+   return static_cast<bool>(file);
+}
+
+std::vector<std::string> listRoms(const std::string &dir)
+{
+   std::vector<std::string> roms;
+   std::unique_ptr<DIR, int(*)(DIR*)> handle(opendir(dir.c_str()), closedir);
+
+   if(handle != nullptr) {
+      while(dirent *entry = readdir(handle.get())) {
+         const std::string name = entry->d_name;
+         if(name.size() > 4 && name.compare(name.size() - 4, 4, ".ch8") == 0) {
+            roms.push_back(name.substr(0, name.size() - 4));
+         }
+      }
+   }
+
+   std::sort(roms.begin(), roms.end());
+   return roms;
+}
+
+// Runs a single rom and either records or checks its hash stream. Returns the
+// number of emulated frames and sets 'passed' accordingly.
+std::uint32_t runRom(const Options &options, const std::string &base, bool &passed)
+{
+   Golden golden { options.seed, options.cyclesPerFrame, {} };
+   const std::vector<std::uint16_t> input = chip8emu::loadInputLog(base + ".input");
+
+   passed = true;
+
+   if(!options.record && !readGolden(base + ".golden", golden)) {
+      std::cout << "SKIP " << base << ": no golden file" << std::endl;
+      return 0;
+   }
+
+   std::uint32_t frames = golden.hashes.size();
+   if(options.record) {
+      frames = input.empty() ? options.frames : input.size();
+   }
+
+   std::shared_ptr<chip8emu::PPU> ppu = std::make_shared<chip8emu::PPU>();
+   chip8emu::CPU cpu(ppu);
+   cpu.seed(golden.seed);
+   cpu.setCyclesPerFrame(golden.cyclesPerFrame);
+   cpu.setQuirkDatabase(options.quirkDb);
+   cpu.loadRom(base + ".ch8");
+
+   for(std::uint32_t frame = 0; frame < frames; frame++) {
+      cpu.setKeys(frame < input.size() ? input[frame] : 0);
+      cpu.runFrames(1);
+
+      const std::uint64_t hash = ppu->hash();
+      if(options.record) {
+         golden.hashes.push_back(hash);
+      } else if(hash != golden.hashes[frame]) {
+         std::cout << "FAIL " << base << ": first mismatch at frame " << std::dec << frame
+                   << " (expected 0x" << std::hex << std::setw(16) << std::setfill('0') << golden.hashes[frame]
+                   << ", got 0x" << std::setw(16) << hash << ")" << std::dec << std::endl;
+         ppu->dumpGfx(std::cout);
+         passed = false;
+         return frame + 1;
+      }
+   }
+
+   if(options.record) {
+      passed = writeGolden(base + ".golden", golden);
+      std::cout << (passed ? "REC  " : "FAIL ") << base << " (" << frames << " frames)" << std::endl;
+   } else {
+      std::cout << "OK   " << base << " (" << frames << " frames)" << std::endl;
+   }
+
+   return frames;
+}
+
+}
+
+int main(int argc, char **argv)
+{
+   Options options;
+
+   for(int i = 1; i < argc; i++) {
+      const std::string arg = argv[i];
+      if(arg == "-record") {
+         options.record = true;
+      } else if(arg == "-frames" && i + 1 < argc) {
+         options.frames = std::stoul(argv[++i]);
+      } else if(arg == "-seed" && i + 1 < argc) {
+         options.seed = std::stoul(argv[++i]);
+      } else if(arg == "-cycles" && i + 1 < argc) {
+         options.cyclesPerFrame = std::stoul(argv[++i]);
+      } else {
+         options.dir = arg;
+      }
+   }
+
+   if(options.dir.empty()) {
+      std::cerr << "Usage: chip8golden [-record] [-frames n] [-seed n] [-cycles n] <rom-dir>" << std::endl;
+      return 2;
+   }
+
+   options.quirkDb = std::make_shared<chip8emu::QuirkDatabase>();
+   options.quirkDb->load(options.dir + "/chip8roms.db");
+
+   const std::vector<std::string> roms = listRoms(options.dir);
+   std::uint64_t totalFrames = 0;
+   std::size_t failures = 0;
+
+   const auto start = std::chrono::steady_clock::now();
+
+   for(const std::string &rom : roms) {
+      bool passed;
+      totalFrames += runRom(options, options.dir + "/" + rom, passed);
+      failures += passed ? 0 : 1;
+   }
+
+   const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+   std::cout << roms.size() << " roms, " << failures << " failed, " << totalFrames << " frames in "
+             << seconds << "s (" << static_cast<std::uint64_t>(totalFrames / std::max(seconds, 1e-9)) << " frames/s)" << std::endl;
+
+   return failures == 0 ? 0 : 1;
+}
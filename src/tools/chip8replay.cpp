@@ -0,0 +1,294 @@
+#include "../chip8core.h"
+#include "../replay.h"
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Records, inspects and seeks keyframe indexed replay files:
+//
+//    chip8replay -record pad.input [-seed n] [-quirks profile] [-romdb file] [-cycles n]
+//                [-keyframes n] [-frames n] [-out file] <rom>
+//    chip8replay <replay>                        prints the header
+//    chip8replay -seek frame [-dump] <replay>    restores a frame
+//    chip8replay -extract from:to [-keyframes n] [-out file] <replay>
+//    chip8replay -verify <replay>                replays checking every keyframe
+
+namespace
+{
+
+enum Mode
+{
+   MODE_INFO,
+   MODE_RECORD,
+   MODE_SEEK,
+   MODE_EXTRACT,
+   MODE_VERIFY
+};
+
+struct Options
+{
+   Mode mode = MODE_INFO;
+   std::string file; // Rom when recording, replay otherwise
+   std::string input;
+   std::string out = "session.c8r";
+   std::string quirks;
+   std::string romDb = "chip8roms.db";
+   std::uint32_t seed = 0;
+   std::uint32_t cyclesPerFrame = 10;
+   std::uint32_t keyframeInterval = 600; // 10 seconds
+   bool framesGiven = false;
+   std::uint32_t frames = 0;
+   std::uint32_t from = 0;
+   std::uint32_t to = 0;
+   bool dump = false;
+};
+
+double elapsedMs(std::chrono::steady_clock::time_point start)
+{
+   return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+std::string hex(std::uint64_t value)
+{
+   std::ostringstream out;
+   out << "0x" << std::hex << std::setw(16) << std::setfill('0') << value;
+   return out.str();
+}
+
+// Emulates 'frames' frames of input, starting at 'first', into the writer.
+void record(chip8emu::CPU &cpu, const std::vector<std::uint16_t> &input, std::uint32_t first, std::uint32_t frames,
+            chip8emu::ReplayWriter &writer)
+{
+   for(std::uint32_t frame = first; frame < first + frames; frame++) {
+      const std::uint16_t keys = frame < input.size() ? input[frame] : 0;
+      writer.addFrame(cpu, keys);
+      cpu.setKeys(keys);
+      cpu.runFrames(1);
+   }
+}
+
+int save(const chip8emu::ReplayWriter &writer, const std::string &filename)
+{
+   if(!writer.save(filename)) {
+      std::cerr << "Failed to write " << filename << "!" << std::endl;
+      return 1;
+   }
+
+   std::cout << "Saved " << writer.frames() << " frames with " << writer.keyframes() << " keyframes as " << filename << std::endl;
+   return 0;
+}
+
+int runRecord(const Options &options)
+{
+   std::shared_ptr<chip8emu::PPU> ppu = std::make_shared<chip8emu::PPU>();
+   chip8emu::CPU cpu(ppu, options.seed);
+
+   chip8emu::Quirks quirks;
+   if(chip8emu::parseQuirks(options.quirks, quirks)) {
+      cpu.setQuirks(quirks);
+   } else {
+      std::shared_ptr<chip8emu::QuirkDatabase> database = std::make_shared<chip8emu::QuirkDatabase>();
+      database->load(options.romDb);
+      cpu.setQuirkDatabase(database);
+   }
+
+   cpu.setCyclesPerFrame(options.cyclesPerFrame);
+   cpu.loadRom(options.file);
+
+   const std::vector<std::uint16_t> input = chip8emu::loadInputLog(options.input);
+   const std::uint32_t frames = options.framesGiven ? options.frames : input.size();
+   if(frames == 0) {
+      std::cerr << "Nothing to record, " << options.input << " is empty" << std::endl;
+      return 1;
+   }
+
+   chip8emu::ReplayWriter writer(cpu.romHash(), options.keyframeInterval);
+   record(cpu, input, 0, frames, writer);
+
+   return save(writer, options.out);
+}
+
+int runInfo(chip8emu::Replay &replay)
+{
+   std::cout << "frames:    " << replay.frames() << " (" << replay.frames() / 60.0 << " s)" << std::endl
+             << "keyframes: " << replay.keyframes() << ", every " << replay.keyframeInterval() << " frames" << std::endl
+             << "rom hash:  " << hex(replay.romHash()) << std::endl
+             << "quirks:    " << chip8emu::quirksName(replay.quirks()) << ", " << replay.cyclesPerFrame() << " cycles per frame" << std::endl;
+   return 0;
+}
+
+int runSeek(const Options &options, chip8emu::Replay &replay)
+{
+   std::shared_ptr<chip8emu::PPU> ppu = std::make_shared<chip8emu::PPU>();
+   chip8emu::CPU cpu(ppu, 0);
+
+   const auto start = std::chrono::steady_clock::now();
+   const std::int64_t emulated = replay.seek(cpu, options.from);
+   if(emulated < 0) {
+      std::cerr << "Cannot seek to frame " << options.from << " of " << replay.frames() << std::endl;
+      return 1;
+   }
+
+   std::cout << "Frame " << options.from << ": keyframe " << replay.keyframeFor(options.from) << " and " << emulated
+             << " emulated frames in " << elapsedMs(start) << " ms, display hash " << hex(ppu->hash()) << std::endl;
+
+   if(options.dump) {
+      ppu->dumpGfx(std::cout);
+   }
+
+   return 0;
+}
+
+int runExtract(const Options &options, chip8emu::Replay &replay)
+{
+   if(options.from >= options.to || options.to > replay.frames()) {
+      std::cerr << "Invalid range " << options.from << ":" << options.to << " of " << replay.frames() << " frames" << std::endl;
+      return 2;
+   }
+
+   std::shared_ptr<chip8emu::PPU> ppu = std::make_shared<chip8emu::PPU>();
+   chip8emu::CPU cpu(ppu, 0);
+   if(replay.seek(cpu, options.from) < 0) {
+      std::cerr << "Cannot seek to frame " << options.from << std::endl;
+      return 1;
+   }
+
+   // The extract starts with a keyframe of its first frame.
+   chip8emu::ReplayWriter writer(replay.romHash(), options.keyframeInterval);
+   record(cpu, replay.input(), options.from, options.to - options.from, writer);
+
+   return save(writer, options.out);
+}
+
+int runVerify(chip8emu::Replay &replay)
+{
+   std::shared_ptr<chip8emu::PPU> ppu = std::make_shared<chip8emu::PPU>();
+   chip8emu::CPU cpu(ppu, 0);
+   if(replay.seek(cpu, 0) < 0) {
+      std::cerr << "Cannot load the first keyframe" << std::endl;
+      return 1;
+   }
+
+   // Replay the whole session from the first keyframe, comparing the
+   // machine against every later one.
+   const auto start = std::chrono::steady_clock::now();
+   std::size_t failed = 0;
+   std::string expected;
+
+   for(std::uint32_t frame = 0; frame < replay.frames(); frame++) {
+      if(frame % replay.keyframeInterval() == 0) {
+         const std::size_t index = frame / replay.keyframeInterval();
+
+         std::ostringstream state;
+         cpu.saveState(state);
+         if(!replay.keyframe(index, expected) || state.str() != expected) {
+            std::cout << "FAIL keyframe " << index << " at frame " << frame << std::endl;
+            failed++;
+         }
+      }
+
+      cpu.setKeys(replay.input()[frame]);
+      cpu.runFrames(1);
+   }
+
+   std::cout << replay.keyframes() << " keyframes, " << failed << " failed, " << replay.frames() << " frames in "
+             << elapsedMs(start) << " ms" << std::endl;
+   return failed == 0 ? 0 : 1;
+}
+
+// Parses "from:to".
+bool parseRange(const std::string &arg, Options &options)
+{
+   const std::size_t colon = arg.find(':');
+   if(colon == std::string::npos) {
+      return false;
+   }
+
+   options.from = std::stoul(arg.substr(0, colon));
+   options.to = std::stoul(arg.substr(colon + 1));
+   return true;
+}
+
+}
+
+int main(int argc, char **argv)
+{
+   Options options;
+
+   for(int i = 1; i < argc; i++) {
+      const std::string arg = argv[i];
+      if(arg == "-record" && i + 1 < argc) {
+         options.mode = MODE_RECORD;
+         options.input = argv[++i];
+      } else if(arg == "-seek" && i + 1 < argc) {
+         options.mode = MODE_SEEK;
+         options.from = std::stoul(argv[++i]);
+      } else if(arg == "-extract" && i + 1 < argc) {
+         options.mode = MODE_EXTRACT;
+         if(!parseRange(argv[++i], options)) {
+            std::cerr << "Invalid range " << argv[i] << ", expected from:to" << std::endl;
+            return 2;
+         }
+      } else if(arg == "-verify") {
+         options.mode = MODE_VERIFY;
+      } else if(arg == "-dump") {
+         options.dump = true;
+      } else if(arg == "-seed" && i + 1 < argc) {
+         options.seed = std::stoul(argv[++i]);
+      } else if(arg == "-cycles" && i + 1 < argc) {
+         options.cyclesPerFrame = std::stoul(argv[++i]);
+      } else if(arg == "-keyframes" && i + 1 < argc) {
+         options.keyframeInterval = std::max<std::uint32_t>(std::stoul(argv[++i]), 1);
+      } else if(arg == "-frames" && i + 1 < argc) {
+         options.framesGiven = true;
+         options.frames = std::stoul(argv[++i]);
+      } else if(arg == "-quirks" && i + 1 < argc) {
+         options.quirks = argv[++i];
+
+         chip8emu::Quirks quirks;
+         if(!chip8emu::parseQuirks(options.quirks, quirks)) {
+            std::cerr << "Unknown quirk profile " << options.quirks << std::endl;
+            return 2;
+         }
+      } else if(arg == "-romdb" && i + 1 < argc) {
+         options.romDb = argv[++i];
+      } else if(arg == "-out" && i + 1 < argc) {
+         options.out = argv[++i];
+      } else {
+         options.file = arg;
+      }
+   }
+
+   if(options.file.empty()) {
+      std::cerr << "Usage: chip8replay -record pad.input [-seed n] [-quirks profile] [-romdb file] [-cycles n]" << std::endl
+                << "                   [-keyframes n] [-frames n] [-out file] <rom>" << std::endl
+                << "       chip8replay [-seek frame [-dump] | -extract from:to [-keyframes n] [-out file] | -verify] <replay>" << std::endl;
+      return 2;
+   }
+
+   if(options.mode == MODE_RECORD) {
+      return runRecord(options);
+   }
+
+   chip8emu::Replay replay;
+   if(!replay.open(options.file)) {
+      std::cerr << "Failed to read replay " << options.file << "!" << std::endl;
+      return 1;
+   }
+
+   switch(options.mode) {
+   case MODE_SEEK:
+      return runSeek(options, replay);
+   case MODE_EXTRACT:
+      return runExtract(options, replay);
+   case MODE_VERIFY:
+      return runVerify(replay);
+   default:
+      return runInfo(replay);
+   }
+}
@@ -0,0 +1,122 @@
+#include "../chip8core.h"
+#include "../search.h"
+
+#include <csignal>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Searches the input sequences of a rom for the fastest one reaching a goal,
+// e.g. 'the byte at 0x3F0 becomes 1', or with -best for the highest value of
+// a score byte. Progress is printed once per second and the best sequence is
+// written as an input log, which the emulator replays with
+//
+//    chip8emu -headless -seed <seed> -quirks <profile> -input <file> <rom>
+
+namespace
+{
+
+chip8emu::Search *sSearch = nullptr;
+
+void handleSignal(int)
+{
+   if(sSearch != nullptr) {
+      sSearch->stop();
+   }
+}
+
+// Parses "addr=value", both decimal or 0x prefixed hexadecimal.
+bool parseGoal(const std::string &arg, chip8emu::Search::Config &config)
+{
+   const std::size_t equals = arg.find('=');
+   if(equals == std::string::npos) {
+      return false;
+   }
+
+   config.goalAddress = std::stoul(arg.substr(0, equals), nullptr, 0);
+   config.goalValue = std::stoul(arg.substr(equals + 1), nullptr, 0);
+   return true;
+}
+
+void printProgress(const chip8emu::Search::Progress &progress)
+{
+   std::cerr << "expanded " << progress.expanded << ", unique " << progress.unique
+             << ", queued " << progress.queued << " (" << progress.compressedBytes / 1024 << " KiB), "
+             << std::fixed << std::setprecision(0) << progress.statesPerSecond << " states/s, ";
+
+   if(progress.solved) {
+      std::cerr << "solved in " << progress.bestFrames << " frames" << std::endl;
+   } else {
+      std::cerr << "best score " << static_cast<int>(progress.bestScore) << " after " << progress.bestFrames << " frames" << std::endl;
+   }
+}
+
+}
+
+int main(int argc, char **argv)
+{
+   chip8emu::Search::Config config;
+   std::string output = "best.input";
+
+   for(int i = 1; i < argc; i++) {
+      const std::string arg = argv[i];
+      if(arg == "-bfs") {
+         config.mode = chip8emu::Search::MODE_BFS;
+      } else if(arg == "-best") {
+         config.mode = chip8emu::Search::MODE_BEST_FIRST;
+      } else if(arg == "-goal" && i + 1 < argc) {
+         if(!parseGoal(argv[++i], config)) {
+            std::cerr << "Invalid goal " << argv[i] << ", expected addr=value" << std::endl;
+            return 2;
+         }
+      } else if(arg == "-score" && i + 1 < argc) {
+         config.scoreAddress = std::stoul(argv[++i], nullptr, 0);
+      } else if(arg == "-frames" && i + 1 < argc) {
+         config.maxFrames = std::stoul(argv[++i]);
+      } else if(arg == "-states" && i + 1 < argc) {
+         config.maxStates = std::stoull(argv[++i]);
+      } else if(arg == "-threads" && i + 1 < argc) {
+         config.threads = std::stoul(argv[++i]);
+      } else if(arg == "-seed" && i + 1 < argc) {
+         config.seed = std::stoul(argv[++i]);
+      } else if(arg == "-cycles" && i + 1 < argc) {
+         config.cyclesPerFrame = std::stoul(argv[++i]);
+      } else if(arg == "-quirks" && i + 1 < argc) {
+         if(!chip8emu::parseQuirks(argv[++i], config.quirks) || config.quirks == chip8emu::QUIRKS_XOCHIP) {
+            std::cerr << "Unsupported quirk profile " << argv[i] << std::endl;
+            return 2;
+         }
+      } else if(arg == "-out" && i + 1 < argc) {
+         output = argv[++i];
+      } else {
+         config.rom = arg;
+      }
+   }
+
+   if(config.rom.empty() || (config.goalAddress == chip8emu::Search::NO_ADDRESS && config.scoreAddress == chip8emu::Search::NO_ADDRESS)) {
+      std::cerr << "Usage: chip8search [-bfs | -best] [-goal addr=value] [-score addr] [-frames n] [-states n]" << std::endl
+                << "                   [-threads n] [-seed n] [-cycles n] [-quirks profile] [-out file] <rom>" << std::endl;
+      return 2;
+   }
+
+   chip8emu::Search search(config);
+   sSearch = &search;
+   std::signal(SIGINT, handleSignal);
+   std::signal(SIGTERM, handleSignal);
+
+   const bool solved = search.run(printProgress);
+   sSearch = nullptr;
+
+   const std::vector<std::uint16_t> trace = search.bestTrace();
+   if(!chip8emu::saveInputLog(output, trace)) {
+      std::cerr << "Failed to write " << output << "!" << std::endl;
+      return 1;
+   }
+
+   std::cout << (solved ? "Solution" : "Best trace") << " of " << trace.size() << " frames written to " << output << std::endl
+             << "Replay with: chip8emu -headless -frames " << trace.size() << " -seed " << config.seed
+             << " -cycles " << config.cyclesPerFrame << " -quirks " << chip8emu::quirksName(config.quirks) << " -input " << output << " " << config.rom << std::endl;
+
+   return solved || config.goalAddress == chip8emu::Search::NO_ADDRESS ? 0 : 1;
+}
@@ -0,0 +1,136 @@
+#include "../trace.h"
+#include "../disasm.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+// Offline decoder for execution traces written by chip8emu::Trace. Prints
+// the recorded instructions disassembled, optionally filtered by address
+// range, opcode pattern or written register, or a profile of the hottest
+// addresses.
+
+namespace
+{
+
+struct Filter
+{
+   std::uint16_t pcLow = 0x000;
+   std::uint16_t pcHigh = 0xFFFF;
+   std::string opcode; // Four hex digits, '?' matching any digit
+   int reg = -1;
+   std::size_t last = 0;
+   bool profile = false;
+};
+
+bool matchesOpcode(const std::string &pattern, std::uint16_t op)
+{
+   char hex[5];
+   std::snprintf(hex, sizeof(hex), "%04X", op);
+
+   for(std::size_t i = 0; i < 4 && i < pattern.size(); i++) {
+      if(pattern[i] != '?' && std::toupper(pattern[i]) != hex[i]) {
+         return false;
+      }
+   }
+
+   return true;
+}
+
+bool matches(const Filter &filter, const chip8emu::TraceRecord &record)
+{
+   return record.pc >= filter.pcLow && record.pc <= filter.pcHigh
+          && (filter.opcode.empty() || matchesOpcode(filter.opcode, record.op))
+          && (filter.reg < 0 || record.reg == filter.reg);
+}
+
+void printRecord(std::size_t index, const chip8emu::TraceRecord &record)
+{
+   char reg[8] = "";
+   if(record.reg != chip8emu::TraceRecord::NO_REGISTER) {
+      std::snprintf(reg, sizeof(reg), "V%X=%02X", record.reg, record.value);
+   }
+
+   std::printf("%8zu  0x%03X  %04X  %-18s %-6s I=%03X\n", index, record.pc, record.op,
+               chip8emu::disassemble(record.op).c_str(), reg, record.i);
+}
+
+void printProfile(const std::vector<std::size_t> &selected, const std::vector<chip8emu::TraceRecord> &records)
+{
+   std::map<std::uint16_t, std::size_t> hits;
+   for(const std::size_t index : selected) {
+      hits[records[index].pc]++;
+   }
+
+   std::vector<std::pair<std::uint16_t, std::size_t>> hottest(hits.begin(), hits.end());
+   std::sort(hottest.begin(), hottest.end(), [](const std::pair<std::uint16_t, std::size_t> &a,
+         const std::pair<std::uint16_t, std::size_t> &b) { return a.second > b.second; });
+
+   for(std::size_t i = 0; i < hottest.size() && i < 20; i++) {
+      std::printf("0x%03X  %8zu  %5.1f%%\n", hottest[i].first, hottest[i].second,
+                  100.0 * hottest[i].second / selected.size());
+   }
+}
+
+}
+
+int main(int argc, char **argv)
+{
+   Filter filter;
+   std::string filename;
+
+   for(int i = 1; i < argc; i++) {
+      const std::string arg = argv[i];
+      if(arg == "-pc" && i + 1 < argc) {
+         const std::string range = argv[++i];
+         const std::size_t dash = range.find('-');
+         filter.pcLow = std::stoul(range.substr(0, dash), nullptr, 16);
+         filter.pcHigh = dash == std::string::npos ? filter.pcLow : std::stoul(range.substr(dash + 1), nullptr, 16);
+      } else if(arg == "-op" && i + 1 < argc) {
+         filter.opcode = argv[++i];
+      } else if(arg == "-reg" && i + 1 < argc) {
+         filter.reg = std::stoul(argv[++i], nullptr, 16);
+      } else if(arg == "-last" && i + 1 < argc) {
+         filter.last = std::stoul(argv[++i]);
+      } else if(arg == "-profile") {
+         filter.profile = true;
+      } else {
+         filename = arg;
+      }
+   }
+
+   if(filename.empty()) {
+      std::cerr << "Usage: chip8trace [-pc lo[-hi]] [-op 8??4] [-reg X] [-last n] [-profile] <trace-file>" << std::endl;
+      return 2;
+   }
+
+   std::vector<chip8emu::TraceRecord> records;
+   if(!chip8emu::Trace::load(filename, records)) {
+      std::cerr << "Failed to read trace '" << filename << "'" << std::endl;
+      return 1;
+   }
+
+   std::vector<std::size_t> selected;
+   for(std::size_t i = 0; i < records.size(); i++) {
+      if(matches(filter, records[i])) {
+         selected.push_back(i);
+      }
+   }
+
+   if(filter.last > 0 && selected.size() > filter.last) {
+      selected.erase(selected.begin(), selected.end() - filter.last);
+   }
+
+   if(filter.profile) {
+      printProfile(selected, records);
+   } else {
+      for(const std::size_t index : selected) {
+         printRecord(index, records[index]);
+      }
+   }
+
+   return 0;
+}
@@ -0,0 +1,165 @@
+#include "trace.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <csignal>
+#include <cstring>
+#include <fstream>
+
+namespace
+{
+
+const char TRACE_MAGIC[4] = { 'C', '8', 'T', 'R' };
+const std::uint32_t TRACE_VERSION = 1;
+
+const int CRASH_SIGNALS[] = { SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT };
+
+std::size_t roundUp(std::size_t n)
+{
+   std::size_t capacity = 1;
+   while(capacity < n) {
+      capacity <<= 1;
+   }
+
+   return capacity;
+}
+
+}
+
+chip8emu::Trace *chip8emu::Trace::sCrashTrace = nullptr;
+
+chip8emu::Trace::Trace(const std::string &filename, std::size_t capacity)
+   : mFilename(filename), mMask(roundUp(capacity) - 1), mRing(mMask + 1), mHead(0)
+{
+}
+
+chip8emu::Trace::~Trace()
+{
+   if(sCrashTrace == this) {
+      sCrashTrace = nullptr;
+   }
+}
+
+std::uint8_t chip8emu::Trace::changedRegister(std::uint16_t op)
+{
+   switch(op & 0xF000) {
+   case 0x6000:
+   case 0x7000:
+   case 0x8000:
+   case 0xC000:
+      return (op & 0x0F00) >> 8;
+   case 0xD000:
+      return 0xF;
+   case 0xF000:
+      switch(op & 0x00FF) {
+      case 0x07:
+      case 0x0A:
+      case 0x65:
+      case 0x85:
+         return (op & 0x0F00) >> 8;
+      case 0x1E:
+         return 0xF;
+      }
+      break;
+   }
+
+   return TraceRecord::NO_REGISTER;
+}
+
+bool chip8emu::Trace::dump() const
+{
+   return dump(mFilename);
+}
+
+bool chip8emu::Trace::dump(const std::string &filename) const
+{
+   const int fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+   if(fd < 0) {
+      return false;
+   }
+
+   writeRaw(fd, *this);
+   return ::close(fd) == 0;
+}
+
+const std::string& chip8emu::Trace::filename() const
+{
+   return mFilename;
+}
+
+void chip8emu::Trace::writeRaw(int fd, const Trace &trace)
+{
+   // Only async signal safe calls here, this runs in the crash handler.
+   const std::uint64_t head = trace.mHead.load(std::memory_order_acquire);
+   const std::uint64_t size = trace.mRing.size();
+   const std::uint32_t count = head < size ? head : size;
+   const std::size_t first = (head - count) & trace.mMask;
+
+   ssize_t ignored = ::write(fd, TRACE_MAGIC, sizeof(TRACE_MAGIC));
+   ignored = ::write(fd, &TRACE_VERSION, sizeof(TRACE_VERSION));
+   ignored = ::write(fd, &count, sizeof(count));
+
+   // Oldest records first, the ring may wrap once.
+   const std::size_t tail = std::min<std::size_t>(count, size - first);
+   ignored = ::write(fd, &trace.mRing[first], tail * sizeof(TraceRecord));
+   ignored = ::write(fd, &trace.mRing[0], (count - tail) * sizeof(TraceRecord));
+   (void) ignored;
+}
+
+void chip8emu::Trace::installCrashHandler()
+{
+   sCrashTrace = this;
+
+   for(const int signal : CRASH_SIGNALS) {
+      std::signal(signal, &Trace::onCrash);
+   }
+}
+
+void chip8emu::Trace::onCrash(int signal)
+{
+   if(sCrashTrace != nullptr) {
+      const int fd = ::open(sCrashTrace->mFilename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+      if(fd >= 0) {
+         writeRaw(fd, *sCrashTrace);
+         ::close(fd);
+      }
+   }
+
+   // Let the default action terminate the process.
+   std::signal(signal, SIG_DFL);
+   std::raise(signal);
+}
+
+bool chip8emu::Trace::load(const std::string &filename, std::vector<TraceRecord> &records)
+{
+   std::ifstream file(filename, std::ios::in | std::ios::binary);
+   char magic[4];
+   std::uint32_t version, count;
+
+   if(!file.read(magic, sizeof(magic)) || std::memcmp(magic, TRACE_MAGIC, sizeof(magic)) != 0) {
+      return false;
+   }
+
+   file.read(reinterpret_cast<char*>(&version), sizeof(version));
+   file.read(reinterpret_cast<char*>(&count), sizeof(count));
+   if(!file || version != TRACE_VERSION) {
+      return false;
+   }
+
+   // Crash dumps may be truncated, the records must fit into the file
+   // before any memory is set aside for them.
+   const std::streamoff start = file.tellg();
+   file.seekg(0, std::ios::end);
+   const std::uint64_t remaining = file.tellg() - start;
+   file.seekg(start);
+   if(count * static_cast<std::uint64_t>(sizeof(TraceRecord)) > remaining) {
+      return false;
+   }
+
+   records.resize(count);
+   file.read(reinterpret_cast<char*>(records.data()), count * sizeof(TraceRecord));
+
+   return static_cast<bool>(file);
+}
@@ -0,0 +1,71 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace chip8emu
+{
+
+// One executed instruction, 8 bytes on disk and in memory.
+struct TraceRecord
+{
+   static const std::uint8_t NO_REGISTER = 0xFF;
+
+   std::uint16_t pc; // Address of the instruction
+   std::uint16_t op; // Executed opcode
+   std::uint16_t i; // Index register after execution
+   std::uint8_t reg; // Register written by the instruction or NO_REGISTER
+   std::uint8_t value; // Value of that register after execution
+};
+
+static_assert(sizeof(TraceRecord) == 8, "Trace records must stay packed");
+
+// Execution trace kept in a fixed size in-memory ring. The emulation thread
+// is the only writer, records are never locked or allocated, so tracing costs
+// a handful of stores per instruction. The ring can be written to a binary
+// file at any time, on invalid opcodes and from a crash signal handler, and
+// is decoded offline by chip8trace.
+class Trace
+{
+public:
+   Trace(const std::string &filename, std::size_t capacity = 1 << 16);
+   ~Trace();
+
+   inline void record(std::uint16_t pc, std::uint16_t op, std::uint16_t i, std::uint8_t reg, std::uint8_t value)
+   {
+      const std::uint64_t head = mHead.load(std::memory_order_relaxed);
+      mRing[head & mMask] = TraceRecord { pc, op, i, reg, value };
+      mHead.store(head + 1, std::memory_order_release);
+   }
+
+   // Register written by an opcode, VF for instructions only setting flags.
+   static std::uint8_t changedRegister(std::uint16_t op);
+
+   bool dump() const;
+   bool dump(const std::string &filename) const;
+   const std::string& filename() const;
+
+   // Writes the ring to the trace file if the process receives SIGSEGV,
+   // SIGBUS, SIGFPE, SIGILL or SIGABRT.
+   void installCrashHandler();
+
+   static bool load(const std::string &filename, std::vector<TraceRecord> &records);
+
+private:
+   static void onCrash(int signal);
+   static void writeRaw(int fd, const Trace &trace);
+
+   const std::string mFilename;
+   const std::size_t mMask;
+   std::vector<TraceRecord> mRing;
+   std::atomic<std::uint64_t> mHead; // Number of records ever written
+
+   static Trace *sCrashTrace; // Trace dumped by the crash handler
+};
+
+}
+
+#endif // TRACE_H
@@ -0,0 +1,125 @@
+#include "vecenv.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+
+// Instances stepped per claimed chunk, enough to amortize the scheduling.
+const std::size_t STEP_GRAIN = 8;
+
+}
+
+chip8emu::VecEnv::VecEnv(std::size_t instances, const Config &config)
+   : mConfig(config), mObservationSize(config.format == FORMAT_BITS ? 32 * sizeof(std::uint64_t) : 64 * 32),
+     mPool(config.threads)
+{
+   // Load the rom once, instances are reset from this machine.
+   mInitialPpu = std::make_shared<PPU>();
+   mInitial = std::make_unique<CPU>(mInitialPpu);
+   mInitial->setQuirks(config.quirks);
+   mInitial->setCyclesPerFrame(config.cyclesPerFrame);
+   mInitial->seed(config.seed);
+   mInitial->loadRom(config.rom);
+
+   // All instances share one allocation.
+   mMemory.resize(MachineArena::bytesFor(instances));
+   mArena = std::make_unique<MachineArena>(mMemory.data(), mMemory.size());
+
+   mInstances.resize(instances);
+   for(std::size_t i = 0; i < instances; i++) {
+      Instance &instance = mInstances[i];
+      instance.machine = mArena->create(config.seed);
+      instance.episode = 0;
+      resetInstance(i);
+   }
+}
+
+chip8emu::VecEnv::~VecEnv()
+{
+
+}
+
+std::size_t chip8emu::VecEnv::instances() const
+{
+   return mInstances.size();
+}
+
+std::size_t chip8emu::VecEnv::observationBytes() const
+{
+   return mInstances.size() * mObservationSize;
+}
+
+void chip8emu::VecEnv::reset(std::uint8_t *observations)
+{
+   mPool.parallelFor(mInstances.size(), STEP_GRAIN, [this, observations](std::size_t begin, std::size_t end) {
+      for(std::size_t i = begin; i < end; i++) {
+         resetInstance(i);
+         observe(i, observations);
+      }
+   });
+}
+
+void chip8emu::VecEnv::step(const std::uint16_t *actions, std::uint8_t *observations, float *rewards, std::uint8_t *dones)
+{
+   mPool.parallelFor(mInstances.size(), STEP_GRAIN, [&](std::size_t begin, std::size_t end) {
+      for(std::size_t i = begin; i < end; i++) {
+         Instance &instance = mInstances[i];
+
+         instance.machine->cpu.setKeys(actions[i]);
+         instance.machine->cpu.runFrames(mConfig.framesPerStep);
+         instance.frames += mConfig.framesPerStep;
+
+         // The reward is the change of the score byte, wrapping like a counter.
+         const std::uint8_t score = peek(instance, mConfig.rewardAddress);
+         rewards[i] = static_cast<std::int8_t>(score - instance.score);
+         instance.score = score;
+
+         const bool done = (mConfig.doneAddress != NO_ADDRESS && peek(instance, mConfig.doneAddress) == mConfig.doneValue)
+                           || (mConfig.maxFrames > 0 && instance.frames >= mConfig.maxFrames);
+         dones[i] = done ? 1 : 0;
+
+         if(done) {
+            resetInstance(i);
+         }
+
+         observe(i, observations);
+      }
+   });
+}
+
+void chip8emu::VecEnv::resetInstance(std::size_t index)
+{
+   Instance &instance = mInstances[index];
+
+   // Every episode of every instance gets its own seed.
+   instance.machine->cpu.copyState(*mInitial);
+   instance.machine->cpu.seed(mConfig.seed + index + instance.episode * mInstances.size());
+   instance.score = peek(instance, mConfig.rewardAddress);
+   instance.frames = 0;
+   instance.episode++;
+}
+
+void chip8emu::VecEnv::observe(std::size_t index, std::uint8_t *observations) const
+{
+   const PPU &ppu = mInstances[index].machine->ppu;
+   std::uint8_t *out = observations + index * mObservationSize;
+
+   for(std::uint8_t y = 0; y < 32; y++) {
+      const std::uint64_t bits = ppu.row(y)[0];
+
+      if(mConfig.format == FORMAT_BITS) {
+         std::memcpy(out + y * sizeof(bits), &bits, sizeof(bits));
+      } else {
+         for(std::uint8_t x = 0; x < 64; x++) {
+            out[y * 64 + x] = (bits >> (63 - x)) & 1;
+         }
+      }
+   }
+}
+
+std::uint8_t chip8emu::VecEnv::peek(const Instance &instance, std::uint16_t addr) const
+{
+   return addr != NO_ADDRESS ? instance.machine->cpu.peek(addr) : 0;
+}
@@ -0,0 +1,95 @@
+#ifndef VEC_ENV_H
+#define VEC_ENV_H
+
+#include "arena.h"
+#include "cpu.h"
+#include "ppu.h"
+#include "threadpool.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace chip8emu
+{
+
+// Vectorized environment for reinforcement learning, holding many instances
+// of one rom and stepping all of them in parallel on a thread pool.
+//
+// Observations are written straight into a caller owned buffer holding the
+// framebuffers of all instances back to back, either one byte per pixel
+// (0 or 1, 64x32 bytes per instance) or bit-packed like PPU::row() (32 words
+// of 64 bits per instance) of the first plane. Hires displays only show
+// their top left quarter. Rewards and episode ends are read from memory
+// addresses of the game. Finished instances are reset from a cached copy of
+// the freshly loaded machine instead of loading the rom again.
+class VecEnv
+{
+public:
+   static const std::uint16_t NO_ADDRESS = 0xFFFF;
+
+   enum Format
+   {
+      FORMAT_BYTES, // One byte per pixel
+      FORMAT_BITS // One bit per pixel, one 64 bit word per row
+   };
+
+   struct Config
+   {
+      std::string rom;
+      Quirks quirks = QUIRKS_DEFAULT;
+      std::uint32_t seed = 0; // Seed of the first episode of the first instance
+      std::uint32_t framesPerStep = 1; // 60Hz frames emulated per step
+      std::uint32_t cyclesPerFrame = 10;
+      std::uint16_t rewardAddress = NO_ADDRESS; // The reward is the change of this byte
+      std::uint16_t doneAddress = NO_ADDRESS; // The episode ends once this byte ...
+      std::uint8_t doneValue = 1; // ... equals this value
+      std::uint32_t maxFrames = 0; // Episode length limit, 0 for none
+      Format format = FORMAT_BYTES;
+      std::size_t threads = 0; // Worker threads, 0 for one per hardware thread
+   };
+
+   VecEnv(std::size_t instances, const Config &config);
+   ~VecEnv();
+
+   std::size_t instances() const;
+
+   // Size of the observation buffer for all instances.
+   std::size_t observationBytes() const;
+
+   // Resets all instances and writes their observations.
+   void reset(std::uint8_t *observations);
+
+   // Applies one pad mask per instance for framesPerStep frames. Instances
+   // whose episode ended are reset, their observation then shows the first
+   // frame of the next episode while 'dones' reports the end.
+   void step(const std::uint16_t *actions, std::uint8_t *observations, float *rewards, std::uint8_t *dones);
+
+private:
+   struct Instance
+   {
+      Machine *machine; // Slot in mArena
+      std::uint8_t score; // Last value at the reward address
+      std::uint32_t frames; // Frames of the current episode
+      std::uint32_t episode; // Number of started episodes
+   };
+
+   void resetInstance(std::size_t index);
+   void observe(std::size_t index, std::uint8_t *observations) const;
+   std::uint8_t peek(const Instance &instance, std::uint16_t addr) const;
+
+   const Config mConfig;
+   const std::size_t mObservationSize; // Bytes per instance observation
+
+   std::shared_ptr<PPU> mInitialPpu;
+   std::unique_ptr<CPU> mInitial; // Machine right after loading the rom
+   std::vector<unsigned char> mMemory; // Slots of all instances, ...
+   std::unique_ptr<MachineArena> mArena; // ... constructed in place
+   std::vector<Instance> mInstances;
+   ThreadPool mPool;
+};
+
+}
+
+#endif // VEC_ENV_H